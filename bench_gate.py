@@ -0,0 +1,241 @@
+#! /usr/bin/env python3
+
+#
+# Runs a fixed suite of deterministic paging workloads under each policy,
+# and compares their page loads, writebacks and wall time against a stored
+# baseline, failing if any of them has regressed.  Every case runs with
+# virtual-time policy ticks (--vtick) and a fixed seed, so the counts are
+# exact and must match the baseline unless a tolerance is given.  Times vary
+# from run to run, so a case's time only counts as regressed if its median
+# is both more than --time-tolerance above the baseline's and above it by
+# more than --sigmas times the noise (the larger of the two runs' median
+# absolute deviations, scaled to a standard deviation).
+#
+# Times depend on the machine, so record a baseline on the machine that runs
+# the gate, or pass --no-time elsewhere.
+#
+# Example:
+#
+#   ./bench_gate.py --update            # record bench_baseline.json
+#   ./bench_gate.py                     # compare against it
+#
+
+import argparse, json, os, statistics, sys
+
+from bench_sweep import POLICY_SUFFIX, run_point
+
+#
+# Constants.
+#
+
+# The suite:  each case's name, program, max_resident, size and options.
+SUITE = [
+    ("matmul-naive", "test_matrix", 64, 200, ""),
+    ("matmul-tiled", "test_matrix", 64, 300, "--algorithm tiled"),
+    ("scan-seq",     "vmem_bench",  64, 512, "--pattern seq --refs 10000"),
+    ("scan-loop",    "vmem_bench",  64, 512, "--pattern loop --refs 10000"),
+    ("zipf",         "vmem_bench",  64, 1024,
+     "--pattern zipf --writes 0.3 --refs 10000"),
+]
+
+# The policies the suite runs under.
+POLICIES = ["random", "fifo", "clru"]
+
+# The counts compared exactly (or within --count-tolerance).
+COUNTS = ["loads", "writebacks"]
+
+# Scales a median absolute deviation to a standard deviation, for normally
+# distributed times.
+MAD_SCALE = 1.4826
+
+
+def run_case(args, case, policy):
+    """
+    Run one case under one policy args.repeats times, and return its counts
+    and its times' median and median absolute deviation, or None if any run
+    failed or the counts differed between runs.
+    """
+    name, program, max_resident, size, options = case
+    sweep_args = argparse.Namespace(program=program, dir=args.dir,
+                                    timeout=args.timeout)
+    extra = "%s --vtick %d" % (options, args.vtick)
+
+    runs = [run_point(sweep_args, policy, max_resident, size, extra,
+                      args.seed) for r in range(args.repeats)]
+    if not all(run["ok"] for run in runs):
+        return None
+    for metric in COUNTS:
+        if len(set(run[metric] for run in runs)) != 1:
+            print("%s/%s: %s differ between runs; are ticks virtual?" %
+                  (name, policy, metric), file=sys.stderr)
+            return None
+
+    seconds = [run["seconds"] for run in runs]
+    median = statistics.median(seconds)
+    result = {metric: runs[0][metric] for metric in COUNTS}
+    result["seconds"] = {
+        "median": round(median, 4),
+        "mad": round(statistics.median(abs(s - median) for s in seconds), 4),
+    }
+    return result
+
+
+def run_suite(args):
+    """
+    Run every case under every policy, printing progress to stderr, and
+    return a dictionary of the results keyed by "case/policy".
+    """
+    results = {}
+    for case in SUITE:
+        for policy in args.policies:
+            key = "%s/%s" % (case[0], policy)
+            print("running %s" % key, file=sys.stderr)
+            results[key] = run_case(args, case, policy)
+    return results
+
+
+def compare_count(base, cur, tolerance):
+    """
+    Return "ok", "improved" or "REGRESSED" for a count, allowing it to grow
+    by the given fraction of the baseline.
+    """
+    if cur > base + tolerance * base:
+        return "REGRESSED"
+    return "improved" if cur < base else "ok"
+
+
+def compare_time(base, cur, args):
+    """
+    Return "ok", "improved" or "REGRESSED" for a case's time, given the
+    baseline's and the current run's median and MAD.
+    """
+    noise = MAD_SCALE * max(base["mad"], cur["mad"])
+    diff = cur["median"] - base["median"]
+    if diff > args.time_tolerance * base["median"] and \
+       diff > args.sigmas * noise:
+        return "REGRESSED"
+    if -diff > args.time_tolerance * base["median"] and \
+       -diff > args.sigmas * noise:
+        return "improved"
+    return "ok"
+
+
+def change(base, cur):
+    """
+    Format the relative change from base to cur.
+    """
+    if base == 0:
+        return "-" if cur == 0 else "new"
+    return "%+.1f%%" % (100.0 * (cur - base) / base)
+
+
+def compare(args, baseline, results):
+    """
+    Print a table of every metric that changed (or every metric, with
+    --verbose), and return the number of regressions and failures.
+    """
+    rows, bad = [], 0
+    for key, cur in results.items():
+        base = baseline.get(key)
+        if cur is None:
+            rows.append((key, "-", "-", "-", "-", "FAILED"))
+            bad += 1
+            continue
+        if base is None:
+            rows.append((key, "-", "-", "-", "-", "no baseline"))
+            continue
+
+        for metric in COUNTS:
+            status = compare_count(base[metric], cur[metric],
+                                   args.count_tolerance)
+            rows.append((key, metric, str(base[metric]), str(cur[metric]),
+                         change(base[metric], cur[metric]), status))
+
+        if not args.no_time:
+            b, c = base["seconds"], cur["seconds"]
+            rows.append((key, "seconds", "%.3f" % b["median"],
+                         "%.3f" % c["median"], change(b["median"], c["median"]),
+                         compare_time(b, c, args)))
+
+    bad += sum(1 for row in rows if row[5] == "REGRESSED")
+    shown = [row for row in rows if args.verbose or row[5] != "ok"]
+    if shown:
+        print("%-22s %-10s %10s %10s %8s  %s" %
+              ("case/policy", "metric", "baseline", "current", "change",
+               "status"))
+        for row in shown:
+            print("%-22s %-10s %10s %10s %8s  %s" % row)
+    print("%d checks, %d regressions or failures" % (len(rows), bad))
+    return bad
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Check the paging test programs' page loads, writebacks "
+                    "and times against a stored baseline.")
+    parser.add_argument("--baseline", default="bench_baseline.json",
+                        help="baseline file to compare against or update")
+    parser.add_argument("--update", action="store_true",
+                        help="record the results as the new baseline instead "
+                             "of comparing")
+    parser.add_argument("--dir", default=".",
+                        help="directory holding the built programs")
+    parser.add_argument("--policies", default=",".join(POLICIES),
+                        type=lambda s: s.split(","),
+                        help="comma-separated paging policies")
+    parser.add_argument("--repeats", default=5, type=int,
+                        help="runs per case, for the time statistics")
+    parser.add_argument("--seed", default=1, type=int,
+                        help="seed for every run")
+    parser.add_argument("--vtick", default=64, type=int,
+                        help="faults per virtual-time policy tick")
+    parser.add_argument("--count-tolerance", default=0.0, type=float,
+                        help="fraction by which a count may grow")
+    parser.add_argument("--time-tolerance", default=0.25, type=float,
+                        help="fraction by which a median time may grow")
+    parser.add_argument("--sigmas", default=3.0, type=float,
+                        help="standard deviations of noise a time must grow "
+                             "by to regress")
+    parser.add_argument("--no-time", action="store_true",
+                        help="don't compare times")
+    parser.add_argument("--timeout", default=600, type=float,
+                        help="seconds to allow each run")
+    parser.add_argument("--verbose", action="store_true",
+                        help="show every check, not just the changed ones")
+    args = parser.parse_args()
+
+    for policy in args.policies:
+        if policy not in POLICY_SUFFIX:
+            parser.error("unknown policy %s" % policy)
+
+    if not args.update and not os.path.exists(args.baseline):
+        parser.error("no baseline %s; record one with --update" %
+                     args.baseline)
+
+    results = run_suite(args)
+
+    if args.update:
+        failed = [key for key, result in results.items() if result is None]
+        if failed:
+            print("not updating; failed: %s" % ", ".join(failed),
+                  file=sys.stderr)
+            sys.exit(1)
+        with open(args.baseline, "w") as f:
+            json.dump({"vtick": args.vtick, "seed": args.seed,
+                       "results": results}, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("wrote %s" % args.baseline)
+        return
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if baseline["vtick"] != args.vtick or baseline["seed"] != args.seed:
+        parser.error("the baseline was recorded with --vtick %d --seed %d" %
+                     (baseline["vtick"], baseline["seed"]))
+
+    if compare(args, baseline["results"], results):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
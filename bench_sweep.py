@@ -0,0 +1,205 @@
+#! /usr/bin/env python3
+
+#
+# Sweeps the test programs over paging policies, max_resident values,
+# problem sizes and extra engine options, running each point several times
+# with fixed seeds, and writes the page loads, faults, writebacks, wall time
+# and faults per second of every point, with their median and spread, as CSV
+# and/or JSON.  Sweeping max_resident for a fixed program and size gives a
+# miss-ratio curve per policy.
+#
+# Example:
+#
+#   ./bench_sweep.py --program test_matrix --policies random,fifo,clru \
+#       --max-resident 64,128,256,512 --sizes 200 --extra "" \
+#       --extra "--algorithm tiled" --repeats 3 --csv sweep.csv
+#
+
+import argparse, csv, json, os, re, shlex, statistics, subprocess, sys, time
+
+#
+# Constants.
+#
+
+# The binary suffix for each policy, as built by the Makefile.  "kernel" is
+# the kernel-paging baseline, which is only built for test_matrix.
+POLICY_SUFFIX = {"random": "", "fifo": "_fifo", "clru": "_clru",
+                 "kernel": "_kernel"}
+
+# The totals that every test program prints at the end of a run.
+TOTALS = {
+    "loads":      re.compile(r"^Total page loads:\s+(\d+)", re.M),
+    "faults":     re.compile(r"^Total faults:\s+(\d+)", re.M),
+    "writebacks": re.compile(r"^Total writebacks:\s+(\d+)", re.M),
+}
+
+# The measurements summarized for each point.
+METRICS = ["loads", "faults", "writebacks", "seconds", "faults_per_sec"]
+
+
+def int_list(text):
+    """
+    Parse a comma-separated list of integers.
+    """
+    return [int(x) for x in text.split(",") if x]
+
+
+def run_point(args, policy, max_resident, size, extra, seed):
+    """
+    Run the program once, and return a dictionary of its measurements.
+    """
+    program = os.path.join(args.dir, args.program + POLICY_SUFFIX[policy])
+    cmd = [program, "-s", str(seed), "-m", str(max_resident)] + \
+          shlex.split(extra) + [str(size)]
+
+    start = time.perf_counter()
+    try:
+        proc = subprocess.run(cmd, stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL,
+                              universal_newlines=True, timeout=args.timeout)
+        output, ok = proc.stdout, proc.returncode == 0
+    except subprocess.TimeoutExpired:
+        output, ok = "", False
+    seconds = time.perf_counter() - start
+
+    run = {"seed": seed, "seconds": seconds,
+           "ok": ok and "ERROR" not in output}
+    for name, pattern in TOTALS.items():
+        match = pattern.search(output)
+        run[name] = int(match.group(1)) if match else None
+        if match is None:
+            run["ok"] = False
+    run["faults_per_sec"] = \
+        run["faults"] / seconds if run["faults"] is not None else None
+    return run
+
+
+def summarize(runs):
+    """
+    Return the median, minimum, maximum and relative spread ((max - min) /
+    median) of each metric over the successful runs.
+    """
+    summary = {}
+    for metric in METRICS:
+        values = [r[metric] for r in runs if r["ok"]]
+        if not values:
+            continue
+        median = statistics.median(values)
+        summary[metric] = {
+            "median": median,
+            "min": min(values),
+            "max": max(values),
+            "spread": (max(values) - min(values)) / median if median else 0.0,
+        }
+    return summary
+
+
+def sweep(args):
+    """
+    Run every point of the sweep, printing progress to stderr, and return
+    the list of points.
+    """
+    points = []
+    for policy in args.policies:
+        for size in args.sizes:
+            for extra in args.extra:
+                for max_resident in args.max_resident:
+                    point = {"program": args.program, "policy": policy,
+                             "max_resident": max_resident, "size": size,
+                             "options": extra, "runs": []}
+                    for r in range(args.repeats):
+                        run = run_point(args, policy, max_resident, size,
+                                        extra, args.seed + r)
+                        point["runs"].append(run)
+                    point["summary"] = summarize(point["runs"])
+                    point["failures"] = \
+                        sum(1 for run in point["runs"] if not run["ok"])
+                    points.append(point)
+
+                    loads = point["summary"].get("loads", {})
+                    print("%-7s m=%-5d size=%-5d %-20s loads %s%s" %
+                          (policy, max_resident, size, extra or "-",
+                           loads.get("median", "-"),
+                           "  (%d failed)" % point["failures"]
+                           if point["failures"] else ""),
+                          file=sys.stderr)
+    return points
+
+
+def write_csv(points, path):
+    """
+    Write one row per point, with the median, minimum, maximum and spread of
+    each metric.
+    """
+    fields = ["program", "policy", "max_resident", "size", "options",
+              "runs", "failures"]
+    for metric in METRICS:
+        fields += [metric + "_" + stat
+                   for stat in ("median", "min", "max", "spread")]
+
+    with open(path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        for point in points:
+            row = {key: point[key] for key in fields[:5]}
+            row["runs"] = len(point["runs"])
+            row["failures"] = point["failures"]
+            for metric, stats in point["summary"].items():
+                for stat, value in stats.items():
+                    row[metric + "_" + stat] = value
+            writer.writerow(row)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Sweep the paging test programs over policies, "
+                    "max_resident values, sizes and options.")
+    parser.add_argument("--program", default="test_matrix",
+                        help="test program to run (test_matrix, "
+                             "test_workloads or vmem_bench)")
+    parser.add_argument("--dir", default=".",
+                        help="directory holding the built programs")
+    parser.add_argument("--policies", default="random,fifo,clru",
+                        type=lambda s: s.split(","),
+                        help="comma-separated paging policies; "
+                             "\"kernel\" runs test_matrix's kernel-paging "
+                             "baseline")
+    parser.add_argument("--max-resident", default="64,128,256,512",
+                        type=int_list,
+                        help="comma-separated max_resident values")
+    parser.add_argument("--sizes", default="200", type=int_list,
+                        help="comma-separated problem sizes")
+    parser.add_argument("--extra", action="append",
+                        help="extra options for the program; repeat to "
+                             "sweep over several sets")
+    parser.add_argument("--repeats", default=3, type=int,
+                        help="runs per point")
+    parser.add_argument("--seed", default=1, type=int,
+                        help="seed of the first run of each point; later "
+                             "runs use the following seeds")
+    parser.add_argument("--timeout", default=600, type=float,
+                        help="seconds to allow each run")
+    parser.add_argument("--csv", help="file to write the summary CSV to")
+    parser.add_argument("--json", help="file to write every run to, as JSON")
+    args = parser.parse_args()
+
+    for policy in args.policies:
+        if policy not in POLICY_SUFFIX:
+            parser.error("unknown policy %s" % policy)
+    if args.extra is None:
+        args.extra = [""]
+
+    points = sweep(args)
+
+    if args.csv:
+        write_csv(points, args.csv)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"points": points}, f, indent=2)
+
+    if any(point["failures"] for point in points):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,282 @@
+/*============================================================================
+ * A microbenchmark for the virtual memory system's fault path.  It drives
+ * each kind of fault on its own, and uses the timings that a VMEM_PROFILE
+ * build of the virtual memory system records inside the SIGSEGV handler to
+ * break the cost of each kind down by stage:  signal delivery, the policy,
+ * writing back the victim, munmap(), mmap(), reading the page in, and
+ * mprotect().
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "virtualmem.h"
+#include "vmalloc.h"
+
+#if !VMEM_PROFILE
+#error "fault_bench must be built with -DVMEM_PROFILE=1"
+#endif
+
+#define DEFAULT_MAX_RESIDENT 64
+
+
+static unsigned int max_resident = DEFAULT_MAX_RESIDENT;
+static int rounds = 4;
+static int size;                    /* Buffer size in pages. */
+
+/* Timestamp ticks per nanosecond, measured at startup. */
+static double ticks_per_ns;
+
+/* The totals of each access the benchmark makes, and of the time from the
+ * end of each access's last fault until the access completed.
+ */
+static unsigned long num_accesses;
+static uint64_t access_ticks;
+static uint64_t return_ticks;
+
+
+/* Prints the program's usage, and then exit the program. */
+void usage(const char *prog) {
+    printf("usage: %s [--max_resident num] [--rounds num] size\n", prog);
+    printf("\tTimes each kind of fault on a size-page buffer in the virtual\n");
+    printf("\tmemory pool, which must be larger than max_resident.\n\n");
+    printf("\t--max_resident | -m num specifies the maximum number of pages\n");
+    printf("\tthat may be resident in the virtual memory system.\n\n");
+    printf("\t--rounds | -r num sets the number of passes over the buffer\n");
+    printf("\tfor each kind of fault (default 4).\n");
+    exit(1);
+}
+
+
+/* Parse the command-line arguments passed to the program. */
+void parse_args(int argc, char **argv) {
+    int c;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"max_resident", required_argument, 0, 'm'},
+            {"rounds",       required_argument, 0, 'r'},
+            {0, 0, 0, 0}
+        };
+
+        /* getopt_long stores the option index here. */
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "m:r:", long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'm':
+            max_resident = atoi(optarg);
+            printf("Max resident pages = %d\n", max_resident);
+            break;
+
+        case 'r':
+            rounds = atoi(optarg);
+            if (rounds <= 0)
+                usage(argv[0]);
+            break;
+
+        case '?':
+            /* getopt_long already printed an error message. */
+            usage(argv[0]);
+            /* usage() will exit the program. */
+            break;
+
+        default:
+            abort();
+        }
+    }
+
+    if (optind + 1 != argc)
+        usage(argv[0]);
+
+    size = atoi(argv[optind]);
+    if (size <= (int) max_resident)
+        usage(argv[0]);
+}
+
+
+/* Measures how many timestamp ticks there are per nanosecond, by watching the
+ * timestamp over 50ms of the monotonic clock.
+ */
+static void calibrate(void) {
+    struct timespec start, now;
+    uint64_t t0, t1;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    t0 = vmem_timestamp();
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ns = (now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec);
+    } while (ns < 50e6);
+    t1 = vmem_timestamp();
+
+    ticks_per_ns = (t1 - t0) / ns;
+}
+
+
+/* Reads or writes the first word of page i of the buffer, timing the whole
+ * access and the return from its last fault.
+ */
+static void touch(volatile uint64_t *buffer, int i, int write) {
+    uint64_t start, end;
+
+    start = vmem_timestamp();
+    vmem_profile_mark = start;
+    if (write)
+        buffer[i * (PAGE_SIZE / 8)] = i;
+    else
+        (void) buffer[i * (PAGE_SIZE / 8)];
+    end = vmem_timestamp();
+
+    num_accesses++;
+    access_ticks += end - start;
+    return_ticks += end - vmem_profile_mark;
+}
+
+
+/* Clears the timings before a measured phase. */
+static void start_phase(const char *title) {
+    printf("%s\n", title);
+    vmem_reset_profile();
+    num_accesses = 0;
+    access_ticks = 0;
+    return_ticks = 0;
+}
+
+
+/* Prints the timings of a measured phase, in nanoseconds per access and per
+ * fault of each kind.
+ */
+static void report_phase(void) {
+    static const char *kind_names[VMEM_NUM_FAULT_KINDS] = {
+        "map clean", "map dirty", "read", "write"
+    };
+    vmem_profile_t p;
+    double per_fault[VMEM_NUM_STAGES], other;
+    int kind, stage;
+
+    vmem_get_profile(&p);
+
+    printf(" * %lu accesses, %.0f ns each, %.0f ns of it returning from the"
+           " last fault\n", num_accesses,
+           access_ticks / ticks_per_ns / num_accesses,
+           return_ticks / ticks_per_ns / num_accesses);
+    printf("   kind       faults deliver handler policy wrback munmap   mmap"
+           "   read mprot  other\n");
+
+    for (kind = 0; kind < VMEM_NUM_FAULT_KINDS; kind++) {
+        if (p.faults[kind] == 0)
+            continue;
+
+        for (stage = 0; stage < VMEM_NUM_STAGES; stage++) {
+            per_fault[stage] =
+                p.ticks[kind][stage] / ticks_per_ns / p.faults[kind];
+        }
+        other = per_fault[VMEM_STAGE_HANDLER];
+        for (stage = VMEM_STAGE_POLICY; stage < VMEM_NUM_STAGES; stage++)
+            other -= per_fault[stage];
+
+        printf("   %-9s %7lu %7.0f %7.0f %6.0f %6.0f %6.0f %6.0f %6.0f"
+               " %5.0f %6.0f\n", kind_names[kind], p.faults[kind],
+               per_fault[VMEM_STAGE_DELIVERY], per_fault[VMEM_STAGE_HANDLER],
+               per_fault[VMEM_STAGE_POLICY], per_fault[VMEM_STAGE_WRITEBACK],
+               per_fault[VMEM_STAGE_MUNMAP], per_fault[VMEM_STAGE_MMAP],
+               per_fault[VMEM_STAGE_READ], per_fault[VMEM_STAGE_MPROTECT],
+               other);
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char **argv) {
+    volatile uint64_t *buffer;
+    int i, r, first, batch;
+
+    /* Parse arguments */
+    parse_args(argc, argv);
+
+    printf("Options:\n");
+    printf(" * Max resident pages = %u\n", max_resident);
+    printf(" * Buffer of %d pages, %d rounds\n", size, rounds);
+    printf("\n");
+
+    calibrate();
+    printf("Timestamp counter runs at %.3f ticks per ns\n\n", ticks_per_ns);
+
+    /* Initialize the virtual memory system. */
+    vmem_init(max_resident);
+    vmem_alloc_init();
+
+    buffer = vmem_alloc_aligned(size * PAGE_SIZE, PAGE_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Couldn't allocate a buffer of %d pages\n", size);
+        exit(1);
+    }
+
+    /* Reading pages that aren't resident, once memory is full of pages that
+     * have only been read, makes each access a clean miss and then a first
+     * read.
+     */
+    for (i = 0; i < size; i++)
+        touch(buffer, i, 0);
+    start_phase("Reading pages that aren't resident (clean victims)");
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < size; i++)
+            touch(buffer, i, 0);
+    }
+    report_phase();
+
+    /* Writing them instead, once every page is dirty, adds a write fault and
+     * makes every victim dirty.
+     */
+    for (i = 0; i < size; i++)
+        touch(buffer, i, 1);
+    start_phase("Writing pages that aren't resident (dirty victims)");
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < size; i++)
+            touch(buffer, i, 1);
+    }
+    report_phase();
+
+    /* Pinning maps pages in without touching them, so reading and then
+     * writing pinned pages times the permission faults on their own.
+     */
+    start_phase("Reading and then writing resident pages");
+    batch = max_resident / 2;
+    for (r = 0; r < rounds; r++) {
+        for (first = 0; first + batch <= size; first += batch) {
+            if (!vmem_pin((void *) (buffer + first * (PAGE_SIZE / 8)),
+                          batch * PAGE_SIZE)) {
+                fprintf(stderr, "Couldn't pin %d pages\n", batch);
+                exit(1);
+            }
+            for (i = first; i < first + batch; i++)
+                touch(buffer, i, 0);
+            for (i = first; i < first + batch; i++)
+                touch(buffer, i, 1);
+            vmem_unpin((void *) (buffer + first * (PAGE_SIZE / 8)),
+                       batch * PAGE_SIZE);
+        }
+    }
+    report_phase();
+
+    printf("Done!\n\n");
+
+    printf("Total page loads:  %u\n", get_num_loads());
+    printf("Total faults:  %u\n", get_num_faults());
+    printf("Total writebacks:  %u\n", get_num_writebacks());
+
+    vmem_cleanup();
+
+    return 0;
+}
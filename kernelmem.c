@@ -0,0 +1,758 @@
+/* ============================================================================
+ * A stand-in for the user-space virtual memory system that leaves the paging
+ * to the kernel, so that the pager's results can be compared against the
+ * kernel's own reclaim on exactly the same programs.  It implements the
+ * interface in virtualmem.h, and programs are linked against it instead of
+ * virtualmem.c and a paging policy.
+ *
+ * The pool is a shared mapping of a swap file at the same address the pager
+ * uses, so the kernel loads pages from the file on major faults and writes
+ * them back to it when it reclaims them.  The number of resident pages is
+ * held to max_resident in one of two ways:
+ *
+ *  -  If the process can make a child of its cgroup with a memory controller
+ *     (cgroup v2), it moves itself in there, and each timer tick sets the
+ *     child's memory.max to whatever the process is using besides page cache
+ *     plus max_resident pages.  The kernel then reclaims the pool's pages
+ *     itself, with its own LRU lists.
+ *
+ *  -  Otherwise each timer tick asks mincore() which pages of the pool are in
+ *     the page cache, and drops the ones that have been there longest until
+ *     only max_resident are left, writing them back first.  This is coarser,
+ *     since the pool can overshoot between ticks, and oldest-first is only
+ *     an approximation of the kernel's reclaim order.
+ *
+ * Page loads and writebacks are the pages that the kernel's I/O accounting
+ * says the process read and wrote.  The pool is mapped with MADV_RANDOM, so
+ * the kernel doesn't read ahead on faults and its readahead pages don't count
+ * against the limit.  getrusage()'s count of major faults is reported
+ * separately.
+ */
+
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "virtualmem.h"
+
+
+/* The pool is at the same address as the pager's; see virtualmem.c. */
+#define VIRTUALMEM_ADDR_START 0x20000000
+
+/* The timer signal is set to trigger on this interval, currently 10ms. */
+#define TIMESLICE_SEC 0
+#define TIMESLICE_USEC 10000
+
+
+/* ============================================================================
+ * Global state
+ */
+
+static void *vmem_start;
+static void *vmem_end;
+
+/* The filename and file-descriptor of the swap file. */
+static char swapfile[40];
+static int fd_swapfile;
+
+/* The maximum number of pages that may be resident in memory. */
+static unsigned int max_resident;
+
+/* The pages that vmem_pin() has locked into memory. */
+static unsigned char pinned[NUM_PAGES];
+static unsigned int num_pinned;
+
+/* The cgroup that the process moved itself into, and the one it came from,
+ * or empty strings if the limit is enforced by trimming instead.
+ */
+static char cgroup_dir[PATH_MAX];
+static char parent_dir[PATH_MAX];
+
+/* The pages that trimming has seen in the page cache, oldest first, as a
+ * circular queue; queued[p] is nonzero if page p is in it.
+ */
+static page_t resident_queue[NUM_PAGES];
+static unsigned int queue_head, queue_len;
+static unsigned char queued[NUM_PAGES];
+
+/* The process's fault counts and bytes read and written when vmem_init()
+ * ran.
+ */
+static struct rusage start_usage;
+static unsigned long start_read_bytes, start_write_bytes;
+
+/* The pages trimming has dropped, the timer ticks, and the time spent in
+ * them, since vmem_init(); and the statistics as of the last
+ * vmem_reset_stats(), counted from vmem_init().
+ */
+static uint64_t num_evictions, num_ticks, tick_ns;
+static vmem_stats_t stats_base;
+
+
+/* ============================================================================
+ * Helper Functions
+ */
+
+
+/* Returns the start of the virtual memory pool. */
+void * get_vmem_start() {
+    return vmem_start;
+}
+
+
+/* Returns the end of the virtual memory pool. */
+void * get_vmem_end() {
+    return vmem_end;
+}
+
+
+/* Takes a page number and returns the address of the start of the
+ * corresponding virtual memory page.
+ */
+void * page_to_addr(page_t page) {
+    assert(page < NUM_PAGES);
+    return vmem_start + page * PAGE_SIZE;
+}
+
+
+/* Takes an address and returns the virtual memory page corresponding to
+ * the address.
+ */
+page_t addr_to_page(void *addr) {
+    assert(addr >= vmem_start);
+    assert(addr < vmem_end);
+    return (addr - vmem_start) / PAGE_SIZE;
+}
+
+
+/* Returns the maximum number of pages that may be resident in memory. */
+unsigned int vmem_get_max_resident() {
+    return max_resident;
+}
+
+
+/* Returns the number of bytes the process has caused to be read from
+ * storage (if key is "read_bytes") or written to it (if key is
+ * "write_bytes"), from /proc/self/io, or 0 if that isn't available.
+ */
+static unsigned long read_io_bytes(const char *key) {
+    char buf[512], *p;
+    int fd, n;
+
+    fd = open("/proc/self/io", O_RDONLY);
+    if (fd < 0)
+        return 0;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+
+    for (p = strstr(buf, key); p != NULL; p = strstr(p + 1, key)) {
+        if ((p == buf || p[-1] == '\n') && p[strlen(key)] == ':')
+            return strtoul(p + strlen(key) + 1, NULL, 10);
+    }
+    return 0;
+}
+
+
+/* Returns the number of faults the kernel has handled for the process since
+ * vmem_init():  only the major ones, which had to read from the file, if
+ * major is nonzero, or else all of them.
+ */
+static unsigned int faults_since_init(int major) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    if (major)
+        return usage.ru_majflt - start_usage.ru_majflt;
+    return usage.ru_majflt + usage.ru_minflt - start_usage.ru_majflt -
+           start_usage.ru_minflt;
+}
+
+
+/* Returns the number of faults, major and minor, that the kernel has handled
+ * for the process.
+ */
+unsigned int get_num_faults() {
+    return faults_since_init(0);
+}
+
+
+/* Returns the number of pages the kernel has read in for the process.  This
+ * is usually more than the number of major faults, since the kernel reads
+ * ahead of each one.
+ */
+unsigned int get_num_loads() {
+    return (read_io_bytes("read_bytes") - start_read_bytes) / PAGE_SIZE;
+}
+
+
+/* Returns the number of major faults:  those that had to wait for a read. */
+unsigned int get_num_major_faults() {
+    return faults_since_init(1);
+}
+
+
+/* Returns the number of pages the process has written to storage. */
+unsigned int get_num_writebacks() {
+    return (read_io_bytes("write_bytes") - start_write_bytes) / PAGE_SIZE;
+}
+
+
+/* Fills in the statistics since vmem_init().  The kernel's faults can't be
+ * told apart by kind, so they are all counted as maperr_faults, and its
+ * readahead isn't visible at all.  Evictions are only those made by
+ * trimming; the kernel's own reclaim doesn't report them to the process, and
+ * whether each page was dirty isn't known either.
+ */
+static void stats_since_init(vmem_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->maperr_faults = faults_since_init(0);
+    stats->bytes_read = read_io_bytes("read_bytes") - start_read_bytes;
+    stats->bytes_written = read_io_bytes("write_bytes") - start_write_bytes;
+    stats->loads = stats->bytes_read / PAGE_SIZE;
+    stats->writebacks = stats->bytes_written / PAGE_SIZE;
+    stats->evictions = num_evictions;
+    stats->timer_ticks = num_ticks;
+    stats->policy_ns = tick_ns;
+}
+
+
+/* Copies the statistics gathered since the last reset into *stats. */
+void vmem_get_stats(vmem_stats_t *stats) {
+    stats_since_init(stats);
+    stats->maperr_faults -= stats_base.maperr_faults;
+    stats->bytes_read -= stats_base.bytes_read;
+    stats->bytes_written -= stats_base.bytes_written;
+    stats->loads -= stats_base.loads;
+    stats->writebacks -= stats_base.writebacks;
+    stats->evictions -= stats_base.evictions;
+    stats->timer_ticks -= stats_base.timer_ticks;
+    stats->policy_ns -= stats_base.policy_ns;
+}
+
+
+/* Starts the statistics that vmem_get_stats() reports from zero again. */
+void vmem_reset_stats(void) {
+    stats_since_init(&stats_base);
+}
+
+
+/* ============================================================================
+ * Enforcing the resident limit
+ */
+
+
+/* Writes a string to the file at path.  Returns nonzero on success. */
+static int write_file(const char *path, const char *text) {
+    int fd, ok;
+
+    fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return 0;
+    ok = (write(fd, text, strlen(text)) == (ssize_t) strlen(text));
+    close(fd);
+    return ok;
+}
+
+
+/* Reads the number after key in the file at path, or the first number in the
+ * file if key is NULL.  Returns -1 if there is no such number.
+ */
+static long read_file_value(const char *path, const char *key) {
+    char buf[4096], *p;
+    int fd, n;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    p = buf;
+    if (key != NULL) {
+        p = strstr(buf, key);
+        if (p == NULL)
+            return -1;
+        p += strlen(key);
+    }
+    return strtol(p, NULL, 10);
+}
+
+
+/* Sets the cgroup's memory.max to what the process is using besides page
+ * cache, plus max_resident pages for the pool.
+ */
+static void set_cgroup_limit(void) {
+    char path[PATH_MAX + 32], text[32];
+    long current, file;
+
+    snprintf(path, sizeof(path), "%s/memory.current", cgroup_dir);
+    current = read_file_value(path, NULL);
+    snprintf(path, sizeof(path), "%s/memory.stat", cgroup_dir);
+    file = read_file_value(path, "\nfile ");
+    if (current < 0 || file < 0 || file > current)
+        return;
+
+    snprintf(text, sizeof(text), "%ld",
+             current - file + (long) max_resident * PAGE_SIZE);
+    snprintf(path, sizeof(path), "%s/memory.max", cgroup_dir);
+    write_file(path, text);
+}
+
+
+/* Moves the process into a new child of its cgroup with its own memory
+ * limit.  Returns nonzero on success, or 0 (leaving the process where it was)
+ * if cgroup v2 isn't mounted or the memory controller isn't delegated here.
+ */
+static int enter_cgroup(void) {
+    char line[PATH_MAX], path[PATH_MAX + 32];
+    FILE *f;
+    int found = 0;
+
+    f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            found = 1;
+            break;
+        }
+    }
+    fclose(f);
+    if (!found)
+        return 0;
+
+    /* Only a cgroup v2 hierarchy has cgroup.controllers in every group. */
+    if (snprintf(parent_dir, sizeof(parent_dir), "/sys/fs/cgroup%s",
+                 strcmp(line + 3, "/") == 0 ? "" : line + 3) >=
+            (int) sizeof(parent_dir) ||
+        snprintf(cgroup_dir, sizeof(cgroup_dir), "%s/vmem_kernel_%d",
+                 parent_dir, getpid()) >= (int) sizeof(cgroup_dir))
+        goto fail;
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", parent_dir);
+    if (access(path, R_OK) < 0)
+        goto fail;
+    if (mkdir(cgroup_dir, 0755) < 0)
+        goto fail;
+
+    snprintf(path, sizeof(path), "%s/memory.max", cgroup_dir);
+    if (access(path, W_OK) < 0)
+        goto fail_rmdir;
+    snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup_dir);
+    if (!write_file(path, "0"))
+        goto fail_rmdir;
+
+    set_cgroup_limit();
+    return 1;
+
+fail_rmdir:
+    rmdir(cgroup_dir);
+fail:
+    cgroup_dir[0] = '\0';
+    parent_dir[0] = '\0';
+    return 0;
+}
+
+
+/* Moves the process back out of its cgroup, and removes it. */
+static void leave_cgroup(void) {
+    char path[PATH_MAX + 32];
+
+    snprintf(path, sizeof(path), "%s/cgroup.procs", parent_dir);
+    if (write_file(path, "0"))
+        rmdir(cgroup_dir);
+    cgroup_dir[0] = '\0';
+}
+
+
+/* Drops the pages of the pool that have been in the page cache longest until
+ * at most max_resident are left.  Each is written back if it is dirty, and
+ * then unmapped and removed from the page cache, so that touching it again
+ * is a major fault.  Pinned pages are passed over.  The kernel is free to
+ * keep a page it was asked to drop, so a page only counts as evicted once
+ * mincore() says it is gone; a page that stays is queued again by the next
+ * tick's scan.
+ */
+static void trim_resident(void) {
+    static unsigned char vec[NUM_PAGES];
+    unsigned int count = 0, tail;
+    unsigned char still;
+    page_t page;
+    void *addr;
+
+    if (mincore(vmem_start, NUM_PAGES * PAGE_SIZE, vec) < 0)
+        return;
+
+    for (page = 0; page < NUM_PAGES; page++) {
+        if (!(vec[page] & 1))
+            continue;
+        count++;
+        if (!queued[page]) {
+            tail = (queue_head + queue_len) % NUM_PAGES;
+            resident_queue[tail] = page;
+            queued[page] = 1;
+            queue_len++;
+        }
+    }
+
+    while (count > max_resident && queue_len > 0) {
+        page = resident_queue[queue_head];
+        queue_head = (queue_head + 1) % NUM_PAGES;
+        queue_len--;
+        queued[page] = 0;
+
+        /* The kernel may have dropped the page already. */
+        if (!(vec[page] & 1))
+            continue;
+
+        if (pinned[page]) {
+            tail = (queue_head + queue_len) % NUM_PAGES;
+            resident_queue[tail] = page;
+            queued[page] = 1;
+            queue_len++;
+            continue;
+        }
+
+        addr = page_to_addr(page);
+        msync(addr, PAGE_SIZE, MS_SYNC);
+        madvise(addr, PAGE_SIZE, MADV_DONTNEED);
+        posix_fadvise(fd_swapfile, (off_t) page * PAGE_SIZE, PAGE_SIZE,
+                      POSIX_FADV_DONTNEED);
+        if (mincore(addr, PAGE_SIZE, &still) < 0 || (still & 1))
+            continue;
+        num_evictions++;
+        count--;
+    }
+}
+
+
+/* The timer tick:  bring the pool back within its limit.  The time this
+ * takes stands in for the paging policy's time in the statistics.
+ */
+static void sigalrm_handler(int signum, siginfo_t *infop, void *data) {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (cgroup_dir[0] != '\0')
+        set_cgroup_limit();
+    else
+        trim_resident();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    num_ticks++;
+    tick_ns += (end.tv_sec - start.tv_sec) * 1000000000ull +
+               end.tv_nsec - start.tv_nsec;
+}
+
+
+/* ============================================================================
+ * Core Functions
+ */
+
+
+/* This function initializes the kernel-paged pool with the specified
+ * "maximum resident" limit.  It opens and unlinks the swap file exactly as
+ * the pager does, maps the whole file over the pool, sets up the limit, and
+ * starts the timer that keeps the pool within it.
+ */
+void * vmem_init(unsigned _max_resident) {
+    struct sigaction action;
+    struct itimerval itimer;
+
+    vmem_start = (void *) VIRTUALMEM_ADDR_START;
+    vmem_end = vmem_start + (NUM_PAGES * PAGE_SIZE);
+    max_resident = _max_resident;
+    num_pinned = 0;
+    memset(pinned, 0, sizeof(pinned));
+    memset(queued, 0, sizeof(queued));
+    queue_head = 0;
+    queue_len = 0;
+
+    fprintf(stderr, "\"Physical memory\" is in the range %p..%p\n * %d pages"
+            " total, %d maximum resident pages\n\n", vmem_start, vmem_end,
+            NUM_PAGES, max_resident);
+
+    /* Open the swap file, unlink it, and extend it to the whole pool. */
+    sprintf(swapfile, "/tmp/cs24_pagedev_%05d", getpid());
+    fd_swapfile = open(swapfile, O_RDWR | O_CREAT, 0600);
+    if (fd_swapfile < 0) {
+        perror(swapfile);
+        abort();
+    }
+
+    if (unlink(swapfile) < 0) {
+        perror(swapfile);
+        abort();
+    }
+
+    if (ftruncate(fd_swapfile, NUM_PAGES * PAGE_SIZE) < 0) {
+        perror("ftruncate");
+        abort();
+    }
+
+    if (mmap(vmem_start, NUM_PAGES * PAGE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_FIXED | MAP_SHARED, fd_swapfile, 0) == MAP_FAILED) {
+        perror("mmap");
+        abort();
+    }
+
+    /* Turn off the kernel's readahead on faults, so that the pages in the
+     * page cache are the ones the program touched (or prefetched).
+     */
+    if (madvise(vmem_start, NUM_PAGES * PAGE_SIZE, MADV_RANDOM) < 0)
+        perror("madvise(MADV_RANDOM)");
+
+    getrusage(RUSAGE_SELF, &start_usage);
+    start_read_bytes = read_io_bytes("read_bytes");
+    start_write_bytes = read_io_bytes("write_bytes");
+    num_evictions = 0;
+    num_ticks = 0;
+    tick_ns = 0;
+    memset(&stats_base, 0, sizeof(stats_base));
+
+    if (enter_cgroup()) {
+        fprintf(stderr, "Using kernel paging, limited by the memory cgroup"
+                " %s.\n\n", cgroup_dir);
+    }
+    else {
+        fprintf(stderr, "Using kernel paging, limited by trimming the page"
+                " cache every %dms.\n\n", TIMESLICE_USEC / 1000);
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sigalrm_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    if (sigaction(SIGALRM, &action, (struct sigaction *) 0) < 0) {
+        perror("sigaction(SIGALRM)");
+        exit(1);
+    }
+
+    itimer.it_interval.tv_sec = TIMESLICE_SEC;
+    itimer.it_interval.tv_usec = TIMESLICE_USEC;
+    itimer.it_value.tv_sec = TIMESLICE_SEC;
+    itimer.it_value.tv_usec = TIMESLICE_USEC;
+    if (setitimer(ITIMER_REAL, &itimer, (struct itimerval *) 0) < 0) {
+        perror("setitimer");
+        exit(1);
+    }
+
+    return vmem_start;
+}
+
+
+/* Stops the timer and leaves the cgroup, if the process entered one. */
+void vmem_cleanup(void) {
+    struct itimerval itimer;
+
+    memset(&itimer, 0, sizeof(itimer));
+    setitimer(ITIMER_REAL, &itimer, (struct itimerval *) 0);
+
+    if (cgroup_dir[0] != '\0')
+        leave_cgroup();
+}
+
+
+/* The kernel's paging can't be driven from the fault count, since its
+ * faults aren't visible here, so the limit stays on the 10ms timer.
+ */
+void vmem_set_virtual_ticks(unsigned int faults_per_tick) {
+}
+
+
+/* Returns the page-aligned start and length of the pages entirely inside an
+ * address range in *start and *rlen.
+ */
+static void round_inward(void *addr, unsigned int len, void **start,
+                         size_t *rlen) {
+    void *end;
+
+    *start = vmem_start + (addr - vmem_start + PAGE_SIZE - 1) / PAGE_SIZE *
+             PAGE_SIZE;
+    end = vmem_start + (addr + len - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+    *rlen = (end > *start) ? end - *start : 0;
+}
+
+
+/* Returns the page-aligned start and length of the pages an address range
+ * touches in *start and *rlen.
+ */
+static void round_outward(void *addr, unsigned int len, void **start,
+                          size_t *rlen) {
+    void *end;
+
+    *start = vmem_start + (addr - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+    end = vmem_start + (addr + len - vmem_start + PAGE_SIZE - 1) / PAGE_SIZE *
+          PAGE_SIZE;
+    *rlen = end - *start;
+}
+
+
+/* Frees the file blocks under the pages entirely inside the range, so that
+ * their contents are never written back.
+ */
+void vmem_discard(void *addr, unsigned int len) {
+    size_t rlen;
+    void *start;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    round_inward(addr, len, &start, &rlen);
+    if (rlen > 0)
+        madvise(start, rlen, MADV_REMOVE);
+}
+
+
+/* Writes the dirty pages that the range touches back to the file now. */
+void vmem_writeback(void *addr, unsigned int len) {
+    size_t rlen;
+    void *start;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    if (len == 0)
+        return;
+
+    round_outward(addr, len, &start, &rlen);
+    if (msync(start, rlen, MS_SYNC) < 0) {
+        perror("msync in vmem_writeback");
+        abort();
+    }
+}
+
+
+/* Fills the page-aligned range from the file fd, starting at the page-aligned
+ * offset.  The kernel has no way to back part of a shared mapping with
+ * another file, so the range is filled right away rather than lazily.
+ */
+void vmem_map_file(void *addr, unsigned int len, int fd, off_t offset) {
+    size_t rlen;
+    void *start;
+    ssize_t rc;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+    assert((addr - vmem_start) % PAGE_SIZE == 0);
+    assert(offset % PAGE_SIZE == 0);
+
+    round_outward(addr, len, &start, &rlen);
+    rc = pread(fd, start, rlen, offset);
+    if (rc == -1) {
+        perror("pread");
+        abort();
+    }
+    memset(start + rc, 0, rlen - rc);
+}
+
+
+/* Passes advice about the range on to the kernel:  VMEM_ADVICE_WILLNEED
+ * starts reading in the pages it touches, and VMEM_ADVICE_CYCLIC and
+ * VMEM_ADVICE_STREAM mark the pages entirely inside it as the first to
+ * reclaim, where the kernel supports that.  VMEM_ADVICE_REUSE has no kernel
+ * equivalent.  Ranges outside the pool are ignored.
+ */
+void vmem_advise(void *addr, unsigned int len, int advice) {
+    size_t rlen;
+    void *start;
+
+    assert(advice == VMEM_ADVICE_WILLNEED || advice == VMEM_ADVICE_REUSE ||
+           advice == VMEM_ADVICE_CYCLIC || advice == VMEM_ADVICE_STREAM);
+
+    if (len == 0 || addr < vmem_start || addr + len > vmem_end)
+        return;
+
+    if (advice == VMEM_ADVICE_WILLNEED) {
+        round_outward(addr, len, &start, &rlen);
+        madvise(start, rlen, MADV_WILLNEED);
+    }
+#ifdef MADV_COLD
+    else if (advice == VMEM_ADVICE_CYCLIC || advice == VMEM_ADVICE_STREAM) {
+        round_inward(addr, len, &start, &rlen);
+        if (rlen > 0)
+            madvise(start, rlen, MADV_COLD);
+    }
+#endif
+}
+
+
+/* Locks the pages the range touches into memory, with the same limit of half
+ * of max_resident as the pager.  Returns nonzero on success, or 0 (pinning
+ * nothing) if the range would go over the limit or mlock() fails.
+ */
+int vmem_pin(void *addr, unsigned int len) {
+    sigset_t mask, oldmask;
+    unsigned int count = 0;
+    size_t rlen;
+    void *start, *p;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    round_outward(addr, len, &start, &rlen);
+    for (p = start; p < start + rlen; p += PAGE_SIZE) {
+        if (!pinned[addr_to_page(p)])
+            count++;
+    }
+    if (num_pinned + count > max_resident / 2)
+        return 0;
+    if (mlock(start, rlen) < 0)
+        return 0;
+
+    /* Keep the timer tick from trimming while the pages are being marked. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (p = start; p < start + rlen; p += PAGE_SIZE)
+        pinned[addr_to_page(p)] = 1;
+    num_pinned += count;
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return 1;
+}
+
+
+/* Unlocks the pages the range touches. */
+void vmem_unpin(void *addr, unsigned int len) {
+    sigset_t mask, oldmask;
+    size_t rlen;
+    void *start, *p;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    round_outward(addr, len, &start, &rlen);
+    munlock(start, rlen);
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (p = start; p < start + rlen; p += PAGE_SIZE) {
+        if (pinned[addr_to_page(p)]) {
+            pinned[addr_to_page(p)] = 0;
+            num_pinned--;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
@@ -6,15 +6,19 @@
 
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "matrix.h"
+#include "virtualmem.h"
 #include "vmalloc.h"
 
 
 /* Allocate a new matrix object of size rows x cols, from the virtual memory
- * pool.  The elements themselves are uninitialized.
+ * pool.  The elements themselves are uninitialized.  The rows are packed end
+ * to end, directly after the header.
  */
 matrix_t * vmalloc_matrix(int rows, int cols) {
     matrix_t *m;
@@ -22,6 +26,90 @@ matrix_t * vmalloc_matrix(int rows, int cols) {
     m = vmem_alloc(sizeof(matrix_t) + rows * cols * sizeof(int));
     m->rows = rows;
     m->cols = cols;
+    m->ld = cols;
+    m->elems = (int *) (m + 1);
+
+    return m;
+}
+
+
+/* Returns the leading dimension (in elements) to use for rows of cols
+ * elements of elem_size bytes each, given the MATRIX_ALIGN_* value in flags.
+ * For page alignment, rows no larger than a page are padded to a power-of-two
+ * size so that a whole number of rows fit in each page; larger rows are
+ * padded to a multiple of the page size.
+ */
+int matrix_padded_ld(int cols, int elem_size, int flags) {
+    int row_bytes = cols * elem_size;
+    int padded;
+
+    if (flags & MATRIX_ALIGN_PAGE) {
+        if (row_bytes > PAGE_SIZE) {
+            padded = (row_bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        }
+        else {
+            padded = elem_size;
+            while (padded < row_bytes)
+                padded *= 2;
+        }
+    }
+    else if (flags & MATRIX_ALIGN_CACHELINE) {
+        padded = (row_bytes + CACHE_LINE_SIZE - 1) /
+                 CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+        /* Keep whole elements when they don't divide a cache line. */
+        padded = (padded + elem_size - 1) / elem_size * elem_size;
+    }
+    else {
+        padded = row_bytes;
+    }
+
+    return padded / elem_size;
+}
+
+
+/* Returns the alignment (in bytes) of the element data for the MATRIX_ALIGN_*
+ * value in flags.
+ */
+int matrix_data_align(int flags) {
+    if (flags & MATRIX_ALIGN_PAGE)
+        return PAGE_SIZE;
+    else if (flags & MATRIX_ALIGN_CACHELINE)
+        return CACHE_LINE_SIZE;
+    else
+        return sizeof(uint64_t);
+}
+
+
+/* Allocate a new matrix object of size rows x cols from the virtual memory
+ * pool, with its rows padded and aligned as requested by flags (see the
+ * MATRIX_ALIGN_* and MATRIX_HEADER_OWN_PAGE values in matrix.h).  The elements
+ * themselves, including the padding, are uninitialized.  Returns NULL if the
+ * pool is exhausted.
+ */
+matrix_t * vmalloc_matrix_aligned(int rows, int cols, int flags) {
+    matrix_t *m;
+    int ld, align;
+
+    ld = matrix_padded_ld(cols, sizeof(int), flags);
+    align = matrix_data_align(flags);
+
+    /* Give the header a whole page if asked, so that touching the header
+     * never pulls in element data and vice versa.
+     */
+    if (flags & MATRIX_HEADER_OWN_PAGE)
+        m = vmem_alloc_aligned(PAGE_SIZE, PAGE_SIZE);
+    else
+        m = vmem_alloc(sizeof(matrix_t));
+    if (m == NULL)
+        return NULL;
+
+    m->elems = vmem_alloc_aligned(rows * ld * sizeof(int), align);
+    if (m->elems == NULL)
+        return NULL;
+
+    m->rows = rows;
+    m->cols = cols;
+    m->ld = ld;
 
     return m;
 }
@@ -39,20 +127,140 @@ matrix_t * malloc_matrix(int rows, int cols) {
     m = malloc(sizeof(matrix_t) + rows * cols * sizeof(int));
     m->rows = rows;
     m->cols = cols;
+    m->ld = cols;
+    m->elems = (int *) (m + 1);
     return m;
 }
 
 
+/* Initialize view to refer to the rows x cols sub-matrix of m whose top-left
+ * element is (r0, c0).  No elements are copied; the view shares m's storage
+ * and leading dimension, so writes through the view show up in m.  Returns
+ * view for convenience.
+ */
+matrix_t * matrix_view(matrix_t *m, int r0, int c0, int rows, int cols,
+                       matrix_t *view) {
+    assert(m != NULL);
+    assert(view != NULL);
+    assert(r0 >= 0 && rows >= 0 && r0 + rows <= m->rows);
+    assert(c0 >= 0 && cols >= 0 && c0 + cols <= m->cols);
+
+    view->rows = rows;
+    view->cols = cols;
+    view->ld = m->ld;
+    view->elems = m->elems + r0 * m->ld + c0;
+
+    return view;
+}
+
+
 /* Generate random values in the range [-1000, 1000] for the specified
  * matrix.
  */
 void generate_matrix_values(matrix_t *m) {
-    int i;
+    int r, c;
+    int *row;
 
     assert(m != NULL);
 
-    for (i = 0; i < m->rows * m->cols; i++)
-        m->elems[i] = rand() % 2001 - 1000;
+    for (r = 0; r < m->rows; r++) {
+        row = matrix_row(m, r);
+        for (c = 0; c < m->cols; c++)
+            row[c] = rand() % 2001 - 1000;
+    }
+}
+
+
+/* Fills rows [r_start, r_end) of m with values in [-1000, 1000].  Element
+ * (r, c) depends only on the key and its index r * cols + c, so the inner
+ * loop has no carried state and can be vectorized.
+ */
+static void fill_rows(matrix_t *m, uint64_t key, int r_start, int r_end) {
+    int r, c;
+    int *row;
+    uint64_t base, x;
+
+    for (r = r_start; r < r_end; r++) {
+        row = matrix_row(m, r);
+        base = key + (uint64_t) r * m->cols;
+        for (c = 0; c < m->cols; c++) {
+            x = splitmix64(base + c);
+            /* Map the top 32 bits onto [0, 2000] without a division. */
+            row[c] = (int) (((x >> 32) * 2001) >> 32) - 1000;
+        }
+    }
+}
+
+
+/* Work description for one generator thread. */
+typedef struct fill_job_t {
+    matrix_t *m;
+    uint64_t key;
+    int r_start;
+    int r_end;
+} fill_job_t;
+
+
+/* Thread entry point for generate_matrix_values_seeded(). */
+static void * fill_thread(void *arg) {
+    fill_job_t *job = arg;
+    fill_rows(job->m, job->key, job->r_start, job->r_end);
+    return NULL;
+}
+
+
+/* Generate random values in the range [-1000, 1000] for the specified
+ * matrix, using a counter-based generator keyed by seed.  The values depend
+ * only on the seed and the matrix dimensions, so the same seed always gives
+ * the same matrix however many threads are used, and rand() is untouched.
+ *
+ * Up to nthreads threads split the rows between them.  The virtual memory
+ * system's fault handler is not thread-safe, so matrices that live in the
+ * virtual memory pool are always filled by the calling thread alone.
+ */
+void generate_matrix_values_seeded(matrix_t *m, unsigned long seed,
+                                   int nthreads) {
+    pthread_t threads[64];
+    fill_job_t jobs[64];
+    uint64_t key;
+    int i, rows_per;
+
+    assert(m != NULL);
+
+    /* Spread the seed out so nearby seeds don't give overlapping streams. */
+    key = splitmix64(seed) << 20;
+
+    if ((void *) m->elems >= get_vmem_start() &&
+        (void *) m->elems < get_vmem_end())
+        nthreads = 1;
+    if (nthreads > 64)
+        nthreads = 64;
+    if (nthreads > m->rows)
+        nthreads = m->rows;
+
+    if (nthreads <= 1) {
+        fill_rows(m, key, 0, m->rows);
+        return;
+    }
+
+    rows_per = (m->rows + nthreads - 1) / nthreads;
+    for (i = 0; i < nthreads; i++) {
+        jobs[i].m = m;
+        jobs[i].key = key;
+        jobs[i].r_start = i * rows_per;
+        jobs[i].r_end = (i + 1) * rows_per < m->rows ? (i + 1) * rows_per :
+                        m->rows;
+        if (pthread_create(&threads[i], NULL, fill_thread, &jobs[i]) != 0) {
+            /* Couldn't start the thread; do its share here instead. */
+            fill_thread(&jobs[i]);
+            threads[i] = pthread_self();
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        if (!pthread_equal(threads[i], pthread_self()))
+            pthread_join(threads[i], NULL);
+    }
 }
 
 
@@ -63,8 +271,8 @@ int get_elem(const matrix_t *m, int r, int c) {
     assert(r >= 0 && r < m->rows);
     assert(c >= 0 && c < m->cols);
 
-    index = r * m->cols + c;
-    assert(index >= 0 && index < m->rows * m->cols);
+    index = r * m->ld + c;
+    assert(index >= 0 && index < m->rows * m->ld);
     return m->elems[index];
 }
 
@@ -76,18 +284,72 @@ void set_elem(matrix_t *m, int r, int c, int value) {
     assert(r >= 0 && r < m->rows);
     assert(c >= 0 && c < m->cols);
 
-    index = r * m->cols + c;
-    assert(index >= 0 && index < m->rows * m->cols);
+    index = r * m->ld + c;
+    assert(index >= 0 && index < m->rows * m->ld);
     m->elems[index] = value;
 }
 
 
+/* Passes advice about rows r0 .. r0 + nrows - 1 of m on to the pager.  This
+ * is a no-op for matrices outside the virtual memory pool.
+ */
+static void advise_rows(const matrix_t *m, int r0, int nrows, int advice) {
+    if (nrows > 0) {
+        vmem_advise((void *) matrix_row_const(m, r0),
+                    ((nrows - 1) * m->ld + m->cols) * sizeof(int), advice);
+    }
+}
+
+
+/* Tells the pager that a pass over a matrix has got as far as the address
+ * end, passing on advice (VMEM_ADVICE_CYCLIC or VMEM_ADVICE_STREAM) about the
+ * whole pages passed over.  *done is where the previous call left off; it is
+ * moved up to the start of the page holding end, which may still be in use.
+ * Nothing is advised until the pass leaves a page, so each page is advised
+ * once per pass, and most calls return without calling into the pager.
+ */
+static void advise_passed(const void *end, const char **done, int advice) {
+    const char *e = end;
+    const char *page_start = e - (uintptr_t) e % PAGE_SIZE;
+
+    if (page_start > *done) {
+        vmem_advise((void *) *done, page_start - *done, advice);
+        *done = page_start;
+    }
+}
+
+
+/* Asks the pager to prefetch row r of m ahead of a pass that reaches it next.
+ * *ahead is the end of the pages that earlier calls in the pass already
+ * prefetched, so only the part of the row past it is advised, and rows that
+ * lie in pages already covered cost nothing.
+ */
+static void prefetch_row(const matrix_t *m, int r, const char **ahead) {
+    const char *start = (const char *) matrix_row_const(m, r);
+    const char *end = (const char *) (matrix_row_const(m, r) + m->cols);
+
+    if (end <= *ahead)
+        return;
+    if (start < *ahead)
+        start = *ahead;
+
+    vmem_advise((void *) start, end - start, VMEM_ADVICE_WILLNEED);
+    *ahead = end + (PAGE_SIZE - (uintptr_t) end % PAGE_SIZE) % PAGE_SIZE;
+}
+
+
 /* Multiplies the two matrices m1 and m2, storing the results into the result
- * matrix.
+ * matrix.  Each result element is the dot product of a row of m1 with a
+ * column of m2, so the innermost loop strides down m2, touching a different
+ * row (and often page) of it per step.  This is the reference access pattern
+ * that the other multiplies are measured against.
  */
 void multiply_matrices(const matrix_t *m1, const matrix_t *m2,
                        matrix_t *result) {
     int r, c, i, val;
+    const int *row1;
+    matrix_col_t col2;
+    int *rowr;
 
     assert(m1 != NULL);
     assert(m2 != NULL);
@@ -100,39 +362,579 @@ void multiply_matrices(const matrix_t *m1, const matrix_t *m2,
     for (r = 0; r < result->rows; r++) {
         printf(".");
         fflush(stdout);
+        row1 = matrix_row_const(m1, r);
+        rowr = matrix_row(result, r);
         for (c = 0; c < result->cols; c++) {
+            col2 = matrix_col(m2, c);
             val = 0;
             for (i = 0; i < m1->cols; i++)
-                val += get_elem(m1, r, i) * get_elem(m2, i, c);
+                val += row1[i] * matrix_col_elem(col2, i);
 
-            set_elem(result, r, c, val);
+            rowr[c] = val;
         }
     }
     printf("\n");
 }
 
 
+/* Multiplies the two matrices m1 and m2 like multiply_matrices(), but in r, i,
+ * c order:  each result row is built up as a sum of rows of m2 scaled by the
+ * elements of the matching m1 row, so that every inner loop runs along a
+ * row and can be vectorized.
+ *
+ * This makes one pass over all of m2 per result row, while the m1 and result
+ * rows are reused throughout the pass and then never again, and the pager is
+ * told as much.  The next m2 row is prefetched, and if m2 doesn't fit in
+ * memory its pages are marked as part of a repeated pass, so that the start
+ * of m2 stays resident from one pass to the next, rather than each pass
+ * evicting the pages that the following one needs first.
+ */
+void multiply_matrices_rowwise(const matrix_t *m1, const matrix_t *m2,
+                               matrix_t *result) {
+    int r, c, i, a;
+    const int *row1, *row2;
+    const char *done, *done1, *doner, *ahead;
+    unsigned long pages;
+    int *rowr, m2_advice;
+
+    assert(m1 != NULL);
+    assert(m2 != NULL);
+    assert(result != NULL);
+
+    assert(m1->cols == m2->rows);
+    assert(m1->rows == result->rows);
+    assert(m2->cols == result->cols);
+
+    /* Marking m2 as cyclic makes its pages the first victims after the
+     * finished rows, which only pays off if it can't stay resident anyway:
+     * together with an m1 row and a result row (each spanning at most two
+     * more pages than its size), m2 must overflow memory.
+     */
+    pages = (unsigned long) m2->rows * m2->ld * sizeof(int) / PAGE_SIZE +
+            (m1->cols + result->cols) * sizeof(int) / PAGE_SIZE + 4;
+    m2_advice = (pages > vmem_get_max_resident()) ? VMEM_ADVICE_CYCLIC : 0;
+
+    done1 = (const char *) m1->elems;
+    doner = (const char *) result->elems;
+    for (r = 0; r < result->rows; r++) {
+        printf(".");
+        fflush(stdout);
+        row1 = matrix_row_const(m1, r);
+        rowr = matrix_row(result, r);
+        advise_rows(m1, r, 1, VMEM_ADVICE_REUSE);
+        advise_rows(result, r, 1, VMEM_ADVICE_REUSE);
+        for (c = 0; c < result->cols; c++)
+            rowr[c] = 0;
+
+        done = (const char *) m2->elems;
+        ahead = (const char *) m2->elems;
+        for (i = 0; i < m1->cols; i++) {
+            if (i + 1 < m2->rows)
+                prefetch_row(m2, i + 1, &ahead);
+            a = row1[i];
+            row2 = matrix_row_const(m2, i);
+            for (c = 0; c < result->cols; c++)
+                rowr[c] += a * row2[c];
+            if (m2_advice != 0)
+                advise_passed(row2 + m2->cols, &done, m2_advice);
+        }
+
+        /* The m1 and result rows won't be needed again. */
+        advise_passed(row1 + m1->cols, &done1, VMEM_ADVICE_STREAM);
+        advise_passed(rowr + result->cols, &doner, VMEM_ADVICE_STREAM);
+    }
+    printf("\n");
+}
+
+
+/* Returns a view of the rows x cols sub-matrix of m at (r0, c0).  This is
+ * matrix_view() for the kernels below, which take their inputs as const.
+ */
+static matrix_t submatrix(const matrix_t *m, int r0, int c0,
+                          int rows, int cols) {
+    matrix_t view;
+    return *matrix_view((matrix_t *) m, r0, c0, rows, cols, &view);
+}
+
+
+/* Computes result = m1 * m2, or result += m1 * m2 if accumulate is nonzero,
+ * working on tile x tile blocks so that the pages of the three blocks in use
+ * stay resident.  Within a block the loops run in r, i, c order so that the
+ * innermost loop walks along rows of m2 and result.
+ */
+static void gemm_tiled(const matrix_t *m1, const matrix_t *m2,
+                       matrix_t *result, int tile, int accumulate) {
+    int rr, ii, cc, r, i, c, r_end, i_end, c_end, a;
+    const int *row1, *row2;
+    int *rowr;
+
+    if (!accumulate) {
+        for (r = 0; r < result->rows; r++) {
+            rowr = matrix_row(result, r);
+            for (c = 0; c < result->cols; c++)
+                rowr[c] = 0;
+        }
+    }
+
+    for (rr = 0; rr < result->rows; rr += tile) {
+        r_end = rr + tile < result->rows ? rr + tile : result->rows;
+        for (ii = 0; ii < m1->cols; ii += tile) {
+            i_end = ii + tile < m1->cols ? ii + tile : m1->cols;
+            for (cc = 0; cc < result->cols; cc += tile) {
+                c_end = cc + tile < result->cols ? cc + tile : result->cols;
+
+                for (r = rr; r < r_end; r++) {
+                    row1 = matrix_row_const(m1, r);
+                    rowr = matrix_row(result, r);
+                    for (i = ii; i < i_end; i++) {
+                        a = row1[i];
+                        row2 = matrix_row_const(m2, i);
+                        for (c = cc; c < c_end; c++)
+                            rowr[c] += a * row2[c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/* Multiplies the two matrices m1 and m2 one tile x tile block at a time,
+ * storing the results into the result matrix.  Pass 0 for tile to get
+ * MATRIX_DEFAULT_TILE.
+ */
+void multiply_matrices_tiled(const matrix_t *m1, const matrix_t *m2,
+                             matrix_t *result, int tile) {
+    assert(m1 != NULL);
+    assert(m2 != NULL);
+    assert(result != NULL);
+
+    assert(m1->cols == m2->rows);
+    assert(m1->rows == result->rows);
+    assert(m2->cols == result->cols);
+
+    if (tile <= 0)
+        tile = MATRIX_DEFAULT_TILE;
+
+    gemm_tiled(m1, m2, result, tile, 0);
+}
+
+
+/* Computes dst = a + sign * b elementwise, where sign is 1 or -1. */
+static void add_scaled(const matrix_t *a, const matrix_t *b, int sign,
+                       matrix_t *dst) {
+    int r, c;
+    const int *ra, *rb;
+    int *rd;
+
+    for (r = 0; r < dst->rows; r++) {
+        ra = matrix_row_const(a, r);
+        rb = matrix_row_const(b, r);
+        rd = matrix_row(dst, r);
+        for (c = 0; c < dst->cols; c++)
+            rd[c] = ra[c] + sign * rb[c];
+    }
+}
+
+
+/* Computes dst += sign * src elementwise, where sign is 1 or -1.  If
+ * overwrite is nonzero, dst = sign * src instead.
+ */
+static void accumulate(const matrix_t *src, int sign, int overwrite,
+                       matrix_t *dst) {
+    int r, c;
+    const int *rs;
+    int *rd;
+
+    for (r = 0; r < dst->rows; r++) {
+        rs = matrix_row_const(src, r);
+        rd = matrix_row(dst, r);
+        if (overwrite) {
+            for (c = 0; c < dst->cols; c++)
+                rd[c] = sign * rs[c];
+        }
+        else {
+            for (c = 0; c < dst->cols; c++)
+                rd[c] += sign * rs[c];
+        }
+    }
+}
+
+
+static void strassen(const matrix_t *a, const matrix_t *b, matrix_t *c,
+                     int cutoff);
+
+
+/* One level of Strassen's algorithm for operands whose dimensions are all
+ * even.  The three scratch matrices (an operand sum for each side, and one
+ * product) come from the virtual memory pool, and are released and discarded
+ * on the way out, so their dirty pages never go back to the swap file.  If the
+ * pool is too small for them, the tiled kernel is used instead.
+ */
+static void strassen_even(const matrix_t *a, const matrix_t *b, matrix_t *c,
+                          int cutoff) {
+    int mh = a->rows / 2, kh = a->cols / 2, nh = b->cols / 2;
+    matrix_t a11, a12, a21, a22, b11, b12, b21, b22, c11, c12, c21, c22;
+    matrix_t *ta, *tb, *p;
+    unsigned int needed;
+    void *mark;
+
+    needed = (mh * kh + kh * nh + mh * nh) * sizeof(int) +
+             3 * (sizeof(matrix_t) + CACHE_LINE_SIZE);
+    if (needed > vmem_alloc_available()) {
+        gemm_tiled(a, b, c, MATRIX_DEFAULT_TILE, 0);
+        return;
+    }
+
+    mark = vmem_alloc_mark();
+    ta = vmalloc_matrix_aligned(mh, kh, MATRIX_ALIGN_CACHELINE);
+    tb = vmalloc_matrix_aligned(kh, nh, MATRIX_ALIGN_CACHELINE);
+    p = vmalloc_matrix_aligned(mh, nh, MATRIX_ALIGN_CACHELINE);
+    assert(ta != NULL && tb != NULL && p != NULL);
+
+    a11 = submatrix(a, 0, 0, mh, kh);
+    a12 = submatrix(a, 0, kh, mh, kh);
+    a21 = submatrix(a, mh, 0, mh, kh);
+    a22 = submatrix(a, mh, kh, mh, kh);
+    b11 = submatrix(b, 0, 0, kh, nh);
+    b12 = submatrix(b, 0, nh, kh, nh);
+    b21 = submatrix(b, kh, 0, kh, nh);
+    b22 = submatrix(b, kh, nh, kh, nh);
+    c11 = submatrix(c, 0, 0, mh, nh);
+    c12 = submatrix(c, 0, nh, mh, nh);
+    c21 = submatrix(c, mh, 0, mh, nh);
+    c22 = submatrix(c, mh, nh, mh, nh);
+
+    /* M1 = (A11 + A22)(B11 + B22):  C11 = M1, C22 = M1 */
+    add_scaled(&a11, &a22, 1, ta);
+    add_scaled(&b11, &b22, 1, tb);
+    strassen(ta, tb, &c11, cutoff);
+    accumulate(&c11, 1, 1, &c22);
+
+    /* M2 = (A21 + A22) B11:  C21 = M2, C22 -= M2 */
+    add_scaled(&a21, &a22, 1, ta);
+    strassen(ta, &b11, &c21, cutoff);
+    accumulate(&c21, -1, 0, &c22);
+
+    /* M3 = A11 (B12 - B22):  C12 = M3, C22 += M3 */
+    add_scaled(&b12, &b22, -1, tb);
+    strassen(&a11, tb, &c12, cutoff);
+    accumulate(&c12, 1, 0, &c22);
+
+    /* M4 = A22 (B21 - B11):  C11 += M4, C21 += M4 */
+    add_scaled(&b21, &b11, -1, tb);
+    strassen(&a22, tb, p, cutoff);
+    accumulate(p, 1, 0, &c11);
+    accumulate(p, 1, 0, &c21);
+
+    /* M5 = (A11 + A12) B22:  C11 -= M5, C12 += M5 */
+    add_scaled(&a11, &a12, 1, ta);
+    strassen(ta, &b22, p, cutoff);
+    accumulate(p, -1, 0, &c11);
+    accumulate(p, 1, 0, &c12);
+
+    /* M6 = (A21 - A11)(B11 + B12):  C22 += M6 */
+    add_scaled(&a21, &a11, -1, ta);
+    add_scaled(&b11, &b12, 1, tb);
+    strassen(ta, tb, p, cutoff);
+    accumulate(p, 1, 0, &c22);
+
+    /* M7 = (A12 - A22)(B21 + B22):  C11 += M7 */
+    add_scaled(&a12, &a22, -1, ta);
+    add_scaled(&b21, &b22, 1, tb);
+    strassen(ta, tb, p, cutoff);
+    accumulate(p, 1, 0, &c11);
+
+    vmem_alloc_release(mark);
+}
+
+
+/* Computes c = a * b with Strassen's algorithm, falling back to the tiled
+ * kernel once any dimension is at most cutoff.  Odd dimensions are handled by
+ * peeling off the last row, column or inner index and fixing up the result
+ * with the tiled kernel.
+ */
+static void strassen(const matrix_t *a, const matrix_t *b, matrix_t *c,
+                     int cutoff) {
+    int m = a->rows, k = a->cols, n = b->cols;
+    int m2 = m & ~1, k2 = k & ~1, n2 = n & ~1;
+    matrix_t ae, be, ce, x, y, z;
+
+    if (m <= cutoff || k <= cutoff || n <= cutoff) {
+        gemm_tiled(a, b, c, MATRIX_DEFAULT_TILE, 0);
+        return;
+    }
+
+    ae = submatrix(a, 0, 0, m2, k2);
+    be = submatrix(b, 0, 0, k2, n2);
+    ce = submatrix(c, 0, 0, m2, n2);
+    strassen_even(&ae, &be, &ce, cutoff);
+
+    if (k2 < k) {
+        /* Add in the contribution of the last inner index. */
+        x = submatrix(a, 0, k2, m2, 1);
+        y = submatrix(b, k2, 0, 1, n2);
+        gemm_tiled(&x, &y, &ce, MATRIX_DEFAULT_TILE, 1);
+    }
+
+    if (n2 < n) {
+        /* The last column of the result, for every row. */
+        y = submatrix(b, 0, n2, k, 1);
+        z = submatrix(c, 0, n2, m, 1);
+        gemm_tiled(a, &y, &z, MATRIX_DEFAULT_TILE, 0);
+    }
+
+    if (m2 < m) {
+        /* The last row of the result, except the corner done above. */
+        x = submatrix(a, m2, 0, 1, k);
+        y = submatrix(b, 0, 0, k, n2);
+        z = submatrix(c, m2, 0, 1, n2);
+        gemm_tiled(&x, &y, &z, MATRIX_DEFAULT_TILE, 0);
+    }
+}
+
+
+/* Multiplies the two matrices m1 and m2 using Strassen's algorithm, storing
+ * the results into the result matrix.  Sub-problems with any dimension of at
+ * most cutoff are handed to the tiled kernel; pass 0 for cutoff to get
+ * MATRIX_DEFAULT_STRASSEN_CUTOFF.  Scratch matrices are allocated from the
+ * virtual memory pool, so vmem_alloc_init() must have been called.
+ */
+void multiply_matrices_strassen(const matrix_t *m1, const matrix_t *m2,
+                                matrix_t *result, int cutoff) {
+    assert(m1 != NULL);
+    assert(m2 != NULL);
+    assert(result != NULL);
+
+    assert(m1->cols == m2->rows);
+    assert(m1->rows == result->rows);
+    assert(m2->cols == result->cols);
+
+    if (cutoff <= 0)
+        cutoff = MATRIX_DEFAULT_STRASSEN_CUTOFF;
+
+    strassen(m1, m2, result, cutoff);
+}
+
+
+/* Copies the transpose of src into dst, which must be src->cols x src->rows,
+ * by recursively halving the longer side until the block is small.  At every
+ * level of the recursion some block of source rows and destination rows fits
+ * in memory, so the page loads are close to the minimum whatever the
+ * resident budget is, without having to know it.
+ */
+static void transpose_block(const matrix_t *src, matrix_t *dst) {
+    matrix_t s1, s2, d1, d2;
+    int r, c, h;
+    const int *rows;
+
+    if (src->rows <= MATRIX_TRANSPOSE_BLOCK &&
+        src->cols <= MATRIX_TRANSPOSE_BLOCK) {
+        for (r = 0; r < src->rows; r++) {
+            rows = matrix_row_const(src, r);
+            for (c = 0; c < src->cols; c++)
+                dst->elems[c * dst->ld + r] = rows[c];
+        }
+        return;
+    }
+
+    if (src->rows >= src->cols) {
+        h = src->rows / 2;
+        s1 = submatrix(src, 0, 0, h, src->cols);
+        s2 = submatrix(src, h, 0, src->rows - h, src->cols);
+        matrix_view(dst, 0, 0, dst->rows, h, &d1);
+        matrix_view(dst, 0, h, dst->rows, dst->cols - h, &d2);
+    }
+    else {
+        h = src->cols / 2;
+        s1 = submatrix(src, 0, 0, src->rows, h);
+        s2 = submatrix(src, 0, h, src->rows, src->cols - h);
+        matrix_view(dst, 0, 0, h, dst->cols, &d1);
+        matrix_view(dst, h, 0, dst->rows - h, dst->cols, &d2);
+    }
+
+    transpose_block(&s1, &d1);
+    transpose_block(&s2, &d2);
+}
+
+
+/* Stores the transpose of src into dst, which must have src->cols rows and
+ * src->rows columns and must not overlap src.
+ */
+void transpose_matrix(const matrix_t *src, matrix_t *dst) {
+    assert(src != NULL);
+    assert(dst != NULL);
+    assert(src->rows == dst->cols);
+    assert(src->cols == dst->rows);
+
+    transpose_block(src, dst);
+}
+
+
+/* Swaps the matrix a with the transpose of the matrix b, where a is n x m and
+ * b is m x n, recursing the same way as transpose_block().
+ */
+static void swap_transposed(matrix_t *a, matrix_t *b) {
+    matrix_t a1, a2, b1, b2;
+    int r, c, h, t;
+    int *rowa;
+
+    if (a->rows <= MATRIX_TRANSPOSE_BLOCK &&
+        a->cols <= MATRIX_TRANSPOSE_BLOCK) {
+        for (r = 0; r < a->rows; r++) {
+            rowa = matrix_row(a, r);
+            for (c = 0; c < a->cols; c++) {
+                t = rowa[c];
+                rowa[c] = b->elems[c * b->ld + r];
+                b->elems[c * b->ld + r] = t;
+            }
+        }
+        return;
+    }
+
+    if (a->rows >= a->cols) {
+        h = a->rows / 2;
+        matrix_view(a, 0, 0, h, a->cols, &a1);
+        matrix_view(a, h, 0, a->rows - h, a->cols, &a2);
+        matrix_view(b, 0, 0, b->rows, h, &b1);
+        matrix_view(b, 0, h, b->rows, b->cols - h, &b2);
+    }
+    else {
+        h = a->cols / 2;
+        matrix_view(a, 0, 0, a->rows, h, &a1);
+        matrix_view(a, 0, h, a->rows, a->cols - h, &a2);
+        matrix_view(b, 0, 0, h, b->cols, &b1);
+        matrix_view(b, h, 0, b->rows - h, b->cols, &b2);
+    }
+
+    swap_transposed(&a1, &b1);
+    swap_transposed(&a2, &b2);
+}
+
+
+/* Transposes the square block m in place:  the two diagonal quadrants are
+ * transposed recursively, and the two off-diagonal quadrants are swapped
+ * with each other's transpose.
+ */
+static void transpose_square(matrix_t *m) {
+    matrix_t q11, q12, q21, q22;
+    int r, c, h, t;
+
+    if (m->rows <= MATRIX_TRANSPOSE_BLOCK) {
+        for (r = 0; r < m->rows; r++) {
+            for (c = r + 1; c < m->cols; c++) {
+                t = m->elems[r * m->ld + c];
+                m->elems[r * m->ld + c] = m->elems[c * m->ld + r];
+                m->elems[c * m->ld + r] = t;
+            }
+        }
+        return;
+    }
+
+    h = m->rows / 2;
+    matrix_view(m, 0, 0, h, h, &q11);
+    matrix_view(m, 0, h, h, m->cols - h, &q12);
+    matrix_view(m, h, 0, m->rows - h, h, &q21);
+    matrix_view(m, h, h, m->rows - h, m->cols - h, &q22);
+
+    transpose_square(&q11);
+    transpose_square(&q22);
+    swap_transposed(&q12, &q21);
+}
+
+
+/* Transposes the square matrix m in place. */
+void transpose_matrix_inplace(matrix_t *m) {
+    assert(m != NULL);
+    assert(m->rows == m->cols);
+
+    transpose_square(m);
+}
+
+
+/* Multiplies m1 by the matrix whose transpose is m2t, storing the results
+ * into the result matrix.  Every result element is the dot product of a row
+ * of m1 with a row of m2t, so both inner loops run sequentially through
+ * memory.  The columns of the result are done in strips of
+ * MATRIX_DEFAULT_TILE, so that the matching rows of m2t stay resident while
+ * every row of m1 goes past them.
+ */
+void multiply_matrices_transposed(const matrix_t *m1, const matrix_t *m2t,
+                                  matrix_t *result) {
+    int cc, c_end, r, c, i, val;
+    const int *row1, *row2;
+    int *rowr;
+
+    assert(m1 != NULL);
+    assert(m2t != NULL);
+    assert(result != NULL);
+
+    assert(m1->cols == m2t->cols);
+    assert(m1->rows == result->rows);
+    assert(m2t->rows == result->cols);
+
+    for (cc = 0; cc < result->cols; cc += MATRIX_DEFAULT_TILE) {
+        c_end = cc + MATRIX_DEFAULT_TILE < result->cols ?
+                cc + MATRIX_DEFAULT_TILE : result->cols;
+
+        for (r = 0; r < result->rows; r++) {
+            row1 = matrix_row_const(m1, r);
+            rowr = matrix_row(result, r);
+            for (c = cc; c < c_end; c++) {
+                row2 = matrix_row_const(m2t, c);
+                val = 0;
+                for (i = 0; i < m1->cols; i++)
+                    val += row1[i] * row2[i];
+                rowr[c] = val;
+            }
+        }
+    }
+}
+
+
 /* Given two matrices of the same dimensions, copies the elements from the
- * source matrix into the destination matrix.
+ * source matrix into the destination matrix.  Both matrices are streamed
+ * through once, so the pager is told to prefetch each next row and to evict
+ * rows that are done with first.
  */
 void copy_matrix(const matrix_t *src, matrix_t *dst) {
-    int i;
+    int r, c;
+    const int *rs;
+    const char *src_done, *dst_done, *src_ahead, *dst_ahead;
+    int *rd;
 
     assert(src != NULL);
     assert(dst != NULL);
     assert(src->rows == dst->rows);
     assert(src->cols == dst->cols);
 
-    for (i = 0; i < src->rows * src->cols; i++)
-        dst->elems[i] = src->elems[i];
+    src_done = (const char *) src->elems;
+    dst_done = (const char *) dst->elems;
+    src_ahead = src_done;
+    dst_ahead = dst_done;
+    for (r = 0; r < src->rows; r++) {
+        if (r + 1 < src->rows) {
+            prefetch_row(src, r + 1, &src_ahead);
+            prefetch_row(dst, r + 1, &dst_ahead);
+        }
+        rs = matrix_row_const(src, r);
+        rd = matrix_row(dst, r);
+        for (c = 0; c < src->cols; c++)
+            rd[c] = rs[c];
+        advise_passed(rs + src->cols, &src_done, VMEM_ADVICE_STREAM);
+        advise_passed(rd + dst->cols, &dst_done, VMEM_ADVICE_STREAM);
+    }
 }
 
 
 /* Compare two matrices for equality; returns nonzero if the matrices have the
- * same values, or zero if the matrices are different.
+ * same values, or zero if the matrices are different.  Like copy_matrix(),
+ * this streams through both matrices and advises the pager accordingly.
  */
 int compare_matrices(const matrix_t *m1, const matrix_t *m2) {
-    int i;
+    int r, c, diff;
+    const int *row1, *row2;
+    const char *done1, *done2, *ahead1, *ahead2;
 
     assert(m1 != NULL);
     assert(m2 != NULL);
@@ -140,11 +942,117 @@ int compare_matrices(const matrix_t *m1, const matrix_t *m2) {
     if (m1->rows != m2->rows || m1->cols != m2->cols)
         return 0;
 
-    for (i = 0; i < m1->rows * m1->cols; i++) {
-        if (m1->elems[i] != m2->elems[i])
+    done1 = (const char *) m1->elems;
+    done2 = (const char *) m2->elems;
+    ahead1 = done1;
+    ahead2 = done2;
+    for (r = 0; r < m1->rows; r++) {
+        if (r + 1 < m1->rows) {
+            prefetch_row(m1, r + 1, &ahead1);
+            prefetch_row(m2, r + 1, &ahead2);
+        }
+        row1 = matrix_row_const(m1, r);
+        row2 = matrix_row_const(m2, r);
+
+        /* Accumulate differences without branching, so the loop vectorizes;
+         * bail out between rows.
+         */
+        diff = 0;
+        for (c = 0; c < m1->cols; c++)
+            diff |= row1[c] ^ row2[c];
+        if (diff != 0)
             return 0;
+        advise_passed(row1 + m1->cols, &done1, VMEM_ADVICE_STREAM);
+        advise_passed(row2 + m2->cols, &done2, VMEM_ADVICE_STREAM);
     }
 
     return 1;
 }
 
+
+
+/* Multiplies each row of m by the k vectors stored interleaved in x (element
+ * j of vector t is x[j * k + t]), storing the products interleaved into y the
+ * same way.  The arithmetic is done modulo 2^32, matching the wrap-around of
+ * the int multiply kernels.
+ */
+static void multiply_vectors(const matrix_t *m, const uint32_t *x, int k,
+                             uint32_t *y) {
+    int r, c, t;
+    const int *row;
+    uint32_t a;
+
+    for (r = 0; r < m->rows; r++) {
+        row = matrix_row_const(m, r);
+        for (t = 0; t < k; t++)
+            y[r * k + t] = 0;
+
+        for (c = 0; c < m->cols; c++) {
+            a = (uint32_t) row[c];
+            for (t = 0; t < k; t++)
+                y[r * k + t] += a * x[c * k + t];
+        }
+    }
+}
+
+
+/* Checks that result == m1 * m2 using Freivalds' algorithm:  for random
+ * vectors r, m1 * (m2 * r) must equal result * r.  All of the vectors are
+ * processed together, so each matrix is read exactly once, row by row, and
+ * the cost is O(rounds * n^2) instead of the O(n^3) of a reference multiply.
+ *
+ * Returns zero if the product is definitely wrong, or nonzero if it passed;
+ * a wrong product passes with probability at most 2^-rounds.  The vectors come
+ * from splitmix64() keyed by seed, so rand() is left untouched.
+ */
+int verify_product_freivalds(const matrix_t *m1, const matrix_t *m2,
+                             const matrix_t *result, int rounds,
+                             unsigned long seed) {
+    uint32_t *r, *m2r, *m1m2r, *resr;
+    int i, ok;
+
+    assert(m1 != NULL);
+    assert(m2 != NULL);
+    assert(result != NULL);
+
+    if (m1->cols != m2->rows || m1->rows != result->rows ||
+        m2->cols != result->cols)
+        return 0;
+
+    if (rounds <= 0)
+        rounds = MATRIX_DEFAULT_FREIVALDS_ROUNDS;
+
+    r = malloc(m2->cols * rounds * sizeof(uint32_t));
+    m2r = malloc(m2->rows * rounds * sizeof(uint32_t));
+    m1m2r = malloc(m1->rows * rounds * sizeof(uint32_t));
+    resr = malloc(result->rows * rounds * sizeof(uint32_t));
+    if (!r || !m2r || !m1m2r || !resr) {
+        fprintf(stderr, "verify_product_freivalds: out of memory\n");
+        abort();
+    }
+
+    /* Each entry is a 0/1 value, as in the textbook algorithm, keyed by seed
+     * and index like the matrix generators, so no seed gives all zeros.
+     */
+    for (i = 0; i < m2->cols * rounds; i++)
+        r[i] = splitmix64(seed ^ (uint64_t) i) >> 63;
+
+    multiply_vectors(m2, r, rounds, m2r);
+    multiply_vectors(m1, m2r, rounds, m1m2r);
+    multiply_vectors(result, r, rounds, resr);
+
+    ok = 1;
+    for (i = 0; i < result->rows * rounds; i++) {
+        if (m1m2r[i] != resr[i]) {
+            ok = 0;
+            break;
+        }
+    }
+
+    free(r);
+    free(m2r);
+    free(m1m2r);
+    free(resr);
+
+    return ok;
+}
@@ -9,25 +9,136 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <assert.h>
+#include <stdint.h>
 
-/* A simple 2D matrix type. */
+#include "splitmix.h"
+
+
+/* The size of a cache line, used when padding matrix rows. */
+#define CACHE_LINE_SIZE 64
+
+
+/* Layout flags for vmalloc_matrix_aligned().  One of the MATRIX_ALIGN_*
+ * values may be combined with MATRIX_HEADER_OWN_PAGE.
+ */
+#define MATRIX_ALIGN_NONE      0x00  /* Rows are packed end to end.          */
+#define MATRIX_ALIGN_CACHELINE 0x01  /* Rows start on a cache-line boundary. */
+#define MATRIX_ALIGN_PAGE      0x02  /* No row straddles a page boundary.    */
+#define MATRIX_HEADER_OWN_PAGE 0x10  /* Header lives alone on its own page.  */
+
+
+/* Default tile edge (in elements) for the tiled multiply, and the default
+ * size below which the Strassen multiply hands off to the tiled kernel.
+ */
+#define MATRIX_DEFAULT_TILE 64
+#define MATRIX_DEFAULT_STRASSEN_CUTOFF 128
+
+
+/* The transpose routines recurse until a block is at most this many elements
+ * on a side, so that the source and destination blocks are about a page each.
+ */
+#define MATRIX_TRANSPOSE_BLOCK 32
+
+/* Default number of random vectors for verify_product_freivalds(). */
+#define MATRIX_DEFAULT_FREIVALDS_ROUNDS 20
+
+
+/* A simple 2D matrix type.  Element (r, c) lives at elems[r * ld + c].  The
+ * leading dimension ld is at least cols; it is larger when rows are padded,
+ * or when the matrix is a view onto part of a bigger matrix.
+ */
 typedef struct matrix_t {
     int rows;
     int cols;
-    int elems[];
+    int ld;
+    int *elems;
 } matrix_t;
 
 
+/* A strided view of one column of a matrix:  element i of the column is
+ * elems[i * stride].
+ */
+typedef struct matrix_col_t {
+    int *elems;
+    int stride;
+    int len;
+} matrix_col_t;
+
+
+/* Inline accessors for the hot loops of matrix routines.  The bounds checks
+ * are only compiled in for debug builds (make MATRIX_DEBUG=1), so that the
+ * optimized kernels don't test every element they touch; a loop that walks a
+ * row pointer pays no per-element call or index computation.
+ */
+#ifdef MATRIX_DEBUG
+#define MATRIX_CHECK(cond) assert(cond)
+#else
+#define MATRIX_CHECK(cond) ((void) 0)
+#endif
+
+/* Returns a pointer to the first element of row r of m. */
+static inline int * matrix_row(matrix_t *m, int r) {
+    MATRIX_CHECK(m != NULL);
+    MATRIX_CHECK(r >= 0 && r < m->rows);
+    return m->elems + r * m->ld;
+}
+
+/* Returns a read-only pointer to the first element of row r of m. */
+static inline const int * matrix_row_const(const matrix_t *m, int r) {
+    MATRIX_CHECK(m != NULL);
+    MATRIX_CHECK(r >= 0 && r < m->rows);
+    return m->elems + r * m->ld;
+}
+
+/* Returns a strided view of column c of m. */
+static inline matrix_col_t matrix_col(const matrix_t *m, int c) {
+    matrix_col_t col;
+
+    MATRIX_CHECK(m != NULL);
+    MATRIX_CHECK(c >= 0 && c < m->cols);
+    col.elems = m->elems + c;
+    col.stride = m->ld;
+    col.len = m->rows;
+    return col;
+}
+
+/* Returns element i of a column view. */
+static inline int matrix_col_elem(matrix_col_t col, int i) {
+    MATRIX_CHECK(i >= 0 && i < col.len);
+    return col.elems[i * col.stride];
+}
+
+
 matrix_t * malloc_matrix(int rows, int cols);
 matrix_t * vmalloc_matrix(int rows, int cols);
+matrix_t * vmalloc_matrix_aligned(int rows, int cols, int flags);
+int matrix_padded_ld(int cols, int elem_size, int flags);
+int matrix_data_align(int flags);
+matrix_t * matrix_view(matrix_t *m, int r0, int c0, int rows, int cols,
+                       matrix_t *view);
 void generate_matrix_values(matrix_t *m);
+void generate_matrix_values_seeded(matrix_t *m, unsigned long seed,
+                                   int nthreads);
 int get_elem(const matrix_t *m, int r, int c);
 void set_elem(matrix_t *m, int r, int c, int value);
 void multiply_matrices(const matrix_t *m1, const matrix_t *m2,
                        matrix_t *result);
+void multiply_matrices_rowwise(const matrix_t *m1, const matrix_t *m2,
+                               matrix_t *result);
+void multiply_matrices_tiled(const matrix_t *m1, const matrix_t *m2,
+                             matrix_t *result, int tile);
+void multiply_matrices_strassen(const matrix_t *m1, const matrix_t *m2,
+                                matrix_t *result, int cutoff);
+void multiply_matrices_transposed(const matrix_t *m1, const matrix_t *m2t,
+                                  matrix_t *result);
+void transpose_matrix(const matrix_t *src, matrix_t *dst);
+void transpose_matrix_inplace(matrix_t *m);
 void copy_matrix(const matrix_t *src, matrix_t *dst);
 int compare_matrices(const matrix_t *m1, const matrix_t *m2);
+int verify_product_freivalds(const matrix_t *m1, const matrix_t *m2,
+                             const matrix_t *result, int rounds,
+                             unsigned long seed);
 
 
 #endif /* MATRIX_H */
-
@@ -0,0 +1,258 @@
+/*============================================================================
+ * Implementation of fused matrix expressions and planned chain products.
+ *
+ * Every full-size intermediate matrix is written through page faults and then
+ * evicted with a write-back, so the routines here try hard not to create any:
+ * elementwise operations are applied to each strip of result rows while it is
+ * still resident, and the temporaries of a chain product come from a vmalloc
+ * arena that is discarded, rather than written back, once they are used.
+ */
+
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "matrix_expr.h"
+#include "virtualmem.h"
+#include "vmalloc.h"
+
+
+/* Applies the elementwise operations to rows [r_start, r_end) of result. */
+static void apply_epilogue(matrix_t *result, int r_start, int r_end,
+                           const matrix_epilogue_t *ops, int nops) {
+    int r, c, k;
+    const int *rowa;
+    int *row;
+
+    for (r = r_start; r < r_end; r++) {
+        row = matrix_row(result, r);
+        for (k = 0; k < nops; k++) {
+            switch (ops[k].op) {
+            case EPILOGUE_ADD:
+                rowa = matrix_row_const(ops[k].addend, r);
+                for (c = 0; c < result->cols; c++)
+                    row[c] += rowa[c];
+                break;
+
+            case EPILOGUE_SCALE:
+                for (c = 0; c < result->cols; c++)
+                    row[c] *= ops[k].scale;
+                break;
+
+            case EPILOGUE_CLAMP:
+                for (c = 0; c < result->cols; c++) {
+                    row[c] = row[c] < ops[k].lo ? ops[k].lo : row[c];
+                    row[c] = row[c] > ops[k].hi ? ops[k].hi : row[c];
+                }
+                break;
+
+            default:
+                fprintf(stderr, "apply_epilogue: unrecognized op %d\n",
+                        ops[k].op);
+                abort();
+            }
+        }
+    }
+}
+
+
+/* Computes result = m1 * m2 followed by the nops elementwise operations in
+ * ops, applied in order.  The multiply proceeds one strip of
+ * MATRIX_DEFAULT_TILE result rows at a time, tiled like
+ * multiply_matrices_tiled(), and each strip gets its operations as soon as
+ * it is complete, so no intermediate matrix is ever materialized.
+ *
+ * An EPILOGUE_ADD addend must have the same dimensions as result, and must
+ * not be result itself.
+ */
+void multiply_matrices_fused(const matrix_t *m1, const matrix_t *m2,
+                             matrix_t *result, const matrix_epilogue_t *ops,
+                             int nops) {
+    int tile = MATRIX_DEFAULT_TILE;
+    int rr, r_end, k;
+    matrix_t a, c;
+
+    assert(m1 != NULL);
+    assert(m2 != NULL);
+    assert(result != NULL);
+    assert(nops == 0 || ops != NULL);
+
+    assert(m1->cols == m2->rows);
+    assert(m1->rows == result->rows);
+    assert(m2->cols == result->cols);
+
+    for (k = 0; k < nops; k++) {
+        if (ops[k].op == EPILOGUE_ADD) {
+            assert(ops[k].addend != NULL);
+            assert(ops[k].addend->rows == result->rows);
+            assert(ops[k].addend->cols == result->cols);
+            assert(ops[k].addend->elems != result->elems);
+        }
+    }
+
+    for (rr = 0; rr < result->rows; rr += tile) {
+        r_end = rr + tile < result->rows ? rr + tile : result->rows;
+
+        matrix_view((matrix_t *) m1, rr, 0, r_end - rr, m1->cols, &a);
+        matrix_view(result, rr, 0, r_end - rr, result->cols, &c);
+        multiply_matrices_tiled(&a, m2, &c, tile);
+
+        apply_epilogue(result, rr, r_end, ops, nops);
+    }
+}
+
+
+/* Returns the number of pages occupied by n int elements. */
+static unsigned long pages_for(unsigned long n) {
+    return (n * sizeof(int) + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+
+/* Estimates the page loads of a tiled multiply of a p x q matrix by a q x r
+ * matrix, given the current resident-page budget.  The left operand and the
+ * result are streamed through once, and the result is counted twice since
+ * every one of its pages is dirty and must be written back.  The right
+ * operand is read once if everything fits, and otherwise once per strip of
+ * MATRIX_DEFAULT_TILE result rows.
+ */
+unsigned long estimate_multiply_loads(int p, int q, int r) {
+    unsigned long a, b, c, budget, strips;
+
+    a = pages_for((unsigned long) p * q);
+    b = pages_for((unsigned long) q * r);
+    c = pages_for((unsigned long) p * r);
+    budget = vmem_get_max_resident();
+
+    if (a + b + c <= budget)
+        return a + b + 2 * c;
+
+    strips = (p + MATRIX_DEFAULT_TILE - 1) / MATRIX_DEFAULT_TILE;
+    return a + strips * b + 2 * c;
+}
+
+
+/* Plans the order in which to multiply a chain of n matrices, where matrix i
+ * is dims[i] x dims[i + 1], using the classic dynamic program with
+ * estimate_multiply_loads() as the cost of each step.  On return,
+ * split[i * n + j] (for i < j) is the index k at which the product of
+ * matrices i..j is best split into (i..k) * (k+1..j).  The split array must
+ * hold n * n entries.  Returns the estimated page loads of the best order.
+ */
+unsigned long matrix_chain_order(const int *dims, int n, int *split) {
+    unsigned long *cost, c, best;
+    int len, i, j, k;
+
+    assert(dims != NULL);
+    assert(split != NULL);
+    assert(n > 0);
+
+    cost = malloc(n * n * sizeof(unsigned long));
+    if (cost == NULL) {
+        fprintf(stderr, "matrix_chain_order: out of memory\n");
+        abort();
+    }
+
+    for (i = 0; i < n; i++)
+        cost[i * n + i] = 0;
+
+    for (len = 2; len <= n; len++) {
+        for (i = 0; i + len - 1 < n; i++) {
+            j = i + len - 1;
+            cost[i * n + j] = ULONG_MAX;
+            for (k = i; k < j; k++) {
+                c = cost[i * n + k] + cost[(k + 1) * n + j] +
+                    estimate_multiply_loads(dims[i], dims[k + 1],
+                                            dims[j + 1]);
+                if (c < cost[i * n + j]) {
+                    cost[i * n + j] = c;
+                    split[i * n + j] = k;
+                }
+            }
+        }
+    }
+
+    best = cost[n - 1];
+    free(cost);
+    return best;
+}
+
+
+/* Computes the product of mats[i..j] into dst, following the plan in split.
+ * Operands that are themselves products are built in the vmalloc arena, and
+ * the arena is released (discarding the temporaries' dirty pages) as soon as
+ * dst is complete.  Returns nonzero on success, or zero if the pool ran out.
+ */
+static int chain_product(matrix_t **mats, int n, const int *split, int i,
+                         int j, matrix_t *dst) {
+    matrix_t *left, *right;
+    void *mark;
+    int k, ok = 1;
+
+    if (i == j) {
+        copy_matrix(mats[i], dst);
+        return 1;
+    }
+
+    k = split[i * n + j];
+    mark = vmem_alloc_mark();
+
+    left = mats[i];
+    if (k > i) {
+        left = vmalloc_matrix_aligned(mats[i]->rows, mats[k]->cols,
+                                      MATRIX_ALIGN_CACHELINE);
+        ok = left != NULL && chain_product(mats, n, split, i, k, left);
+    }
+
+    right = mats[k + 1];
+    if (ok && j > k + 1) {
+        right = vmalloc_matrix_aligned(mats[k + 1]->rows, mats[j]->cols,
+                                       MATRIX_ALIGN_CACHELINE);
+        ok = right != NULL && chain_product(mats, n, split, k + 1, j, right);
+    }
+
+    if (ok)
+        multiply_matrices_tiled(left, right, dst, 0);
+
+    vmem_alloc_release(mark);
+    return ok;
+}
+
+
+/* Computes result = mats[0] * mats[1] * ... * mats[n - 1], choosing the order
+ * of the multiplications with matrix_chain_order().  Intermediate products
+ * are allocated from the virtual memory pool and discarded when no longer
+ * needed, so vmem_alloc_init() must have been called.  Returns nonzero on
+ * success, or zero if the pool is too small for the intermediates.
+ */
+int multiply_matrix_chain(matrix_t **mats, int n, matrix_t *result) {
+    int *dims, *split;
+    int i, ok;
+
+    assert(mats != NULL);
+    assert(result != NULL);
+    assert(n > 0);
+    assert(result->rows == mats[0]->rows);
+    assert(result->cols == mats[n - 1]->cols);
+
+    dims = malloc((n + 1) * sizeof(int));
+    split = malloc(n * n * sizeof(int));
+    if (dims == NULL || split == NULL) {
+        fprintf(stderr, "multiply_matrix_chain: out of memory\n");
+        abort();
+    }
+
+    for (i = 0; i < n; i++) {
+        assert(i == 0 || mats[i - 1]->cols == mats[i]->rows);
+        dims[i] = mats[i]->rows;
+    }
+    dims[n] = mats[n - 1]->cols;
+
+    matrix_chain_order(dims, n, split);
+    ok = chain_product(mats, n, split, 0, n - 1, result);
+
+    free(dims);
+    free(split);
+    return ok;
+}
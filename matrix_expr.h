@@ -0,0 +1,42 @@
+/*============================================================================
+ * Declarations for simple matrix expressions that avoid full-size temporary
+ * matrices:  a multiply with elementwise operations fused into it, and a
+ * matrix chain product whose multiplication order is planned to minimize the
+ * estimated number of page loads.
+ */
+
+
+#ifndef MATRIX_EXPR_H
+#define MATRIX_EXPR_H
+
+#include "matrix.h"
+
+
+/* Elementwise operations that can follow a multiply. */
+typedef enum epilogue_op_t {
+    EPILOGUE_ADD,       /* x = x + addend(r, c) */
+    EPILOGUE_SCALE,     /* x = x * scale        */
+    EPILOGUE_CLAMP      /* x = min(max(x, lo), hi) */
+} epilogue_op_t;
+
+
+/* One elementwise operation, with the operands it uses. */
+typedef struct matrix_epilogue_t {
+    epilogue_op_t op;
+    const matrix_t *addend;
+    int scale;
+    int lo;
+    int hi;
+} matrix_epilogue_t;
+
+
+void multiply_matrices_fused(const matrix_t *m1, const matrix_t *m2,
+                             matrix_t *result, const matrix_epilogue_t *ops,
+                             int nops);
+
+unsigned long estimate_multiply_loads(int p, int q, int r);
+unsigned long matrix_chain_order(const int *dims, int n, int *split);
+int multiply_matrix_chain(matrix_t **mats, int n, matrix_t *result);
+
+
+#endif /* MATRIX_EXPR_H */
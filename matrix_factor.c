@@ -0,0 +1,404 @@
+/*============================================================================
+ * Implementation of blocked LU and Cholesky factorizations.  The matrices
+ * are stored by rows, so every inner loop below runs along a row:  updates
+ * are written as "row i -= l * row t" or as dot products of two rows.
+ */
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "matrix_factor.h"
+#include "virtualmem.h"
+
+
+/* Element (i, j) of the matrix a. */
+#define A(a, i, j) ((a)->elems[(i) * (a)->ld + (j)])
+
+
+/* Returns a block size for factoring an n x n matrix, derived from the
+ * resident-page budget:  the largest multiple of 8 for which three nb x nb
+ * blocks (the pieces a block update works on at once) take at most half of
+ * the resident pages.  Each block row is counted as one extra page, since it
+ * usually straddles a page boundary.
+ */
+int factor_block_size(int n) {
+    unsigned int budget = vmem_get_max_resident() / 2;
+    int nb, row_pages;
+
+    for (nb = 8; nb + 8 <= n; nb += 8) {
+        row_pages = ((nb + 8) * sizeof(double) + PAGE_SIZE - 1) / PAGE_SIZE
+                    + 1;
+        if (3 * (nb + 8) * row_pages > budget)
+            break;
+    }
+    return nb < n ? nb : n;
+}
+
+
+/* Fills m with a random symmetric matrix whose diagonal entries are m->rows,
+ * and whose other entries are in [-1, 1).  Such a matrix is strictly
+ * diagonally dominant with a positive diagonal, so it is positive definite.
+ */
+void generate_spd_matrix_f64(matrix_f64_t *m, unsigned long seed) {
+    int i, j;
+
+    assert(m != NULL);
+    assert(m->rows == m->cols);
+
+    generate_matrix_values_f64(m, seed);
+    for (i = 0; i < m->rows; i++) {
+        for (j = 0; j < i; j++)
+            A(m, j, i) = A(m, i, j);
+        A(m, i, i) = m->rows;
+    }
+}
+
+
+/* Swaps rows r1 and r2 of a across their whole width. */
+static void swap_rows(matrix_f64_t *a, int r1, int r2) {
+    double *row1 = matrix_row_f64(a, r1), *row2 = matrix_row_f64(a, r2);
+    double t;
+    int c;
+
+    for (c = 0; c < a->cols; c++) {
+        t = row1[c];
+        row1[c] = row2[c];
+        row2[c] = t;
+    }
+}
+
+
+/* Factors the panel of columns [k, k + b) in rows [k, n) with partial
+ * pivoting, assuming it is already up to date with respect to the columns to
+ * its left.  Row interchanges are applied across the whole width of a, and
+ * recorded in piv.  Returns zero if a zero pivot was found.
+ */
+static int lu_panel(matrix_f64_t *a, int *piv, int k, int b) {
+    int n = a->rows, i, j, c, p, ok = 1;
+    double *rowi, *rowj, l, big;
+
+    for (j = k; j < k + b; j++) {
+        p = j;
+        big = fabs(A(a, j, j));
+        for (i = j + 1; i < n; i++) {
+            if (fabs(A(a, i, j)) > big) {
+                big = fabs(A(a, i, j));
+                p = i;
+            }
+        }
+
+        piv[j] = p;
+        if (big == 0.0) {
+            ok = 0;
+            continue;
+        }
+        if (p != j)
+            swap_rows(a, p, j);
+
+        rowj = matrix_row_f64(a, j);
+        for (i = j + 1; i < n; i++) {
+            rowi = matrix_row_f64(a, i);
+            l = rowi[j] /= rowj[j];
+            for (c = j + 1; c < k + b; c++)
+                rowi[c] -= l * rowj[c];
+        }
+    }
+
+    return ok;
+}
+
+
+/* For rows [r0, r1) of a, subtracts the contributions of the unit lower
+ * triangular rows [t0, t1) in columns [c0, c1):
+ *
+ *     row i -= a(i, t) * row t,  for t in [t0, min(i, t1))
+ *
+ * With r0 == t0 this is a forward substitution (a triangular solve) on the
+ * block rows; with r0 >= t1 it is a plain block update.  The rows t are taken
+ * tile at a time, so that one tile of them stays resident while every row i
+ * goes past.  Each row t is final before it is used, since all of the rows
+ * before it are applied in earlier tiles or earlier in the same tile.
+ */
+static void lower_update(matrix_f64_t *a, int r0, int r1, int t0, int t1,
+                         int c0, int c1, int tile) {
+    int i, t, c, tt, tt_end, t_end;
+    double *rowi, l;
+    const double *rowt;
+
+    for (tt = t0; tt < t1; tt += tile) {
+        tt_end = tt + tile < t1 ? tt + tile : t1;
+        for (i = r0 > tt ? r0 : tt; i < r1; i++) {
+            rowi = matrix_row_f64(a, i);
+            t_end = i < tt_end ? i : tt_end;
+            for (t = tt; t < t_end; t++) {
+                l = rowi[t];
+                rowt = matrix_row_const_f64(a, t);
+                for (c = c0; c < c1; c++)
+                    rowi[c] -= l * rowt[c];
+            }
+        }
+    }
+}
+
+
+/* Factors the square matrix a in place into P A = L U, where L is unit lower
+ * triangular and U is upper triangular, using blocks of nb columns (0 means
+ * factor_block_size()).  On return, piv[j] is the row that was swapped with
+ * row j at step j.  Returns nonzero on success, or zero if a is singular.
+ */
+int lu_factor(matrix_f64_t *a, int *piv, int nb, factor_variant_t variant) {
+    int n, k, b, ok = 1;
+
+    assert(a != NULL);
+    assert(piv != NULL);
+    assert(a->rows == a->cols);
+
+    n = a->rows;
+    if (nb <= 0)
+        nb = factor_block_size(n);
+
+    for (k = 0; k < n; k += nb) {
+        b = k + nb < n ? nb : n - k;
+
+        if (variant == FACTOR_LEFT_LOOKING) {
+            /* Bring block column k up to date:  solve for its U part above
+             * the diagonal, then subtract L * U from the rest of it.
+             */
+            lower_update(a, 0, k, 0, k, k, k + b, nb);
+            lower_update(a, k, n, 0, k, k, k + b, nb);
+        }
+
+        ok &= lu_panel(a, piv, k, b);
+
+        if (variant == FACTOR_RIGHT_LOOKING && k + b < n) {
+            /* Solve for the block row of U, then update the trailing
+             * matrix with it.
+             */
+            lower_update(a, k, k + b, k, k + b, k + b, n, nb);
+            lower_update(a, k + b, n, k, k + b, k + b, n, nb);
+        }
+    }
+
+    return ok;
+}
+
+
+/* For rows i in [r0, r1) and columns j in [c0, min(c1, i + 1)) of the lower
+ * triangle of a, subtracts the dot product of row i and row j over columns
+ * [t0, t1).  Then, if factor is nonzero, finishes the Cholesky step for
+ * column j:  the diagonal element becomes its square root, and elements below
+ * it are divided by the diagonal (and the dot product stops at column j).
+ * Returns zero if a diagonal element is not positive.
+ *
+ * The columns j are taken tile at a time, so that the matching rows j stay
+ * resident while every row i goes past.  Element (i, j) only depends on
+ * elements to its left in row i, and on row j, which are all finished in
+ * earlier tiles or earlier in the same tile.
+ */
+static int cholesky_update(matrix_f64_t *a, int r0, int r1, int c0, int c1,
+                           int t0, int t1, int factor, int tile) {
+    int i, j, t, jj, j_end, t_end;
+    double *rowi, s;
+    const double *rowj;
+
+    for (jj = c0; jj < c1; jj += tile) {
+        for (i = r0 > jj ? r0 : jj; i < r1; i++) {
+            rowi = matrix_row_f64(a, i);
+            j_end = jj + tile < c1 ? jj + tile : c1;
+            j_end = i + 1 < j_end ? i + 1 : j_end;
+            for (j = jj; j < j_end; j++) {
+                rowj = matrix_row_const_f64(a, j);
+                s = rowi[j];
+                t_end = factor ? j : t1;
+                for (t = t0; t < t_end; t++)
+                    s -= rowi[t] * rowj[t];
+
+                if (!factor) {
+                    rowi[j] = s;
+                }
+                else if (i == j) {
+                    if (s <= 0.0)
+                        return 0;
+                    rowi[j] = sqrt(s);
+                }
+                else {
+                    rowi[j] = s / rowj[j];
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+
+/* Factors the symmetric positive definite matrix a in place into A = L L^T,
+ * using blocks of nb columns (0 means factor_block_size()).  Only the lower
+ * triangle of a is read or written; on return it holds L.  Returns nonzero
+ * on success, or zero if a is not positive definite.
+ */
+int cholesky_factor(matrix_f64_t *a, int nb, factor_variant_t variant) {
+    int n, k, b;
+
+    assert(a != NULL);
+    assert(a->rows == a->cols);
+
+    n = a->rows;
+    if (nb <= 0)
+        nb = factor_block_size(n);
+
+    for (k = 0; k < n; k += nb) {
+        b = k + nb < n ? nb : n - k;
+
+        /* Left-looking:  bring block column k up to date with all of the
+         * columns to its left first.
+         */
+        if (variant == FACTOR_LEFT_LOOKING)
+            cholesky_update(a, k, n, k, k + b, 0, k, 0, nb);
+
+        /* Factor the diagonal block, and solve for the block column below
+         * it.
+         */
+        if (!cholesky_update(a, k, n, k, k + b, k, k + b, 1, nb))
+            return 0;
+
+        /* Right-looking:  subtract this block column's contribution from
+         * the whole trailing matrix.
+         */
+        if (variant == FACTOR_RIGHT_LOOKING && k + b < n)
+            cholesky_update(a, k + b, n, k + b, n, k, k + b, 0, nb);
+    }
+
+    return 1;
+}
+
+
+/* Returns a pseudo-random test vector with entries in [-1, 1). */
+static double * test_vector(int n) {
+    double *x = malloc(n * sizeof(double));
+    int i;
+
+    if (x == NULL) {
+        fprintf(stderr, "test_vector: out of memory\n");
+        abort();
+    }
+    for (i = 0; i < n; i++)
+        x[i] = (double) (splitmix64(i) >> 11) / (double) (1ull << 52) - 1.0;
+    return x;
+}
+
+
+/* Returns max |y1 - y2| / (max |y2| + 1) over two vectors of length n. */
+static double relative_difference(const double *y1, const double *y2, int n) {
+    double diff = 0.0, norm = 0.0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (fabs(y1[i] - y2[i]) > diff)
+            diff = fabs(y1[i] - y2[i]);
+        if (fabs(y2[i]) > norm)
+            norm = fabs(y2[i]);
+    }
+    return diff / (norm + 1.0);
+}
+
+
+/* Checks an LU factorization by comparing L (U x) with P (A x) for a test
+ * vector x, which takes O(n^2) time.  orig is the matrix before factoring,
+ * and lu and piv are what lu_factor() produced.  Returns the relative
+ * difference, which should be a small multiple of the machine epsilon.
+ */
+double lu_residual(const matrix_f64_t *orig, const matrix_f64_t *lu,
+                   const int *piv) {
+    int n = orig->rows, i, j;
+    double *x, *ax, *y, *z, s, t;
+
+    x = test_vector(n);
+    ax = malloc(n * sizeof(double));
+    y = malloc(n * sizeof(double));
+    z = malloc(n * sizeof(double));
+    if (!ax || !y || !z) {
+        fprintf(stderr, "lu_residual: out of memory\n");
+        abort();
+    }
+
+    for (i = 0; i < n; i++) {
+        const double *row = matrix_row_const_f64(orig, i);
+        for (s = 0.0, j = 0; j < n; j++)
+            s += row[j] * x[j];
+        ax[i] = s;
+    }
+    for (i = 0; i < n; i++) {
+        t = ax[i];
+        ax[i] = ax[piv[i]];
+        ax[piv[i]] = t;
+    }
+
+    for (i = 0; i < n; i++) {
+        const double *row = matrix_row_const_f64(lu, i);
+        for (s = 0.0, j = i; j < n; j++)
+            s += row[j] * x[j];
+        y[i] = s;
+    }
+    for (i = 0; i < n; i++) {
+        const double *row = matrix_row_const_f64(lu, i);
+        for (s = y[i], j = 0; j < i; j++)
+            s += row[j] * y[j];
+        z[i] = s;
+    }
+
+    s = relative_difference(z, ax, n);
+    free(x);
+    free(ax);
+    free(y);
+    free(z);
+    return s;
+}
+
+
+/* Checks a Cholesky factorization by comparing L (L^T x) with A x for a test
+ * vector x.  orig is the matrix before factoring, and l is what
+ * cholesky_factor() produced.  Returns the relative difference.
+ */
+double cholesky_residual(const matrix_f64_t *orig, const matrix_f64_t *l) {
+    int n = orig->rows, i, j;
+    double *x, *ax, *y, *z, s;
+
+    x = test_vector(n);
+    ax = malloc(n * sizeof(double));
+    y = calloc(n, sizeof(double));
+    z = malloc(n * sizeof(double));
+    if (!ax || !y || !z) {
+        fprintf(stderr, "cholesky_residual: out of memory\n");
+        abort();
+    }
+
+    for (i = 0; i < n; i++) {
+        const double *row = matrix_row_const_f64(orig, i);
+        for (s = 0.0, j = 0; j < n; j++)
+            s += row[j] * x[j];
+        ax[i] = s;
+    }
+
+    /* y = L^T x, accumulated a row of L at a time. */
+    for (i = 0; i < n; i++) {
+        const double *row = matrix_row_const_f64(l, i);
+        for (j = 0; j <= i; j++)
+            y[j] += row[j] * x[i];
+    }
+    for (i = 0; i < n; i++) {
+        const double *row = matrix_row_const_f64(l, i);
+        for (s = 0.0, j = 0; j <= i; j++)
+            s += row[j] * y[j];
+        z[i] = s;
+    }
+
+    s = relative_difference(z, ax, n);
+    free(x);
+    free(ax);
+    free(y);
+    free(z);
+    return s;
+}
@@ -0,0 +1,33 @@
+/*============================================================================
+ * Declarations for blocked dense factorizations over double-precision
+ * matrices:  LU with partial pivoting, and Cholesky.  Both come in a
+ * right-looking variant, which updates the whole trailing matrix after each
+ * block column (fewer reads, many writes), and a left-looking variant, which
+ * brings each block column up to date just before factoring it (more reads,
+ * but only the current block column is written).
+ */
+
+
+#ifndef MATRIX_FACTOR_H
+#define MATRIX_FACTOR_H
+
+#include "matrix_typed.h"
+
+
+/* Which blocked algorithm to use. */
+typedef enum factor_variant_t {
+    FACTOR_RIGHT_LOOKING,
+    FACTOR_LEFT_LOOKING
+} factor_variant_t;
+
+
+int factor_block_size(int n);
+void generate_spd_matrix_f64(matrix_f64_t *m, unsigned long seed);
+int lu_factor(matrix_f64_t *a, int *piv, int nb, factor_variant_t variant);
+int cholesky_factor(matrix_f64_t *a, int nb, factor_variant_t variant);
+double lu_residual(const matrix_f64_t *orig, const matrix_f64_t *lu,
+                   const int *piv);
+double cholesky_residual(const matrix_f64_t *orig, const matrix_f64_t *l);
+
+
+#endif /* MATRIX_FACTOR_H */
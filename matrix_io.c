@@ -0,0 +1,263 @@
+/*============================================================================
+ * Implementation of the matrix file format declared in matrix_io.h.
+ */
+
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "matrix_io.h"
+#include "virtualmem.h"
+#include "vmalloc.h"
+
+
+/* Rounds n up to a whole number of pages. */
+static uint64_t round_to_page(uint64_t n) {
+    return (n + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+
+/* Writes len bytes to fd at offset, reporting any error.  Returns nonzero on
+ * success.
+ */
+static int write_all(int fd, const void *buf, size_t len, off_t offset,
+                     const char *path) {
+    ssize_t wc;
+
+    while (len > 0) {
+        wc = pwrite(fd, buf, len, offset);
+        if (wc < 0) {
+            perror(path);
+            return 0;
+        }
+        buf = (const char *) buf + wc;
+        len -= wc;
+        offset += wc;
+    }
+    return 1;
+}
+
+
+/* Reads len bytes from fd at offset, reporting any error.  Returns nonzero
+ * on success.
+ */
+static int read_all(int fd, void *buf, size_t len, off_t offset,
+                    const char *path) {
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = pread(fd, buf, len, offset);
+        if (rc <= 0) {
+            if (rc < 0)
+                perror(path);
+            else
+                fprintf(stderr, "%s: unexpected end of file\n", path);
+            return 0;
+        }
+        buf = (char *) buf + rc;
+        len -= rc;
+        offset += rc;
+    }
+    return 1;
+}
+
+
+/* Saves m to the file at path.  By default the rows are written one after
+ * another with the stride chosen by the MATRIX_ALIGN_* value in flags; with
+ * MATRIX_FILE_TILED, the data is written as page-sized tiles instead, in
+ * row-of-tiles order.  Data is written a page at a time, so m is read in
+ * order whatever its own layout.  Returns nonzero on success.
+ */
+int save_matrix(const matrix_t *m, const char *path, int flags) {
+    char page[PAGE_SIZE];
+    matrix_file_header_t *hdr = (matrix_file_header_t *) page;
+    int *buf = (int *) page;
+    int fd, ok = 1, r, c, tr, tc, i, per_page, row_pages;
+    int t = MATRIX_FILE_TILE;
+    off_t off;
+
+    assert(m != NULL);
+    assert(path != NULL);
+    assert(t * t * sizeof(int) == PAGE_SIZE);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+
+    memset(page, 0, PAGE_SIZE);
+    memcpy(hdr->magic, MATRIX_FILE_MAGIC, sizeof(hdr->magic));
+    hdr->version = MATRIX_FILE_VERSION;
+    hdr->elem_size = sizeof(int);
+    hdr->rows = m->rows;
+    hdr->cols = m->cols;
+    hdr->data_offset = PAGE_SIZE;
+    if (flags & MATRIX_FILE_TILED) {
+        hdr->ld = 0;
+        hdr->tile = t;
+        hdr->data_bytes = (uint64_t) ((m->rows + t - 1) / t) *
+                          ((m->cols + t - 1) / t) * PAGE_SIZE;
+    }
+    else {
+        hdr->ld = matrix_padded_ld(m->cols, sizeof(int), flags);
+        hdr->tile = 0;
+        hdr->data_bytes = round_to_page((uint64_t) m->rows * hdr->ld *
+                                        sizeof(int));
+    }
+    ok = write_all(fd, page, PAGE_SIZE, 0, path);
+    off = hdr->data_offset;
+
+    if (ok && (flags & MATRIX_FILE_TILED)) {
+        for (tr = 0; ok && tr < m->rows; tr += t) {
+            for (tc = 0; ok && tc < m->cols; tc += t) {
+                memset(page, 0, PAGE_SIZE);
+                for (r = tr; r < tr + t && r < m->rows; r++) {
+                    for (c = tc; c < tc + t && c < m->cols; c++)
+                        buf[(r - tr) * t + (c - tc)] = m->elems[r * m->ld + c];
+                }
+                ok = write_all(fd, page, PAGE_SIZE, off, path);
+                off += PAGE_SIZE;
+            }
+        }
+    }
+    else if (ok) {
+        /* Build each page of the output from as many rows as touch it. */
+        int ld = hdr->ld;
+        per_page = PAGE_SIZE / sizeof(int);
+        row_pages = hdr->data_bytes / PAGE_SIZE;
+        for (i = 0; ok && i < row_pages; i++) {
+            int first = i * per_page, e;
+            memset(page, 0, PAGE_SIZE);
+            for (e = 0; e < per_page; e++) {
+                r = (first + e) / ld;
+                c = (first + e) % ld;
+                if (r < m->rows && c < m->cols)
+                    buf[e] = m->elems[r * m->ld + c];
+            }
+            ok = write_all(fd, page, PAGE_SIZE, off, path);
+            off += PAGE_SIZE;
+        }
+    }
+
+    if (close(fd) < 0) {
+        perror(path);
+        ok = 0;
+    }
+    return ok;
+}
+
+
+/* Loads the matrix stored in the file at path.  If use_vmem is zero, the
+ * matrix is allocated with malloc() and read in full.  Otherwise it is
+ * allocated from the virtual memory pool:  row-major data is mapped with
+ * vmem_map_file() so that each page is read only when first touched (the file
+ * stays open for this), while tiled data is read a tile at a time and
+ * scattered into page-aligned rows.  Returns NULL on failure.
+ */
+matrix_t * load_matrix(const char *path, int use_vmem) {
+    matrix_file_header_t hdr;
+    int tile_buf[MATRIX_FILE_TILE * MATRIX_FILE_TILE];
+    matrix_t *m;
+    int fd, r, c, tr, tc, t, *row;
+    uint64_t need;
+    off_t off;
+
+    assert(path != NULL);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+
+    if (!read_all(fd, &hdr, sizeof(hdr), 0, path))
+        goto fail;
+    if (memcmp(hdr.magic, MATRIX_FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != MATRIX_FILE_VERSION || hdr.elem_size != sizeof(int) ||
+        hdr.rows <= 0 || hdr.cols <= 0 || hdr.data_offset % PAGE_SIZE != 0 ||
+        (hdr.tile != 0 && hdr.tile != MATRIX_FILE_TILE) ||
+        (hdr.tile == 0 && hdr.ld < hdr.cols)) {
+        fprintf(stderr, "%s: not a matrix file\n", path);
+        goto fail;
+    }
+
+    /* The data must cover every element, since the lazy mapping below is
+     * only as big as data_bytes says.
+     */
+    if (hdr.tile != 0)
+        need = (uint64_t) ((hdr.rows + hdr.tile - 1) / hdr.tile) *
+               ((hdr.cols + hdr.tile - 1) / hdr.tile) * PAGE_SIZE;
+    else
+        need = (uint64_t) hdr.rows * hdr.ld * sizeof(int);
+    if (hdr.data_bytes % PAGE_SIZE != 0 || hdr.data_bytes < need) {
+        fprintf(stderr, "%s: header gives %llu data bytes, but the matrix "
+                "needs %llu\n", path, (unsigned long long) hdr.data_bytes,
+                (unsigned long long) need);
+        goto fail;
+    }
+
+    if (hdr.tile == 0 && use_vmem) {
+        /* Lay out a matrix that matches the file exactly, and let the pager
+         * fill it in on demand.
+         */
+        m = vmem_alloc(sizeof(matrix_t));
+        if (m == NULL)
+            goto fail;
+        m->elems = vmem_alloc_aligned(hdr.data_bytes, PAGE_SIZE);
+        if (m->elems == NULL)
+            goto fail;
+        m->rows = hdr.rows;
+        m->cols = hdr.cols;
+        m->ld = hdr.ld;
+        vmem_map_file(m->elems, hdr.data_bytes, fd, hdr.data_offset);
+        return m;
+    }
+
+    if (use_vmem)
+        m = vmalloc_matrix_aligned(hdr.rows, hdr.cols, MATRIX_ALIGN_PAGE);
+    else
+        m = malloc_matrix(hdr.rows, hdr.cols);
+    if (m == NULL)
+        goto fail;
+
+    off = hdr.data_offset;
+    if (hdr.tile != 0) {
+        t = hdr.tile;
+        for (tr = 0; tr < m->rows; tr += t) {
+            for (tc = 0; tc < m->cols; tc += t) {
+                if (!read_all(fd, tile_buf, PAGE_SIZE, off, path))
+                    goto fail_matrix;
+                off += PAGE_SIZE;
+                for (r = tr; r < tr + t && r < m->rows; r++) {
+                    row = matrix_row(m, r);
+                    for (c = tc; c < tc + t && c < m->cols; c++)
+                        row[c] = tile_buf[(r - tr) * t + (c - tc)];
+                }
+            }
+        }
+    }
+    else {
+        for (r = 0; r < m->rows; r++) {
+            row = matrix_row(m, r);
+            if (!read_all(fd, row, m->cols * sizeof(int),
+                          off + (off_t) r * hdr.ld * sizeof(int), path))
+                goto fail_matrix;
+        }
+    }
+
+    close(fd);
+    return m;
+
+fail_matrix:
+    /* Pool memory can't be given back, but a malloc()'d matrix can. */
+    if (!use_vmem)
+        free(m);
+fail:
+    close(fd);
+    return NULL;
+}
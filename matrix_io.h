@@ -0,0 +1,55 @@
+/*============================================================================
+ * Declarations for saving matrices to, and loading them from, a simple
+ * binary file format.  A file is a one-page header followed by the element
+ * data, which starts on a page boundary and is padded to a whole number of
+ * pages.  The data is either row-major (with a page-friendly row stride), or
+ * in tiles of exactly one page each.
+ *
+ * Loading a row-major file into the virtual memory pool doesn't read the
+ * data; the pages are filled from the file as they are first touched.
+ */
+
+
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <stdint.h>
+
+#include "matrix.h"
+
+
+/* The magic bytes that start every matrix file, and the format version. */
+#define MATRIX_FILE_MAGIC "VMMATRIX"
+#define MATRIX_FILE_VERSION 1
+
+/* Tiled files store TILE x TILE blocks, each exactly one page of ints. */
+#define MATRIX_FILE_TILE 32
+
+/* Flag for save_matrix():  write the data in tiled order.  It may be
+ * combined with the MATRIX_ALIGN_* flags, which choose the row stride of
+ * row-major files.
+ */
+#define MATRIX_FILE_TILED 0x100
+
+
+/* The header at the start of a matrix file.  It is padded out to a full page
+ * in the file.  All fields are in the host's byte order.
+ */
+typedef struct matrix_file_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t elem_size;     /* Bytes per element; always sizeof(int).     */
+    int32_t rows;
+    int32_t cols;
+    int32_t ld;             /* Row stride of row-major data, in elements. */
+    uint32_t tile;          /* Tile edge for tiled data, or 0.            */
+    uint64_t data_offset;   /* Page-aligned file offset of the data.      */
+    uint64_t data_bytes;    /* Bytes of data, a multiple of PAGE_SIZE.    */
+} matrix_file_header_t;
+
+
+int save_matrix(const matrix_t *m, const char *path, int flags);
+matrix_t * load_matrix(const char *path, int use_vmem);
+
+
+#endif /* MATRIX_IO_H */
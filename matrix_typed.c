@@ -0,0 +1,203 @@
+/*============================================================================
+ * Implementation of the typed matrix variants declared in matrix_typed.h.
+ * Every function is written once, in DEFINE_MATRIX_TYPE, and instantiated for
+ * each entry of MATRIX_TYPE_LIST.
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "matrix_typed.h"
+#include "virtualmem.h"
+#include "vmalloc.h"
+
+
+/* Converts 64 random bits into an element value.  Integers get values in
+ * [-1000, 1000] like matrix_t, so that products can be checked against the
+ * int kernels; floating-point types get values in [-1, 1).
+ */
+static inline float random_f32(uint64_t x) {
+    return (float) ((int64_t) (x >> 40) - (1 << 23)) / (float) (1 << 23);
+}
+
+static inline double random_f64(uint64_t x) {
+    return (double) ((int64_t) (x >> 11) - (1ll << 52)) / (double) (1ll << 52);
+}
+
+static inline int64_t random_i64(uint64_t x) {
+    return (int64_t) (((x >> 32) * 2001) >> 32) - 1000;
+}
+
+
+#define DEFINE_MATRIX_TYPE(sfx, T)                                          \
+                                                                            \
+/* Allocate a rows x cols matrix using malloc().  The elements themselves   \
+ * are uninitialized.                                                       \
+ */                                                                         \
+matrix_##sfx##_t * malloc_matrix_##sfx(int rows, int cols) {                \
+    matrix_##sfx##_t *m;                                                    \
+                                                                            \
+    m = malloc(sizeof(matrix_##sfx##_t) + rows * cols * sizeof(T));         \
+    if (m == NULL)                                                          \
+        return NULL;                                                        \
+    m->rows = rows;                                                         \
+    m->cols = cols;                                                         \
+    m->ld = cols;                                                           \
+    m->elems = (T *) (m + 1);                                               \
+    return m;                                                               \
+}                                                                           \
+                                                                            \
+/* Allocate a rows x cols matrix from the virtual memory pool, with its     \
+ * rows laid out as requested by flags.  Returns NULL if the pool is        \
+ * exhausted.                                                               \
+ */                                                                         \
+matrix_##sfx##_t * vmalloc_matrix_aligned_##sfx(int rows, int cols,         \
+                                                int flags) {                \
+    matrix_##sfx##_t *m;                                                    \
+    int ld = matrix_padded_ld(cols, sizeof(T), flags);                      \
+                                                                            \
+    if (flags & MATRIX_HEADER_OWN_PAGE)                                     \
+        m = vmem_alloc_aligned(PAGE_SIZE, PAGE_SIZE);                       \
+    else                                                                    \
+        m = vmem_alloc_aligned(sizeof(matrix_##sfx##_t), sizeof(T *));      \
+    if (m == NULL)                                                          \
+        return NULL;                                                        \
+                                                                            \
+    m->elems = vmem_alloc_aligned(rows * ld * sizeof(T),                    \
+                                  matrix_data_align(flags));                \
+    if (m->elems == NULL)                                                   \
+        return NULL;                                                        \
+                                                                            \
+    m->rows = rows;                                                         \
+    m->cols = cols;                                                         \
+    m->ld = ld;                                                             \
+    return m;                                                               \
+}                                                                           \
+                                                                            \
+/* Allocate a rows x cols matrix from the virtual memory pool, with packed  \
+ * rows.                                                                    \
+ */                                                                         \
+matrix_##sfx##_t * vmalloc_matrix_##sfx(int rows, int cols) {               \
+    return vmalloc_matrix_aligned_##sfx(rows, cols, MATRIX_ALIGN_NONE);     \
+}                                                                           \
+                                                                            \
+/* Fill the matrix with random values from the counter-based generator,     \
+ * keyed by seed.  The same seed always gives the same matrix.              \
+ */                                                                         \
+void generate_matrix_values_##sfx(matrix_##sfx##_t *m, unsigned long seed) {\
+    int r, c;                                                               \
+    T *row;                                                                 \
+    uint64_t key, base;                                                     \
+                                                                            \
+    assert(m != NULL);                                                      \
+                                                                            \
+    key = splitmix64(seed) << 20;                                           \
+    for (r = 0; r < m->rows; r++) {                                         \
+        row = matrix_row_##sfx(m, r);                                       \
+        base = key + (uint64_t) r * m->cols;                                \
+        for (c = 0; c < m->cols; c++)                                       \
+            row[c] = random_##sfx(splitmix64(base + c));                    \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+/* Multiplies m1 and m2 into result one tile x tile block at a time, with   \
+ * the innermost loop running along rows of m2 and result.  Pass 0 for      \
+ * tile to get MATRIX_DEFAULT_TILE.                                         \
+ */                                                                         \
+void multiply_matrices_##sfx(const matrix_##sfx##_t *m1,                    \
+                             const matrix_##sfx##_t *m2,                    \
+                             matrix_##sfx##_t *result, int tile) {          \
+    int rr, ii, cc, r, i, c, r_end, i_end, c_end;                           \
+    const T *row1, *row2;                                                   \
+    T *rowr, a;                                                             \
+                                                                            \
+    assert(m1 != NULL);                                                     \
+    assert(m2 != NULL);                                                     \
+    assert(result != NULL);                                                 \
+    assert(m1->cols == m2->rows);                                           \
+    assert(m1->rows == result->rows);                                       \
+    assert(m2->cols == result->cols);                                       \
+                                                                            \
+    if (tile <= 0)                                                          \
+        tile = MATRIX_DEFAULT_TILE;                                         \
+                                                                            \
+    for (r = 0; r < result->rows; r++) {                                    \
+        rowr = matrix_row_##sfx(result, r);                                 \
+        for (c = 0; c < result->cols; c++)                                  \
+            rowr[c] = 0;                                                    \
+    }                                                                       \
+                                                                            \
+    for (rr = 0; rr < result->rows; rr += tile) {                           \
+        r_end = rr + tile < result->rows ? rr + tile : result->rows;        \
+        for (ii = 0; ii < m1->cols; ii += tile) {                           \
+            i_end = ii + tile < m1->cols ? ii + tile : m1->cols;            \
+            for (cc = 0; cc < result->cols; cc += tile) {                   \
+                c_end = cc + tile < result->cols ? cc + tile : result->cols;\
+                for (r = rr; r < r_end; r++) {                              \
+                    row1 = matrix_row_const_##sfx(m1, r);                   \
+                    rowr = matrix_row_##sfx(result, r);                     \
+                    for (i = ii; i < i_end; i++) {                          \
+                        a = row1[i];                                        \
+                        row2 = matrix_row_const_##sfx(m2, i);               \
+                        for (c = cc; c < c_end; c++)                        \
+                            rowr[c] += a * row2[c];                         \
+                    }                                                       \
+                }                                                           \
+            }                                                               \
+        }                                                                   \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+/* Given two matrices of the same dimensions, copies the elements from the  \
+ * source matrix into the destination matrix.                               \
+ */                                                                         \
+void copy_matrix_##sfx(const matrix_##sfx##_t *src, matrix_##sfx##_t *dst) {\
+    int r, c;                                                               \
+    const T *rs;                                                            \
+    T *rd;                                                                  \
+                                                                            \
+    assert(src != NULL);                                                    \
+    assert(dst != NULL);                                                    \
+    assert(src->rows == dst->rows);                                         \
+    assert(src->cols == dst->cols);                                         \
+                                                                            \
+    for (r = 0; r < src->rows; r++) {                                       \
+        rs = matrix_row_const_##sfx(src, r);                                \
+        rd = matrix_row_##sfx(dst, r);                                      \
+        for (c = 0; c < src->cols; c++)                                     \
+            rd[c] = rs[c];                                                  \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+/* Compare two matrices for exact equality; returns nonzero if the          \
+ * matrices have the same values, or zero if they are different.  Results   \
+ * computed by the same kernel on the same inputs are bit-for-bit equal,    \
+ * whichever memory they live in.                                           \
+ */                                                                         \
+int compare_matrices_##sfx(const matrix_##sfx##_t *m1,                      \
+                           const matrix_##sfx##_t *m2) {                    \
+    int r, c, same;                                                         \
+    const T *row1, *row2;                                                   \
+                                                                            \
+    assert(m1 != NULL);                                                     \
+    assert(m2 != NULL);                                                     \
+                                                                            \
+    if (m1->rows != m2->rows || m1->cols != m2->cols)                       \
+        return 0;                                                           \
+                                                                            \
+    for (r = 0; r < m1->rows; r++) {                                        \
+        row1 = matrix_row_const_##sfx(m1, r);                               \
+        row2 = matrix_row_const_##sfx(m2, r);                               \
+        same = 1;                                                           \
+        for (c = 0; c < m1->cols; c++)                                      \
+            same &= (row1[c] == row2[c]);                                   \
+        if (!same)                                                          \
+            return 0;                                                       \
+    }                                                                       \
+    return 1;                                                               \
+}
+
+MATRIX_TYPE_LIST(DEFINE_MATRIX_TYPE)
@@ -0,0 +1,72 @@
+/*============================================================================
+ * Declarations of typed variants of the 2D matrix type in matrix.h, holding
+ * float, double or int64_t elements.  Each element type gets its own struct
+ * and its own copy of the kernels, generated from a single macro, so the
+ * compiler can vectorize each one for its element size.  Matrices can be
+ * allocated from the virtual memory pool or using malloc(), and use the same
+ * MATRIX_ALIGN_* layout flags as matrix_t.
+ *
+ * For a suffix sfx and element type T, this declares:
+ *
+ *     matrix_sfx_t                     (rows, cols, ld, T *elems)
+ *     matrix_row_sfx(), matrix_row_const_sfx()
+ *     malloc_matrix_sfx(), vmalloc_matrix_sfx(), vmalloc_matrix_aligned_sfx()
+ *     generate_matrix_values_sfx(), multiply_matrices_sfx(),
+ *     copy_matrix_sfx(), compare_matrices_sfx()
+ */
+
+
+#ifndef MATRIX_TYPED_H
+#define MATRIX_TYPED_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+
+/* The element types that get a typed matrix, as (suffix, type) pairs. */
+#define MATRIX_TYPE_LIST(X) \
+    X(f32, float)           \
+    X(f64, double)          \
+    X(i64, int64_t)
+
+
+#define DECLARE_MATRIX_TYPE(sfx, T)                                         \
+                                                                            \
+typedef struct matrix_##sfx##_t {                                           \
+    int rows;                                                               \
+    int cols;                                                               \
+    int ld;                                                                 \
+    T *elems;                                                               \
+} matrix_##sfx##_t;                                                         \
+                                                                            \
+static inline T * matrix_row_##sfx(matrix_##sfx##_t *m, int r) {            \
+    MATRIX_CHECK(m != NULL);                                                \
+    MATRIX_CHECK(r >= 0 && r < m->rows);                                    \
+    return m->elems + r * m->ld;                                            \
+}                                                                           \
+                                                                            \
+static inline const T * matrix_row_const_##sfx(const matrix_##sfx##_t *m,   \
+                                               int r) {                     \
+    MATRIX_CHECK(m != NULL);                                                \
+    MATRIX_CHECK(r >= 0 && r < m->rows);                                    \
+    return m->elems + r * m->ld;                                            \
+}                                                                           \
+                                                                            \
+matrix_##sfx##_t * malloc_matrix_##sfx(int rows, int cols);                 \
+matrix_##sfx##_t * vmalloc_matrix_##sfx(int rows, int cols);                \
+matrix_##sfx##_t * vmalloc_matrix_aligned_##sfx(int rows, int cols,         \
+                                                int flags);                 \
+void generate_matrix_values_##sfx(matrix_##sfx##_t *m, unsigned long seed); \
+void multiply_matrices_##sfx(const matrix_##sfx##_t *m1,                    \
+                             const matrix_##sfx##_t *m2,                    \
+                             matrix_##sfx##_t *result, int tile);           \
+void copy_matrix_##sfx(const matrix_##sfx##_t *src, matrix_##sfx##_t *dst); \
+int compare_matrices_##sfx(const matrix_##sfx##_t *m1,                      \
+                           const matrix_##sfx##_t *m2);
+
+MATRIX_TYPE_LIST(DECLARE_MATRIX_TYPE)
+
+
+#endif /* MATRIX_TYPED_H */
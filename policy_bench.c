@@ -0,0 +1,427 @@
+/*============================================================================
+ * A microbenchmark for the page replacement policies on their own.  The
+ * program links against a policy but not against the virtual memory system:
+ * it supplies the few page table functions that the policies call itself,
+ * over a page table covering every value of page_t, and drives the policy
+ * with a synthetic stream of page-ins, evictions, accesses and timer ticks.
+ * That measures what each policy operation costs inside the fault handler,
+ * and how that cost and the policy's memory grow with max_resident, far
+ * beyond the pool that the virtual memory system itself can manage.
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "splitmix.h"
+#include "vmpolicy.h"
+
+/* The number of pages in the benchmark's page table:  one per page_t. */
+#define NUM_BENCH_PAGES (1 << (8 * sizeof(page_t)))
+
+/* The sizes measured when none are given:  64 pages doubling up to 32768. */
+#define DEFAULT_MIN_RESIDENT 64
+#define DEFAULT_MAX_RESIDENT 32768
+
+
+static long seed = 0;
+static long num_ops = 200000;       /* Evictions per size.           */
+static int touches = 4;             /* Pages accessed per eviction.  */
+static int tick_every = 1000;       /* Evictions per timer tick.     */
+
+/* The max_resident values to measure, from the command line. */
+static int *sizes;
+static int num_sizes;
+
+static uint64_t random_state;
+
+
+/* Prints the program's usage, and then exit the program. */
+void usage(const char *prog) {
+    printf("usage: %s [--seed num] [--ops num] [--touches num]\n"
+           "\t[--tick_every num] [max_resident ...]\n", prog);
+    printf("\tDrives the page replacement policy with synthetic page-ins,\n");
+    printf("\tevictions, accesses and timer ticks for each max_resident\n");
+    printf("\tgiven (by default %d doubling up to %d, and at most %d),\n",
+           DEFAULT_MIN_RESIDENT, DEFAULT_MAX_RESIDENT, NUM_BENCH_PAGES - 1);
+    printf("\tand reports the time per operation and the policy's memory\n");
+    printf("\tper resident page.\n\n");
+    printf("\t--seed | -s num optionally specifies the seed for the random\n");
+    printf("\tnumber generator.  The system time is used otherwise.\n\n");
+    printf("\t--ops | -n num sets the number of evictions, each followed by\n");
+    printf("\ta page-in, per size (default 200000).\n\n");
+    printf("\t--touches | -t num sets the number of random resident pages\n");
+    printf("\taccessed between evictions (default 4).\n\n");
+    printf("\t--tick_every | -T num sets the number of evictions between\n");
+    printf("\ttimer ticks (default 1000).\n");
+    exit(1);
+}
+
+
+/* Parse the command-line arguments passed to the program. */
+void parse_args(int argc, char **argv) {
+    int c, i;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"seed",       required_argument, 0, 's'},
+            {"ops",        required_argument, 0, 'n'},
+            {"touches",    required_argument, 0, 't'},
+            {"tick_every", required_argument, 0, 'T'},
+            {0, 0, 0, 0}
+        };
+
+        /* getopt_long stores the option index here. */
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "s:n:t:T:", long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 's':
+            seed = atol(optarg);
+            printf("Setting seed to %ld\n", seed);
+            break;
+
+        case 'n':
+            num_ops = atol(optarg);
+            if (num_ops <= 0)
+                usage(argv[0]);
+            break;
+
+        case 't':
+            touches = atoi(optarg);
+            if (touches < 0)
+                usage(argv[0]);
+            break;
+
+        case 'T':
+            tick_every = atoi(optarg);
+            if (tick_every <= 0)
+                usage(argv[0]);
+            break;
+
+        case '?':
+            /* getopt_long already printed an error message. */
+            usage(argv[0]);
+            /* usage() will exit the program. */
+            break;
+
+        default:
+            abort();
+        }
+    }
+
+    if (optind == argc) {
+        for (c = DEFAULT_MIN_RESIDENT; c <= DEFAULT_MAX_RESIDENT; c *= 2)
+            num_sizes++;
+    }
+    else {
+        num_sizes = argc - optind;
+    }
+
+    sizes = malloc(num_sizes * sizeof(int));
+    if (sizes == NULL) {
+        perror("malloc");
+        abort();
+    }
+
+    if (optind == argc) {
+        for (i = 0, c = DEFAULT_MIN_RESIDENT; i < num_sizes; i++, c *= 2)
+            sizes[i] = c;
+    }
+    else {
+        for (i = 0; i < num_sizes; i++) {
+            sizes[i] = atoi(argv[optind + i]);
+            if (sizes[i] <= 0 || sizes[i] >= NUM_BENCH_PAGES)
+                usage(argv[0]);
+        }
+    }
+}
+
+
+/*============================================================================
+ * Page table
+ *
+ * The policies only look at and change the accessed bit and the permission
+ * of resident pages, so that is all these versions of the virtual memory
+ * system's functions keep track of.
+ */
+
+static unsigned char page_table[NUM_BENCH_PAGES];
+
+
+/* Clears the accessed bit of the specified page. */
+void clear_page_accessed(page_t page) {
+    page_table[page] &= ~PAGE_ACCESSED;
+}
+
+
+/* Returns nonzero if the specified page has been accessed. */
+int is_page_accessed(page_t page) {
+    return page_table[page] & PAGE_ACCESSED;
+}
+
+
+/* Records the permission of the specified page.  There is no mapping to
+ * change, so this costs the policy nothing.
+ */
+void set_page_permission(page_t page, int perm) {
+    page_table[page] = (page_table[page] & ~PAGEPERM_MASK) | perm;
+}
+
+
+/*============================================================================
+ * Benchmark
+ */
+
+/* Every page, with the resident ones first:  pages[0] to
+ * pages[num_resident - 1] are resident and the rest aren't.  position[p] is
+ * the index of page p in pages.
+ */
+static page_t pages[NUM_BENCH_PAGES];
+static int position[NUM_BENCH_PAGES];
+static int num_resident;
+
+/* Policy operations are timed in batches of up to BATCH, since one can take
+ * less time than reading the clock does.  clock_overhead is the cost in
+ * nanoseconds of reading the clock, which is taken off each timing.
+ */
+#define BATCH 16
+
+static double clock_overhead;
+
+
+/* Returns the monotonic clock in nanoseconds. */
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/* Measures the average cost of reading the clock twice in a row. */
+static void calibrate(void) {
+    double start, total = 0.0;
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+        start = now_ns();
+        total += now_ns() - start;
+    }
+    clock_overhead = total / i;
+}
+
+
+/* Returns the number of bytes the C library currently has allocated, or 0
+ * if it can't say.  Large blocks are mmapped rather than carved from the
+ * heap, so they are counted separately.
+ */
+static size_t heap_in_use(void) {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+
+/* Swaps the pages at indexes i and j of the pages array. */
+static void swap_pages(int i, int j) {
+    page_t tmp = pages[i];
+
+    pages[i] = pages[j];
+    pages[j] = tmp;
+    position[pages[i]] = i;
+    position[pages[j]] = j;
+}
+
+
+/* Makes n random pages that aren't resident resident, as map_page() would,
+ * and returns how long the policy took to record them.
+ */
+static double page_in(int n) {
+    page_t new_pages[BATCH];
+    double start;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        j = num_resident + splitmix64_next(&random_state) %
+            (NUM_BENCH_PAGES - num_resident);
+        new_pages[i] = pages[j];
+        swap_pages(j, num_resident);
+        num_resident++;
+
+        /* The page is mapped for the access that faulted on it. */
+        page_table[new_pages[i]] =
+            PAGE_RESIDENT | PAGE_ACCESSED | PAGEPERM_READ;
+    }
+
+    start = now_ns();
+    for (i = 0; i < n; i++)
+        policy_page_mapped(new_pages[i]);
+    return now_ns() - start - clock_overhead;
+}
+
+
+/* Asks the policy for n victims and evicts them, as make_room() would, and
+ * returns how long the policy took to choose them.
+ */
+static double evict(int n) {
+    page_t victims[BATCH];
+    double start;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < n; i++)
+        victims[i] = choose_and_evict_victim_page();
+    start = now_ns() - start - clock_overhead;
+
+    for (i = 0; i < n; i++) {
+        if (!(page_table[victims[i]] & PAGE_RESIDENT)) {
+            fprintf(stderr, "ERROR:  the policy evicted page %u, which isn't"
+                    " resident\n", victims[i]);
+            exit(1);
+        }
+
+        page_table[victims[i]] = 0;
+        num_resident--;
+        swap_pages(position[victims[i]], num_resident);
+    }
+    return start;
+}
+
+
+/* Accesses a random resident page.  An access to a page with no permission
+ * faults and makes it readable, as the SIGSEGV handler would.
+ */
+static void touch(void) {
+    page_t page = pages[splitmix64_next(&random_state) % num_resident];
+
+    if ((page_table[page] & PAGEPERM_MASK) == PAGEPERM_NONE)
+        page_table[page] = (page_table[page] & ~PAGEPERM_MASK) | PAGEPERM_READ;
+    page_table[page] |= PAGE_ACCESSED;
+}
+
+
+/* Returns the average of count operations that took total nanoseconds,
+ * which can come out just below zero once the clock's own cost is taken off.
+ */
+static double per_op(double total, long count) {
+    return (count == 0 || total < 0.0) ? 0.0 : total / count;
+}
+
+
+/* Fills a policy with max_resident pages and then runs num_ops evictions
+ * through it, printing one line of measurements.
+ */
+static void run_size(int max_resident) {
+    double fill = 0.0, mapped = 0.0, evicted = 0.0, ticks = 0.0;
+    double tick, max_tick = 0.0;
+    size_t heap_before, heap_full;
+    long done, next_tick, num_ticks = 0;
+    int i, n;
+
+    memset(page_table, 0, sizeof(page_table));
+    for (i = 0; i < NUM_BENCH_PAGES; i++) {
+        pages[i] = i;
+        position[i] = i;
+    }
+    num_resident = 0;
+
+    heap_before = heap_in_use();
+    if (!policy_init(max_resident)) {
+        fprintf(stderr, "Couldn't initialize the policy for %d pages\n",
+                max_resident);
+        exit(1);
+    }
+
+    while (num_resident < max_resident) {
+        n = max_resident - num_resident;
+        fill += page_in(n < BATCH ? n : BATCH);
+    }
+    heap_full = heap_in_use();
+
+    next_tick = tick_every;
+    for (done = 0; done < num_ops; done += n) {
+        n = (num_ops - done < BATCH) ? num_ops - done : BATCH;
+        if (n > max_resident)
+            n = max_resident;
+
+        for (i = 0; i < n * touches; i++)
+            touch();
+        evicted += evict(n);
+        mapped += page_in(n);
+
+        while (done + n >= next_tick) {
+            tick = now_ns();
+            policy_timer_tick();
+            tick = now_ns() - tick - clock_overhead;
+            ticks += tick;
+            num_ticks++;
+            if (tick > max_tick)
+                max_tick = tick;
+            next_tick += tick_every;
+        }
+    }
+
+    /* FIFO and CLOCK/LRU only free their queue nodes as pages are evicted. */
+    while (num_resident > 0)
+        evict(num_resident < BATCH ? num_resident : BATCH);
+    policy_cleanup();
+
+    printf("%8d %8.1f %8.1f %8.1f %11.0f %11.0f %8.1f\n", max_resident,
+           per_op(fill, max_resident), per_op(mapped, num_ops),
+           per_op(evicted, num_ops), per_op(ticks, num_ticks), max_tick,
+           (double) (heap_full - heap_before) / max_resident);
+}
+
+int main(int argc, char **argv) {
+    int i;
+
+    /* Parse arguments */
+    parse_args(argc, argv);
+
+    /* Configure the test. */
+
+    if (seed == 0)
+       seed = time(NULL);
+
+    printf("Options:\n");
+    printf(" * Random seed = %ld\n", seed);
+    printf(" * %ld evictions per size, %d accesses between evictions\n",
+           num_ops, touches);
+    printf(" * A timer tick every %d evictions\n", tick_every);
+    printf("\n");
+
+    srand(seed);
+    random_state = seed;
+    calibrate();
+
+    printf("Times are in ns per operation; memory is the policy's heap use"
+           " in bytes per\nresident page.\n\n");
+    printf("resident  fill-in  page-in    evict   tick mean    tick max"
+           "   memory\n");
+    for (i = 0; i < num_sizes; i++) {
+        run_size(sizes[i]);
+        fflush(stdout);
+    }
+
+    printf("\nDone!\n");
+
+    free(sizes);
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*============================================================================
+ * Implementation of the compressed sparse row (CSR) matrix type.  When a
+ * sparse matrix is allocated from the virtual memory pool, the row pointers
+ * and the entries each start on a fresh page, so a multiply that streams
+ * through them touches every page exactly once.
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sparse.h"
+#include "virtualmem.h"
+#include "vmalloc.h"
+
+
+/* Allocate a sparse matrix with room for nnz non-zeros, using malloc().  The
+ * row pointers and entries are uninitialized.
+ */
+csr_matrix_t * malloc_csr(int rows, int cols, int nnz) {
+    csr_matrix_t *a;
+
+    a = malloc(sizeof(csr_matrix_t));
+    if (a == NULL)
+        return NULL;
+
+    a->row_ptr = malloc((rows + 1) * sizeof(int));
+    a->entries = malloc(nnz * sizeof(csr_entry_t));
+    if (a->row_ptr == NULL || a->entries == NULL) {
+        free(a->row_ptr);
+        free(a->entries);
+        free(a);
+        return NULL;
+    }
+
+    a->rows = rows;
+    a->cols = cols;
+    a->nnz = nnz;
+    return a;
+}
+
+
+/* Allocate a sparse matrix with room for nnz non-zeros from the virtual
+ * memory pool.  The row pointers and entries are uninitialized, and each
+ * array is page-aligned.  Returns NULL if the pool is exhausted.
+ */
+csr_matrix_t * vmalloc_csr(int rows, int cols, int nnz) {
+    csr_matrix_t *a;
+
+    a = vmem_alloc(sizeof(csr_matrix_t));
+    if (a == NULL)
+        return NULL;
+
+    a->row_ptr = vmem_alloc_aligned((rows + 1) * sizeof(int), PAGE_SIZE);
+    if (a->row_ptr == NULL)
+        return NULL;
+
+    a->entries = vmem_alloc_aligned(nnz * sizeof(csr_entry_t), PAGE_SIZE);
+    if (a->entries == NULL)
+        return NULL;
+
+    a->rows = rows;
+    a->cols = cols;
+    a->nnz = nnz;
+    return a;
+}
+
+
+/* Generate random values for the specified matrix, where each element is
+ * non-zero with probability density.  The non-zero values are exactly those
+ * generate_matrix_values_seeded() would produce for the same seed, and the
+ * pattern of zeros depends only on the seed too.
+ */
+void generate_sparse_values(matrix_t *m, unsigned long seed, double density) {
+    uint64_t key, threshold;
+    int r, c;
+    int *row;
+
+    assert(m != NULL);
+    assert(density >= 0.0 && density <= 1.0);
+
+    generate_matrix_values_seeded(m, seed, 1);
+
+    key = splitmix64(~seed) << 20;
+    threshold = (uint64_t) (density * 4294967296.0);
+    for (r = 0; r < m->rows; r++) {
+        row = matrix_row(m, r);
+        for (c = 0; c < m->cols; c++) {
+            if ((splitmix64(key + (uint64_t) r * m->cols + c) >> 32) >=
+                threshold)
+                row[c] = 0;
+        }
+    }
+}
+
+
+/* Returns the number of non-zero elements in the dense matrix m. */
+int count_nonzeros(const matrix_t *m) {
+    int r, c, nnz = 0;
+    const int *row;
+
+    assert(m != NULL);
+
+    for (r = 0; r < m->rows; r++) {
+        row = matrix_row_const(m, r);
+        for (c = 0; c < m->cols; c++)
+            nnz += (row[c] != 0);
+    }
+    return nnz;
+}
+
+
+/* Converts the dense matrix m into a new sparse matrix, allocated from the
+ * virtual memory pool if use_vmem is nonzero, or using malloc() otherwise.
+ * The dense matrix is read twice, row by row:  once to count the non-zeros,
+ * and once to fill in the entries.  Returns NULL if allocation fails.
+ */
+csr_matrix_t * csr_from_dense(const matrix_t *m, int use_vmem) {
+    csr_matrix_t *a;
+    int r, c, n;
+    const int *row;
+
+    assert(m != NULL);
+
+    n = count_nonzeros(m);
+    a = use_vmem ? vmalloc_csr(m->rows, m->cols, n) :
+                   malloc_csr(m->rows, m->cols, n);
+    if (a == NULL)
+        return NULL;
+
+    n = 0;
+    for (r = 0; r < m->rows; r++) {
+        a->row_ptr[r] = n;
+        row = matrix_row_const(m, r);
+        for (c = 0; c < m->cols; c++) {
+            if (row[c] != 0) {
+                a->entries[n].col = c;
+                a->entries[n].val = row[c];
+                n++;
+            }
+        }
+    }
+    a->row_ptr[m->rows] = n;
+    assert(n == a->nnz);
+
+    return a;
+}
+
+
+/* Expands the sparse matrix a into the dense matrix m, which must have the
+ * same dimensions.
+ */
+void csr_to_dense(const csr_matrix_t *a, matrix_t *m) {
+    int r, c, k;
+    int *row;
+
+    assert(a != NULL);
+    assert(m != NULL);
+    assert(a->rows == m->rows && a->cols == m->cols);
+
+    for (r = 0; r < a->rows; r++) {
+        row = matrix_row(m, r);
+        for (c = 0; c < m->cols; c++)
+            row[c] = 0;
+        for (k = a->row_ptr[r]; k < a->row_ptr[r + 1]; k++)
+            row[a->entries[k].col] = a->entries[k].val;
+    }
+}
+
+
+/* Returns the transpose of the sparse matrix a as a new sparse matrix (which
+ * is also a in CSC form), allocated from the virtual memory pool if use_vmem
+ * is nonzero, or using malloc() otherwise.  This is a counting sort on the
+ * column index:  a is read twice in order, and the result written once.
+ * Returns NULL if allocation fails.
+ */
+csr_matrix_t * csr_transpose(const csr_matrix_t *a, int use_vmem) {
+    csr_matrix_t *t;
+    int r, k, c, dst;
+
+    assert(a != NULL);
+
+    t = use_vmem ? vmalloc_csr(a->cols, a->rows, a->nnz) :
+                   malloc_csr(a->cols, a->rows, a->nnz);
+    if (t == NULL)
+        return NULL;
+
+    /* Count the entries in each column, then turn the counts into starting
+     * positions.
+     */
+    for (c = 0; c <= a->cols; c++)
+        t->row_ptr[c] = 0;
+    for (k = 0; k < a->nnz; k++)
+        t->row_ptr[a->entries[k].col + 1]++;
+    for (c = 0; c < a->cols; c++)
+        t->row_ptr[c + 1] += t->row_ptr[c];
+
+    /* Scatter the entries.  Rows are visited in order, so each column of the
+     * result comes out sorted.  row_ptr[c] is used as the insertion point for
+     * column c, which leaves it holding the start of column c + 1.
+     */
+    for (r = 0; r < a->rows; r++) {
+        for (k = a->row_ptr[r]; k < a->row_ptr[r + 1]; k++) {
+            c = a->entries[k].col;
+            dst = t->row_ptr[c]++;
+            t->entries[dst].col = r;
+            t->entries[dst].val = a->entries[k].val;
+        }
+    }
+
+    /* Shift the insertion points back down to the column starts. */
+    for (c = a->cols; c > 0; c--)
+        t->row_ptr[c] = t->row_ptr[c - 1];
+    t->row_ptr[0] = 0;
+
+    return t;
+}
+
+
+/* Computes y = a * x, where x has a->cols elements and y has a->rows
+ * elements.  The row pointers and entries of a are each read once, in order.
+ */
+void csr_spmv(const csr_matrix_t *a, const int *x, int *y) {
+    int r, k, val;
+    const csr_entry_t *e;
+
+    assert(a != NULL);
+    assert(x != NULL);
+    assert(y != NULL);
+
+    e = a->entries;
+    for (r = 0; r < a->rows; r++) {
+        val = 0;
+        for (k = a->row_ptr[r]; k < a->row_ptr[r + 1]; k++)
+            val += e[k].val * x[e[k].col];
+        y[r] = val;
+    }
+}
+
+
+/* Computes result = a * b, where b and result are dense.  Each row of the
+ * result is built up from the rows of b selected by the non-zeros in the
+ * matching row of a, so a is streamed once, result is written once in order,
+ * and only the rows of b that are actually needed are touched.
+ */
+void csr_spmm(const csr_matrix_t *a, const matrix_t *b, matrix_t *result) {
+    int r, c, k, val;
+    const int *rowb;
+    int *rowr;
+
+    assert(a != NULL);
+    assert(b != NULL);
+    assert(result != NULL);
+    assert(a->cols == b->rows);
+    assert(a->rows == result->rows);
+    assert(b->cols == result->cols);
+
+    for (r = 0; r < a->rows; r++) {
+        rowr = matrix_row(result, r);
+        for (c = 0; c < result->cols; c++)
+            rowr[c] = 0;
+
+        for (k = a->row_ptr[r]; k < a->row_ptr[r + 1]; k++) {
+            val = a->entries[k].val;
+            rowb = matrix_row_const(b, a->entries[k].col);
+            for (c = 0; c < result->cols; c++)
+                rowr[c] += val * rowb[c];
+        }
+    }
+}
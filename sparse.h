@@ -0,0 +1,50 @@
+/*============================================================================
+ * Declarations of a compressed sparse row (CSR) matrix type, with conversion
+ * to and from the dense matrix_t type, and sparse matrix-vector and
+ * matrix-matrix multiplies.  Like matrix_t, sparse matrices can be allocated
+ * either from the virtual memory pool or using malloc().
+ */
+
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "matrix.h"
+
+
+/* One stored non-zero:  its column and its value.  Keeping the two together
+ * means a multiply streams through a single array, instead of two arrays
+ * that each fault separately.
+ */
+typedef struct csr_entry_t {
+    int col;
+    int val;
+} csr_entry_t;
+
+
+/* A sparse matrix in CSR form.  The non-zeros of row r are
+ * entries[row_ptr[r]] up to (but not including) entries[row_ptr[r + 1]],
+ * sorted by column.  The CSC form of a matrix is the CSR form of its
+ * transpose; see csr_transpose().
+ */
+typedef struct csr_matrix_t {
+    int rows;
+    int cols;
+    int nnz;
+    int *row_ptr;
+    csr_entry_t *entries;
+} csr_matrix_t;
+
+
+csr_matrix_t * malloc_csr(int rows, int cols, int nnz);
+csr_matrix_t * vmalloc_csr(int rows, int cols, int nnz);
+void generate_sparse_values(matrix_t *m, unsigned long seed, double density);
+int count_nonzeros(const matrix_t *m);
+csr_matrix_t * csr_from_dense(const matrix_t *m, int use_vmem);
+void csr_to_dense(const csr_matrix_t *a, matrix_t *m);
+csr_matrix_t * csr_transpose(const csr_matrix_t *a, int use_vmem);
+void csr_spmv(const csr_matrix_t *a, const int *x, int *y);
+void csr_spmm(const csr_matrix_t *a, const matrix_t *b, matrix_t *result);
+
+
+#endif /* SPARSE_H */
@@ -0,0 +1,38 @@
+/*============================================================================
+ * The SplitMix64 generator, shared by the matrix generators, the workloads
+ * and the benchmarks so that none of them needs its own copy.  It keeps no
+ * state of its own:  callers either hash a counter with splitmix64(), or keep
+ * a state of their own and step it with splitmix64_next().  Either way the
+ * numbers drawn don't depend on anything else that draws random numbers, such
+ * as the random paging policy's rand().
+ */
+
+
+#ifndef SPLITMIX_H
+#define SPLITMIX_H
+
+#include <stdint.h>
+
+
+/* The SplitMix64 output function.  Applied to a counter, it gives a stream of
+ * well-mixed 64-bit values where any element can be computed on its own.
+ * The matrix generators use it keyed by seed and element index.
+ */
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+
+/* Returns the next number from a SplitMix64 generator, advancing its state. */
+static inline uint64_t splitmix64_next(uint64_t *state) {
+    uint64_t x = *state;
+
+    *state += 0x9e3779b97f4a7c15ull;
+    return splitmix64(x);
+}
+
+
+#endif /* SPLITMIX_H */
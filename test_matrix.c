@@ -5,6 +5,7 @@
  */
 
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +15,11 @@
 #include "virtualmem.h"
 #include "vmalloc.h"
 #include "matrix.h"
+#include "matrix_typed.h"
+#include "matrix_expr.h"
+#include "matrix_factor.h"
+#include "matrix_io.h"
+#include "sparse.h"
 
 #define DEFAULT_MAX_RESIDENT 64
 
@@ -21,24 +27,142 @@
 static long seed = 0;
 static unsigned int max_resident = DEFAULT_MAX_RESIDENT;
 static int size;
+static int layout = -1;   /* -1 = packed vmalloc_matrix(), else flags. */
+
+/* Faults per paging policy timer tick, or 0 to tick every 10ms. */
+static unsigned int vtick = 0;
+
+/* Which multiply kernel to run on the virtual-memory matrices. */
+typedef enum {
+    ALG_NAIVE, ALG_TILED, ALG_STRASSEN, ALG_SPMM, ALG_FUSED, ALG_TRANSPOSED,
+    ALG_ROWWISE, ALG_SPMV
+} algorithm_t;
+static const char *algorithm_names[] = {
+    "naive", "tiled", "strassen", "spmm", "fused", "transposed", "rowwise",
+    "spmv", NULL
+};
+
+/* The expression computed by the "fused" algorithm:
+ * result = clamp(FUSED_SCALE * (m1 * m2) + m2, -FUSED_LIMIT, FUSED_LIMIT).
+ */
+#define FUSED_SCALE 3
+#define FUSED_LIMIT 100000000
+static algorithm_t algorithm = ALG_NAIVE;
+static int tuning = 0;    /* Tile size or Strassen cutoff; 0 = default. */
+
+/* How to check the result matrix:  against a reference multiply, or with
+ * Freivalds' algorithm using the given number of rounds.
+ */
+static int freivalds = 0;
+static int rounds = MATRIX_DEFAULT_FREIVALDS_ROUNDS;
+
+/* Number of threads used to generate the reference matrices. */
+static int nthreads = 1;
+
+/* Element type of the test matrices:  "int" for matrix_t, or one of the
+ * suffixes in MATRIX_TYPE_LIST.
+ */
+static const char *elem_type = "int";
+
+/* Fraction of the input elements that are non-zero. */
+static double density = 1.0;
+
+/* The number of matrices multiplied by the "chain" workload. */
+#define CHAIN_LENGTH 3
+
+/* Which workload to run:  the matrix multiply, one of the factorizations
+ * (with its blocked variant and block size; 0 derives it from the budget),
+ * or a planned chain of multiplies.
+ */
+typedef enum { WORK_MATMUL, WORK_LU, WORK_CHOLESKY, WORK_CHAIN } workload_t;
+static const char *workload_names[] = {
+    "matmul", "lu", "cholesky", "chain", NULL
+};
+static workload_t workload = WORK_MATMUL;
+static factor_variant_t variant = FACTOR_RIGHT_LOOKING;
+static int block = 0;
+
+/* Files to save the generated input matrices to, or to load them from
+ * instead of generating them.  Each is a prefix; m1 and m2 use the suffixes
+ * ".m1" and ".m2".
+ */
+static const char *save_prefix = NULL;
+static const char *load_prefix = NULL;
+static int save_tiled = 0;
 
 
 /* Prints the test program's usage, and then exit the program. */
 void usage(const char *prog) {
-    printf("usage: %s [--seed num] [--max_resident num] size\n", prog);
+    printf("usage: %s [--seed num] [--max_resident num] [--align kind]\n"
+           "\t[--header_page] [--algorithm alg] [--cutoff num]\n"
+           "\t[--verify kind] [--rounds num] [--threads num] [--type t]\n"
+           "\t[--density p] [--workload w] [--variant v] [--block num]\n"
+           "\t[--save prefix] [--save_tiled] [--load prefix] [--vtick num]\n"
+           "\tsize\n", prog);
     printf("\tRuns the test program, generating two square matrices with size\n");
     printf("\trows and columns, and then multiplying them into a third matrix.\n\n");
     printf("\t--seed | -s num optionally specifies the seed for the random\n");
     printf("\tnumber generator.  The system time is used otherwise.\n\n");
     printf("\t--max_resident | -m num specifies the maximum number of pages\n");
-    printf("\tthat may be resident in the virtual memory system.\n");
+    printf("\tthat may be resident in the virtual memory system.\n\n");
+    printf("\t--vtick | -K num ticks the paging policy's timer every num\n");
+    printf("\tfaults instead of every 10ms, so that runs with the same\n");
+    printf("\tseed make the same page loads on any machine.\n\n");
+    printf("\t--align | -a kind pads the rows of the vmem matrices; kind\n");
+    printf("\tis one of \"none\", \"cacheline\" or \"page\".\n\n");
+    printf("\t--header_page | -H puts each matrix header on its own page.\n\n");
+    printf("\t--algorithm | -A alg selects the multiply; alg is one of\n");
+    printf("\t\"naive\" (the default), \"tiled\", \"strassen\", \"spmm\",\n");
+    printf("\t\"fused\", \"transposed\", \"rowwise\" or \"spmv\".\n");
+    printf("\t\"spmm\" stores m1 in the virtual memory pool in sparse CSR\n");
+    printf("\tform rather than as a dense matrix.  \"fused\" computes\n");
+    printf("\tclamp(3 * m1 * m2 + m2) with the elementwise steps fused\n");
+    printf("\tinto the multiply, and always uses the full verification.\n");
+    printf("\t\"transposed\" transposes m2 in place, multiplies using the\n");
+    printf("\ttranspose, and then transposes m2 back; it also checks an\n");
+    printf("\tout-of-place transpose of the left half of m1.  \"rowwise\"\n");
+    printf("\tloops in r, i, c order, adding scaled rows of m2 into each\n");
+    printf("\tresult row, where \"naive\" walks down a column of m2 for\n");
+    printf("\teach result element.  \"spmv\" stores m1 like \"spmm\", but\n");
+    printf("\tmultiplies it by one column of m2 at a time, so each result\n");
+    printf("\tcolumn is checked against a dense matrix-vector product.\n");
+    printf("\tBoth sparse algorithms also check that transposing m1 to\n");
+    printf("\tCSC form and back gives m1 again.\n\n");
+    printf("\t--cutoff | -c num sets the tile size for \"tiled\", or the\n");
+    printf("\tsize at which \"strassen\" switches to the tiled kernel.\n\n");
+    printf("\t--verify | -v kind is \"full\" (the default) to compare the\n");
+    printf("\tresult against a reference multiply, or \"freivalds\" for a\n");
+    printf("\tprobabilistic O(n^2) check.\n\n");
+    printf("\t--rounds | -k num sets the number of Freivalds rounds.\n\n");
+    printf("\t--threads | -t num generates the reference matrices with up\n");
+    printf("\tto num threads; the values don't depend on the count.\n\n");
+    printf("\t--type | -T t sets the element type; t is \"int\" (the\n");
+    printf("\tdefault), \"i64\", \"f32\" or \"f64\".  The typed matrices\n");
+    printf("\talways use the tiled multiply.\n\n");
+    printf("\t--density | -d p makes each input element non-zero with\n");
+    printf("\tprobability p (default 1).\n\n");
+    printf("\t--workload | -w w is \"matmul\" (the default), or \"lu\" or\n");
+    printf("\t\"cholesky\" to factor a double matrix in virtual memory,\n");
+    printf("\tor \"chain\" to multiply a size x size/8, a size/8 x size and\n");
+    printf("\ta size x size/8 matrix in the order the planner picks.\n\n");
+    printf("\t--variant | -V v is \"right\" (the default) or \"left\",\n");
+    printf("\tfor right- or left-looking blocked factorization.\n\n");
+    printf("\t--block | -b num sets the factorization block size; by\n");
+    printf("\tdefault it is derived from --max_resident.\n\n");
+    printf("\t--save | -S prefix writes the generated inputs to the files\n");
+    printf("\tprefix.m1 and prefix.m2; --save_tiled | -D writes them in\n");
+    printf("\tpage-sized tiles.\n\n");
+    printf("\t--load | -L prefix maps previously saved inputs into virtual\n");
+    printf("\tmemory instead of generating them.  Use the same seed that\n");
+    printf("\tthey were saved with, since the copies used for checking are\n");
+    printf("\tstill generated.\n");
     exit(1);
 }
 
 
 /* Parse the command-line arguments passed to the program. */
 void parse_args(int argc, char **argv) {
-    int c;
+    int c, i;
 
     while (1) {
         static struct option long_options[] = {
@@ -49,13 +173,30 @@ void parse_args(int argc, char **argv) {
              * We distinguish them by their indices. */
             {"seed",         required_argument, 0, 's'},
             {"max_resident", required_argument, 0, 'm'},
+            {"vtick",        required_argument, 0, 'K'},
+            {"align",        required_argument, 0, 'a'},
+            {"header_page",  no_argument,       0, 'H'},
+            {"algorithm",    required_argument, 0, 'A'},
+            {"cutoff",       required_argument, 0, 'c'},
+            {"verify",       required_argument, 0, 'v'},
+            {"rounds",       required_argument, 0, 'k'},
+            {"threads",      required_argument, 0, 't'},
+            {"type",         required_argument, 0, 'T'},
+            {"density",      required_argument, 0, 'd'},
+            {"workload",     required_argument, 0, 'w'},
+            {"variant",      required_argument, 0, 'V'},
+            {"block",        required_argument, 0, 'b'},
+            {"save",         required_argument, 0, 'S'},
+            {"save_tiled",   no_argument,       0, 'D'},
+            {"load",         required_argument, 0, 'L'},
             {0, 0, 0, 0}
         };
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "s:m:", long_options, &option_index);
+        c = getopt_long(argc, argv, "s:m:K:a:HA:c:v:k:t:T:d:w:V:b:S:DL:",
+                        long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -83,6 +224,107 @@ void parse_args(int argc, char **argv) {
             printf("Max resident pages = %d\n", max_resident);
             break;
 
+        case 'K':
+            vtick = atoi(optarg);
+            break;
+
+        case 'a':
+            if (layout < 0)
+                layout = 0;
+            layout &= ~(MATRIX_ALIGN_CACHELINE | MATRIX_ALIGN_PAGE);
+            if (strcmp(optarg, "cacheline") == 0)
+                layout |= MATRIX_ALIGN_CACHELINE;
+            else if (strcmp(optarg, "page") == 0)
+                layout |= MATRIX_ALIGN_PAGE;
+            else if (strcmp(optarg, "none") != 0)
+                usage(argv[0]);
+            break;
+
+        case 'H':
+            if (layout < 0)
+                layout = 0;
+            layout |= MATRIX_HEADER_OWN_PAGE;
+            break;
+
+        case 'A':
+            for (i = 0; algorithm_names[i] != NULL; i++) {
+                if (strcmp(optarg, algorithm_names[i]) == 0)
+                    break;
+            }
+            if (algorithm_names[i] == NULL)
+                usage(argv[0]);
+            algorithm = (algorithm_t) i;
+            break;
+
+        case 'c':
+            tuning = atoi(optarg);
+            break;
+
+        case 'v':
+            if (strcmp(optarg, "full") == 0)
+                freivalds = 0;
+            else if (strcmp(optarg, "freivalds") == 0)
+                freivalds = 1;
+            else
+                usage(argv[0]);
+            break;
+
+        case 'k':
+            rounds = atoi(optarg);
+            break;
+
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+
+        case 'T':
+            if (strcmp(optarg, "int") != 0 && strcmp(optarg, "i64") != 0 &&
+                strcmp(optarg, "f32") != 0 && strcmp(optarg, "f64") != 0)
+                usage(argv[0]);
+            elem_type = optarg;
+            break;
+
+        case 'd':
+            density = atof(optarg);
+            if (density < 0.0 || density > 1.0)
+                usage(argv[0]);
+            break;
+
+        case 'w':
+            for (i = 0; workload_names[i] != NULL; i++) {
+                if (strcmp(optarg, workload_names[i]) == 0)
+                    break;
+            }
+            if (workload_names[i] == NULL)
+                usage(argv[0]);
+            workload = (workload_t) i;
+            break;
+
+        case 'V':
+            if (strcmp(optarg, "right") == 0)
+                variant = FACTOR_RIGHT_LOOKING;
+            else if (strcmp(optarg, "left") == 0)
+                variant = FACTOR_LEFT_LOOKING;
+            else
+                usage(argv[0]);
+            break;
+
+        case 'b':
+            block = atoi(optarg);
+            break;
+
+        case 'S':
+            save_prefix = optarg;
+            break;
+
+        case 'D':
+            save_tiled = 1;
+            break;
+
+        case 'L':
+            load_prefix = optarg;
+            break;
+
         case '?':
             /* getopt_long already printed an error message. */
             usage(argv[0]);
@@ -101,9 +343,410 @@ void parse_args(int argc, char **argv) {
 }
 
 
+/* Allocate a matrix from the virtual memory pool, using the row layout chosen
+ * on the command line.
+ */
+matrix_t * alloc_test_matrix(int rows, int cols) {
+    matrix_t *m;
+
+    if (layout < 0)
+        m = vmalloc_matrix(rows, cols);
+    else
+        m = vmalloc_matrix_aligned(rows, cols, layout);
+
+    if (m == NULL) {
+        fprintf(stderr, "Couldn't allocate %d x %d matrix\n", rows, cols);
+        exit(1);
+    }
+    return m;
+}
+
+
+/* Prints the virtual memory system's statistics for a phase of the test,
+ * and starts counting them from zero for the next phase.
+ */
+static void report_phase(const char *phase) {
+    vmem_stats_t st;
+
+    vmem_get_stats(&st);
+    vmem_reset_stats();
+
+    printf("Paging during %s:\n", phase);
+    printf(" * Faults:  %" PRIu64 " unmapped, %" PRIu64 " first reads, %"
+           PRIu64 " first writes\n", st.maperr_faults, st.read_faults,
+           st.write_faults);
+    printf(" * Page loads:  %" PRIu64 " (%" PRIu64 " bytes read)\n",
+           st.loads, st.bytes_read);
+    printf(" * Evictions:  %" PRIu64 " (%" PRIu64 " clean, %" PRIu64
+           " dirty)\n", st.evictions, st.clean_evictions, st.dirty_evictions);
+    printf(" * Writebacks:  %" PRIu64 " (%" PRIu64 " bytes written)\n",
+           st.writebacks, st.bytes_written);
+    if (st.policy_ns != 0) {
+        printf(" * Policy:  %" PRIu64 " timer ticks, %.3f ms\n",
+               st.timer_ticks, st.policy_ns / 1e6);
+    }
+    else {
+        printf(" * Policy:  %" PRIu64 " timer ticks\n", st.timer_ticks);
+    }
+    printf(" * Readahead:  %" PRIu64 " pages prefetched, %" PRIu64
+           " seen in use\n\n", st.readahead_pages, st.readahead_hits);
+}
+
+
+/* Reports whether a verified matrix came out correct. */
+static void report(const char *name, int correct) {
+    if (correct)
+        printf(" * %s is correct\n", name);
+    else
+        printf(" * ERROR:  %s doesn't contain correct values!\n", name);
+}
+
+
+/* The test for each typed matrix:  the same steps as main() below, using the
+ * typed allocation, generation and (tiled) multiply functions.
+ */
+#define DEFINE_TYPED_TEST(sfx, T)                                           \
+static void run_typed_test_##sfx(void) {                                    \
+    matrix_##sfx##_t *m1, *m2, *result, *m1v, *m2v, *resultv;               \
+    int flags = layout < 0 ? MATRIX_ALIGN_NONE : layout;                    \
+                                                                            \
+    printf("Generating two " #T " matrices\n\n");                           \
+                                                                            \
+    m1v = malloc_matrix_##sfx(size, size);                                  \
+    m2v = malloc_matrix_##sfx(size, size);                                  \
+    resultv = malloc_matrix_##sfx(size, size);                              \
+    m1 = vmalloc_matrix_aligned_##sfx(size, size, flags);                   \
+    m2 = vmalloc_matrix_aligned_##sfx(size, size, flags);                   \
+    result = vmalloc_matrix_aligned_##sfx(size, size, flags);               \
+    if (!m1v || !m2v || !resultv || !m1 || !m2 || !result) {                \
+        fprintf(stderr, "Couldn't allocate the test matrices\n");           \
+        exit(1);                                                            \
+    }                                                                       \
+                                                                            \
+    generate_matrix_values_##sfx(m1v, seed);                                \
+    generate_matrix_values_##sfx(m2v, seed + 1);                            \
+    report_phase("generate");                                               \
+                                                                            \
+    copy_matrix_##sfx(m1v, m1);                                             \
+    copy_matrix_##sfx(m2v, m2);                                             \
+    report_phase("copy");                                                   \
+                                                                            \
+    printf("Multiplying the matrices together\n\n");                       \
+    multiply_matrices_##sfx(m1, m2, result, tuning);                        \
+    multiply_matrices_##sfx(m1v, m2v, resultv, tuning);                     \
+    report_phase("multiply");                                               \
+                                                                            \
+    printf("Verifying source and result matrix contents\n");               \
+    report("Matrix m1", compare_matrices_##sfx(m1, m1v));                   \
+    report("Matrix m2", compare_matrices_##sfx(m2, m2v));                   \
+    report("Result matrix", compare_matrices_##sfx(result, resultv));       \
+    printf("\n");                                                           \
+    report_phase("verify");                                                 \
+}
+
+MATRIX_TYPE_LIST(DEFINE_TYPED_TEST)
+
+
+/* Fill a test matrix with values for the given seed, honoring --density. */
+static void generate_test_values(matrix_t *m, unsigned long s, int threads) {
+    if (density < 1.0)
+        generate_sparse_values(m, s, density);
+    else
+        generate_matrix_values_seeded(m, s, threads);
+}
+
+
+/* Applies the elementwise steps of the "fused" algorithm to the reference
+ * product, one at a time.
+ */
+static void fused_reference(matrix_t *product, const matrix_t *addend) {
+    int r, c, x;
+
+    for (r = 0; r < product->rows; r++) {
+        for (c = 0; c < product->cols; c++) {
+            x = get_elem(product, r, c) * FUSED_SCALE + get_elem(addend, r, c);
+            if (x < -FUSED_LIMIT)
+                x = -FUSED_LIMIT;
+            if (x > FUSED_LIMIT)
+                x = FUSED_LIMIT;
+            set_elem(product, r, c, x);
+        }
+    }
+}
+
+
+/* The "spmv" algorithm:  multiplies the sparse matrix a by b one column at a
+ * time.  Each column of b is gathered into a vector, multiplied by a with
+ * csr_spmv(), and the product scattered into the matching result column, so
+ * a is streamed once per column.
+ */
+static void multiply_spmv(const csr_matrix_t *a, const matrix_t *b,
+                          matrix_t *result) {
+    matrix_col_t col;
+    int *x, *y;
+    int r, c;
+
+    x = malloc(b->rows * sizeof(int));
+    y = malloc(result->rows * sizeof(int));
+    if (x == NULL || y == NULL) {
+        fprintf(stderr, "Couldn't allocate the spmv vectors\n");
+        exit(1);
+    }
+
+    for (c = 0; c < result->cols; c++) {
+        printf(".");
+        fflush(stdout);
+        col = matrix_col(b, c);
+        for (r = 0; r < b->rows; r++)
+            x[r] = matrix_col_elem(col, r);
+        csr_spmv(a, x, y);
+        for (r = 0; r < result->rows; r++)
+            matrix_row(result, r)[c] = y[r];
+    }
+    printf("\n");
+
+    free(x);
+    free(y);
+}
+
+
+/* Checks that transposing the sparse matrix a into CSC form in the virtual
+ * memory pool, and then transposing that back, gives the dense matrix
+ * expected.  scratch must have the same dimensions, and is overwritten.
+ */
+static int check_csc_round_trip(const csr_matrix_t *a,
+                                const matrix_t *expected, matrix_t *scratch) {
+    csr_matrix_t *csc, *back;
+
+    csc = csr_transpose(a, 1);
+    back = (csc != NULL) ? csr_transpose(csc, 0) : NULL;
+    if (back == NULL) {
+        fprintf(stderr, "Couldn't allocate the CSC form of m1\n");
+        exit(1);
+    }
+
+    csr_to_dense(back, scratch);
+    return compare_matrices(scratch, expected);
+}
+
+
+/* Checks transpose_matrix() against a naive transpose.  A view of the first
+ * size/2 + 1 columns of m, which isn't square, so that the recursion halves
+ * both ways, is transposed into a new matrix in the pool, and compared
+ * element by element with the malloc()'d copy expected.
+ */
+static int check_transpose(matrix_t *m, const matrix_t *expected) {
+    matrix_t view, *t;
+    int r, c;
+
+    matrix_view(m, 0, 0, m->rows, m->cols / 2 + 1, &view);
+    t = alloc_test_matrix(view.cols, view.rows);
+    transpose_matrix(&view, t);
+
+    for (r = 0; r < t->rows; r++) {
+        for (c = 0; c < t->cols; c++) {
+            if (get_elem(t, r, c) != get_elem(expected, c, r))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* Fill a test matrix in the virtual memory pool:  either load it from the
+ * file named by --load and suffix, or copy it from the trusted malloc()'d
+ * matrix src.  If --save was given, the matrix is then written out under the
+ * same suffix.
+ */
+static matrix_t * make_input_matrix(const char *suffix, const matrix_t *src) {
+    char path[4096];
+    matrix_t *m;
+    int flags;
+
+    if (load_prefix != NULL) {
+        snprintf(path, sizeof(path), "%s.%s", load_prefix, suffix);
+        m = load_matrix(path, 1);
+        if (m == NULL)
+            exit(1);
+        if (m->rows != size || m->cols != size) {
+            fprintf(stderr, "%s is %d x %d, not %d x %d\n", path, m->rows,
+                    m->cols, size, size);
+            exit(1);
+        }
+    }
+    else {
+        m = alloc_test_matrix(size, size);
+        copy_matrix(src, m);
+    }
+
+    if (save_prefix != NULL) {
+        snprintf(path, sizeof(path), "%s.%s", save_prefix, suffix);
+        flags = layout < 0 ? MATRIX_ALIGN_NONE : layout;
+        if (save_tiled)
+            flags |= MATRIX_FILE_TILED;
+        if (!save_matrix(m, path, flags))
+            exit(1);
+    }
+    return m;
+}
+
+
+/* Prints the multiplication order that split gives for the product of
+ * matrices i..j of a chain of n, naming them m1, m2, and so on.
+ */
+static void print_chain_order(const int *split, int n, int i, int j) {
+    int k;
+
+    if (i == j) {
+        printf("m%d", i + 1);
+        return;
+    }
+
+    k = split[i * n + j];
+    printf("(");
+    print_chain_order(split, n, i, k);
+    printf(" * ");
+    print_chain_order(split, n, k + 1, j);
+    printf(")");
+}
+
+
+/* The chain test:  multiply a chain of differently shaped matrices in
+ * virtual memory with multiply_matrix_chain(), reporting the order that
+ * matrix_chain_order() chose for it, and check the product against the
+ * malloc()'d copies multiplied left to right.
+ */
+static void run_chain_test(void) {
+    matrix_t *mats[CHAIN_LENGTH], *matsv[CHAIN_LENGTH], *result, *resultv, *t;
+    int dims[CHAIN_LENGTH + 1], split[CHAIN_LENGTH * CHAIN_LENGTH];
+    unsigned long loads;
+    int i, k;
+
+    /* A narrow inner dimension makes the order matter:  one order builds a
+     * size x size intermediate, and the other only a size/8 x size/8 one.
+     */
+    k = (size >= 8) ? size / 8 : 1;
+    dims[0] = size;
+    dims[1] = k;
+    dims[2] = size;
+    dims[3] = k;
+
+    printf("Generating a chain of %d matrices:", CHAIN_LENGTH);
+    for (i = 0; i < CHAIN_LENGTH; i++)
+        printf("%s %d x %d", i > 0 ? "," : "", dims[i], dims[i + 1]);
+    printf("\n\n");
+
+    for (i = 0; i < CHAIN_LENGTH; i++) {
+        matsv[i] = malloc_matrix(dims[i], dims[i + 1]);
+        generate_test_values(matsv[i], seed + i, nthreads);
+    }
+    resultv = malloc_matrix(dims[0], dims[CHAIN_LENGTH]);
+    report_phase("generate");
+
+    for (i = 0; i < CHAIN_LENGTH; i++) {
+        mats[i] = alloc_test_matrix(dims[i], dims[i + 1]);
+        copy_matrix(matsv[i], mats[i]);
+    }
+    result = alloc_test_matrix(dims[0], dims[CHAIN_LENGTH]);
+    report_phase("copy");
+
+    loads = matrix_chain_order(dims, CHAIN_LENGTH, split);
+    printf("Multiplying the chain as ");
+    print_chain_order(split, CHAIN_LENGTH, 0, CHAIN_LENGTH - 1);
+    printf(" (about %lu page loads estimated)\n\n", loads);
+
+    if (!multiply_matrix_chain(mats, CHAIN_LENGTH, result)) {
+        fprintf(stderr, "Couldn't allocate the intermediate products\n");
+        exit(1);
+    }
+
+    /* The reference goes left to right, whatever the plan was. */
+    t = malloc_matrix(dims[0], dims[2]);
+    multiply_matrices(matsv[0], matsv[1], t);
+    multiply_matrices(t, matsv[2], resultv);
+    report_phase("multiply");
+
+    printf("Verifying the result matrix\n");
+    if (compare_matrices(result, resultv))
+        printf(" * Result matrix is correct\n");
+    else
+        printf(" * ERROR:  Result matrix doesn't contain correct values!\n");
+    printf("\n");
+    report_phase("verify");
+}
+
+
+/* The factorization test:  generate a double matrix (symmetric positive
+ * definite for Cholesky), factor a copy of it in virtual memory, and check
+ * the factors against the malloc()'d original.
+ */
+static void run_factor_test(void) {
+    matrix_f64_t *a, *av, *f;
+    int *piv = NULL;
+    int nb, ok;
+    double resid;
+
+    nb = block > 0 ? block : factor_block_size(size);
+    printf("Generating a %d x %d double matrix\n\n", size, size);
+
+    av = malloc_matrix_f64(size, size);
+    f = malloc_matrix_f64(size, size);
+    a = vmalloc_matrix_aligned_f64(size, size,
+                                   layout < 0 ? MATRIX_ALIGN_NONE : layout);
+    if (!av || !f || !a) {
+        fprintf(stderr, "Couldn't allocate the test matrices\n");
+        exit(1);
+    }
+
+    if (workload == WORK_CHOLESKY)
+        generate_spd_matrix_f64(av, seed);
+    else
+        generate_matrix_values_f64(av, seed);
+    report_phase("generate");
+
+    copy_matrix_f64(av, a);
+    report_phase("copy");
+
+    printf("Factoring the matrix (%s-looking %s, block size %d)\n\n",
+           variant == FACTOR_LEFT_LOOKING ? "left" : "right",
+           workload == WORK_CHOLESKY ? "Cholesky" : "LU", nb);
+
+    if (workload == WORK_CHOLESKY) {
+        ok = cholesky_factor(a, nb, variant);
+    }
+    else {
+        piv = malloc(size * sizeof(int));
+        ok = lu_factor(a, piv, nb, variant);
+    }
+    report_phase("factor");
+
+    printf("Verifying the factors\n");
+    if (!ok) {
+        printf(" * ERROR:  The factorization failed!\n");
+        return;
+    }
+
+    copy_matrix_f64(a, f);
+    if (workload == WORK_CHOLESKY)
+        resid = cholesky_residual(av, f);
+    else
+        resid = lu_residual(av, f, piv);
+
+    if (resid < 1e-10)
+        printf(" * Factors are correct (relative residual %.2e)\n", resid);
+    else
+        printf(" * ERROR:  Factors are wrong (relative residual %.2e)!\n",
+               resid);
+    printf("\n");
+    report_phase("verify");
+    free(piv);
+}
+
+
 int main(int argc, char **argv) {
     matrix_t *m1, *m2, *result;     /* Allocated from virtual memory pool */
     matrix_t *m1v, *m2v, *resultv;  /* Allocated with malloc(), to verify */
+    csr_matrix_t *m1s = NULL;       /* Sparse m1, for "spmm" and "spmv" */
 
     /* Parse arguments */
     parse_args(argc, argv);
@@ -113,68 +756,203 @@ int main(int argc, char **argv) {
     if (seed == 0)
        seed = time(NULL);
 
+    /* Freivalds' check only covers a plain product. */
+    if (algorithm == ALG_FUSED)
+        freivalds = 0;
+
     printf("Options:\n");
     printf(" * Random seed = %ld\n", seed);
     printf(" * Max resident pages = %u\n", max_resident);
-    printf(" * Using %d x %d matrices\n", size, size);
+    if (vtick != 0)
+        printf(" * Policy timer ticks every %u faults\n", vtick);
+    printf(" * Using %d x %d %s matrices\n", size, size, elem_type);
+    printf(" * Multiply algorithm = %s\n", algorithm_names[algorithm]);
+    if (density < 1.0)
+        printf(" * Input density = %g\n", density);
+    if (layout >= 0) {
+        printf(" * Row alignment = %s%s\n",
+               (layout & MATRIX_ALIGN_PAGE) ? "page" :
+               (layout & MATRIX_ALIGN_CACHELINE) ? "cacheline" : "none",
+               (layout & MATRIX_HEADER_OWN_PAGE) ? ", header on own page" : "");
+    }
+    if (load_prefix != NULL)
+        printf(" * Loading inputs from %s.m1 and %s.m2\n", load_prefix,
+               load_prefix);
+    if (save_prefix != NULL)
+        printf(" * Saving inputs to %s.m1 and %s.m2%s\n", save_prefix,
+               save_prefix, save_tiled ? " (tiled)" : "");
     printf("\n");
 
     srand(seed);
 
     /* Initialize the virtual memory system. */
     vmem_init(max_resident);
+    if (vtick != 0)
+        vmem_set_virtual_ticks(vtick);
     vmem_alloc_init();
+    vmem_reset_stats();
 
     /* Perform the test. */
 
+#define RUN_TYPED_TEST(sfx, T)                                              \
+    if (strcmp(elem_type, #sfx) == 0) {                                     \
+        run_typed_test_##sfx();                                             \
+        goto done;                                                          \
+    }
+    MATRIX_TYPE_LIST(RUN_TYPED_TEST)
+
+    if (workload == WORK_CHAIN) {
+        run_chain_test();
+        goto done;
+    }
+    if (workload != WORK_MATMUL) {
+        run_factor_test();
+        goto done;
+    }
+
     printf("Generating two matrices\n\n");
 
     /* Allocate matrices from the two memory sources.  Generate values into
-     * the malloc()'d matrix since we can trust it.  Then copy the values into
-     * the vmalloc()'d matrix.
+     * the malloc()'d matrices (which can use several threads) since we can
+     * trust them.  Then copy the values into the vmalloc()'d matrices.
      */
 
     m1v = malloc_matrix(size, size);
-    m1 = vmalloc_matrix(size, size);
-    generate_matrix_values(m1v);
-    copy_matrix(m1v, m1);
-
+    generate_test_values(m1v, seed, nthreads);
     m2v = malloc_matrix(size, size);
-    m2 = vmalloc_matrix(size, size);
-    generate_matrix_values(m2v);
-    copy_matrix(m2v, m2);
+    generate_test_values(m2v, seed + 1, nthreads);
+    resultv = freivalds ? NULL : malloc_matrix(size, size);
+    report_phase("generate");
+
+    if (algorithm == ALG_SPMM || algorithm == ALG_SPMV) {
+        /* Only the sparse form of m1 goes in the virtual memory pool.  For
+         * checking, it is expanded back into a malloc()'d matrix.
+         */
+        m1s = csr_from_dense(m1v, 1);
+        if (m1s == NULL) {
+            fprintf(stderr, "Couldn't allocate sparse m1\n");
+            exit(1);
+        }
+        printf(" * Sparse m1 has %d non-zeros (%lu bytes vs %lu dense)\n\n",
+               m1s->nnz, (unsigned long) (m1s->nnz * sizeof(csr_entry_t) +
+                                          (size + 1) * sizeof(int)),
+               (unsigned long) size * size * sizeof(int));
+        m1 = malloc_matrix(size, size);
+    }
+    else {
+        m1 = make_input_matrix("m1", m1v);
+    }
+    m2 = make_input_matrix("m2", m2v);
 
-    resultv = malloc_matrix(size, size);
-    result = vmalloc_matrix(size, size);
+    result = alloc_test_matrix(size, size);
+    report_phase("copy");
 
     printf("Multiplying the matrices together\n");
     printf(" * Printing one dot per row in result matrix.\n\n");
 
-    /* Multiply the vmalloc()'d matrices and the malloc()'d matrices
-     * separately, so that we can compare the results.
+    /* Multiply the vmalloc()'d matrices and (unless Freivalds' check is
+     * being used) the malloc()'d matrices separately, so that we can compare
+     * the results.  The malloc()'d matrices always use the straightforward
+     * multiply, as a reference.
      */
-    multiply_matrices(m1, m2, result);
-    multiply_matrices(m1v, m2v, resultv);
+    switch (algorithm) {
+    case ALG_TILED:
+        multiply_matrices_tiled(m1, m2, result, tuning);
+        break;
+
+    case ALG_ROWWISE:
+        multiply_matrices_rowwise(m1, m2, result);
+        break;
+
+    case ALG_STRASSEN:
+        multiply_matrices_strassen(m1, m2, result, tuning);
+        break;
+
+    case ALG_SPMM:
+        csr_spmm(m1s, m2, result);
+        break;
+
+    case ALG_SPMV:
+        multiply_spmv(m1s, m2, result);
+        break;
+
+    case ALG_TRANSPOSED:
+        transpose_matrix_inplace(m2);
+        multiply_matrices_transposed(m1, m2, result);
+        transpose_matrix_inplace(m2);
+        break;
+
+    case ALG_FUSED:
+        {
+            matrix_epilogue_t ops[3] = {
+                { EPILOGUE_SCALE, NULL, FUSED_SCALE, 0, 0 },
+                { EPILOGUE_ADD, m2, 0, 0, 0 },
+                { EPILOGUE_CLAMP, NULL, 0, -FUSED_LIMIT, FUSED_LIMIT }
+            };
+            multiply_matrices_fused(m1, m2, result, ops, 3);
+        }
+        break;
+
+    default:
+        multiply_matrices(m1, m2, result);
+        break;
+    }
+    if (!freivalds) {
+        multiply_matrices(m1v, m2v, resultv);
+        if (algorithm == ALG_FUSED)
+            fused_reference(resultv, m2v);
+    }
+    printf("\n");
+    report_phase("multiply");
 
     printf("Verifying source and result matrix contents\n");
+    if (m1s != NULL)
+        csr_to_dense(m1s, m1);
     if (compare_matrices(m1, m1v))
         printf(" * Matrix m1 is correct\n");
     else
         printf(" * ERROR:  Matrix m1 doesn't contain correct values!\n");
 
+    if (algorithm == ALG_TRANSPOSED) {
+        if (check_transpose(m1, m1v))
+            printf(" * Out-of-place transpose of m1 is correct\n");
+        else
+            printf(" * ERROR:  Out-of-place transpose of m1 is wrong!\n");
+    }
+
+    if (m1s != NULL) {
+        if (check_csc_round_trip(m1s, m1v, m1))
+            printf(" * CSC round trip of m1 is correct\n");
+        else
+            printf(" * ERROR:  CSC round trip of m1 doesn't match m1!\n");
+    }
+
     if (compare_matrices(m2, m2v))
         printf(" * Matrix m2 is correct\n");
     else
         printf(" * ERROR:  Matrix m2 doesn't contain correct values!\n");
 
-    if (compare_matrices(result, resultv))
+    if (freivalds) {
+        if (verify_product_freivalds(m1v, m2v, result, rounds, seed))
+            printf(" * Result matrix is correct (Freivalds, %d rounds)\n",
+                   rounds);
+        else
+            printf(" * ERROR:  Result matrix doesn't contain correct values!\n");
+    }
+    else if (compare_matrices(result, resultv))
         printf(" * Result matrix is correct\n");
     else
         printf(" * ERROR:  Result matrix doesn't contain correct values!\n");
+    printf("\n");
+    report_phase("verify");
 
-    printf("\nDone!\n\n");
+done:
+    printf("Done!\n\n");
 
     printf("Total page loads:  %u\n", get_num_loads());
+    printf("Total faults:  %u\n", get_num_faults());
+    printf("Total writebacks:  %u\n", get_num_writebacks());
+    printf("Kernel major faults:  %u\n", get_num_major_faults());
 
     vmem_cleanup();
 
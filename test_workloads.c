@@ -0,0 +1,843 @@
+/*============================================================================
+ * A test program for exercising the virtual memory system with workloads
+ * other than matrix arithmetic, built on the data structures that live in
+ * the virtual memory pool.
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "splitmix.h"
+#include "virtualmem.h"
+#include "vmalloc.h"
+#include "vmhash.h"
+#include "vmbtree.h"
+#include "vmsort.h"
+#include "vmgraph.h"
+#include "vmstencil.h"
+
+#define DEFAULT_MAX_RESIDENT 64
+
+
+static long seed = 0;
+static unsigned int max_resident = DEFAULT_MAX_RESIDENT;
+static int size;
+
+/* The generator state for the keys the workloads look up, insert and scan
+ * from.  It is kept apart from rand(), which the random policy draws from, so
+ * that every policy sees the same keys for a given seed.
+ */
+static uint64_t key_state;
+
+/* Faults per paging policy timer tick, or 0 to tick every 10ms. */
+static unsigned int vtick = 0;
+
+/* Which workload to run. */
+typedef enum {
+    WORK_HASH, WORK_BTREE, WORK_SORT, WORK_GRAPH, WORK_STENCIL
+} workload_t;
+static const char *workload_names[] = {
+    "hash", "btree", "sort", "graph", "stencil", NULL
+};
+static workload_t workload = WORK_HASH;
+
+/* Hash table options:  the fraction of slots to fill (0 for the default), and
+ * how many lookups to sort by page at a time (0 to look keys up one by one).
+ */
+static double load = 0.0;
+static int batch = 0;
+
+/* B+tree options:  how full to bulk-load the nodes (0 for full), how many
+ * levels to pin from the root, and how many keys each range scan covers.
+ */
+static double fill = 0.9;
+static int pin_levels = 0;
+static int scan_len = 1000;
+
+/* Streaming options:  how many pages range scans and merges read ahead, and
+ * how many finished pages a merge collects before writing them back (0 to
+ * leave them to be written back when they are evicted).
+ */
+static int readahead = 0;
+static int write_behind = 0;
+
+/* Graph options:  a file of edges to load instead of generating an R-MAT
+ * graph, the number of edges per vertex to generate, how to renumber the
+ * vertices, and how many PageRank iterations to run.
+ */
+typedef enum { ORDER_NONE, ORDER_BFS, ORDER_DEGREE } graph_order_t;
+static const char *order_names[] = { "none", "bfs", "degree", NULL };
+static const char *graph_path = NULL;
+static int edge_factor = 16;
+static graph_order_t graph_order = ORDER_NONE;
+static int iterations = 10;
+
+/* Stencil options:  how many time steps to run, and how many of them the
+ * wavefront schedule runs per sweep (0 to size it to the resident pages).
+ */
+static int steps = 20;
+static int depth = 0;
+
+
+/* Prints the test program's usage, and then exit the program. */
+void usage(const char *prog) {
+    printf("usage: %s [--seed num] [--max_resident num] [--workload w]\n"
+           "\t[--load p] [--batch num] [--fill p] [--pin num]\n"
+           "\t[--scan_len num] [--readahead num] [--write_behind num]\n"
+           "\t[--graph file] [--edge_factor num] [--order o]\n"
+           "\t[--iterations num] [--steps num] [--depth num] [--vtick num]\n"
+           "\tsize\n", prog);
+    printf("\tRuns a workload of the specified size on data structures in\n");
+    printf("\tthe virtual memory pool.\n\n");
+    printf("\t--seed | -s num optionally specifies the seed for the random\n");
+    printf("\tnumber generator.  The system time is used otherwise.\n\n");
+    printf("\t--max_resident | -m num specifies the maximum number of pages\n");
+    printf("\tthat may be resident in the virtual memory system.\n\n");
+    printf("\t--vtick | -K num ticks the paging policy's timer every num\n");
+    printf("\tfaults instead of every 10ms, so that runs with the same\n");
+    printf("\tseed make the same page loads on any machine.\n\n");
+    printf("\t--workload | -w w selects the workload.  \"hash\" (the\n");
+    printf("\tdefault) inserts size keys into a hash table, and then looks\n");
+    printf("\tup size keys, about half of which are present.  \"btree\"\n");
+    printf("\tbulk-loads size keys into a B+tree, looks up size / 2 keys,\n");
+    printf("\tinserts size / 10 more, and runs size / scan_len range\n");
+    printf("\tscans.  \"sort\" sorts size keys with an external merge\n");
+    printf("\tsort.  \"graph\" runs a breadth-first search and PageRank\n");
+    printf("\tover an R-MAT graph of size vertices (rounded up to a power\n");
+    printf("\tof two).  \"stencil\" runs a Jacobi stencil over a size x\n");
+    printf("\tsize grid, sweeping once per step and then in wavefronts.\n\n");
+    printf("\t--load | -l p sets the fraction of hash table slots to\n");
+    printf("\tfill.\n\n");
+    printf("\t--batch | -B num looks keys up num at a time, visiting the\n");
+    printf("\tbuckets of each batch in page order.\n\n");
+    printf("\t--fill | -f p sets how full the B+tree is bulk-loaded\n");
+    printf("\t(default 0.9).\n\n");
+    printf("\t--pin | -p num pins the top num levels of the B+tree.\n\n");
+    printf("\t--scan_len | -L num sets the number of keys each range scan\n");
+    printf("\tcovers (default 1000).\n\n");
+    printf("\t--readahead | -r num makes range scans prefetch num leaves\n");
+    printf("\tahead, and merges num pages of each run.\n\n");
+    printf("\t--write_behind | -W num makes merges write their output back\n");
+    printf("\tnum pages at a time.\n\n");
+    printf("\t--graph | -g file loads the graph's edges from file, one pair\n");
+    printf("\tof vertex numbers per line, instead; size is then ignored.\n\n");
+    printf("\t--edge_factor | -e num sets the number of edges per vertex of\n");
+    printf("\tthe R-MAT graph (default 16).\n\n");
+    printf("\t--order | -o o renumbers the vertices before traversing the\n");
+    printf("\tgraph:  \"none\" (the default), \"bfs\" or\n");
+    printf("\t\"degree\".\n\n");
+    printf("\t--iterations | -i num sets the number of PageRank iterations\n");
+    printf("\t(default 10).\n\n");
+    printf("\t--steps | -t num sets the number of stencil time steps\n");
+    printf("\t(default 20).\n\n");
+    printf("\t--depth | -d num sets the number of time steps per wavefront\n");
+    printf("\tsweep (by default, as many as fit in memory).\n");
+    exit(1);
+}
+
+
+/* Parse the command-line arguments passed to the program. */
+void parse_args(int argc, char **argv) {
+    int c, i;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"seed",         required_argument, 0, 's'},
+            {"max_resident", required_argument, 0, 'm'},
+            {"vtick",        required_argument, 0, 'K'},
+            {"workload",     required_argument, 0, 'w'},
+            {"load",         required_argument, 0, 'l'},
+            {"batch",        required_argument, 0, 'B'},
+            {"fill",         required_argument, 0, 'f'},
+            {"pin",          required_argument, 0, 'p'},
+            {"readahead",    required_argument, 0, 'r'},
+            {"scan_len",     required_argument, 0, 'L'},
+            {"write_behind", required_argument, 0, 'W'},
+            {"graph",        required_argument, 0, 'g'},
+            {"edge_factor",  required_argument, 0, 'e'},
+            {"order",        required_argument, 0, 'o'},
+            {"iterations",   required_argument, 0, 'i'},
+            {"steps",        required_argument, 0, 't'},
+            {"depth",        required_argument, 0, 'd'},
+            {0, 0, 0, 0}
+        };
+
+        /* getopt_long stores the option index here. */
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "s:m:K:w:l:B:f:p:r:L:W:g:e:o:i:t:d:",
+                        long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 's':
+            seed = atol(optarg);
+            printf("Setting seed to %ld\n", seed);
+            break;
+
+        case 'm':
+            max_resident = atoi(optarg);
+            printf("Max resident pages = %d\n", max_resident);
+            break;
+
+        case 'K':
+            vtick = atoi(optarg);
+            break;
+
+        case 'w':
+            for (i = 0; workload_names[i] != NULL; i++) {
+                if (strcmp(optarg, workload_names[i]) == 0)
+                    break;
+            }
+            if (workload_names[i] == NULL)
+                usage(argv[0]);
+            workload = (workload_t) i;
+            break;
+
+        case 'l':
+            load = atof(optarg);
+            if (load < 0.0 || load > 1.0)
+                usage(argv[0]);
+            break;
+
+        case 'B':
+            batch = atoi(optarg);
+            break;
+
+        case 'f':
+            fill = atof(optarg);
+            if (fill < 0.0 || fill > 1.0)
+                usage(argv[0]);
+            break;
+
+        case 'p':
+            pin_levels = atoi(optarg);
+            break;
+
+        case 'r':
+            readahead = atoi(optarg);
+            if (readahead < 0)
+                usage(argv[0]);
+            break;
+
+        case 'L':
+            scan_len = atoi(optarg);
+            if (scan_len <= 0)
+                usage(argv[0]);
+            break;
+
+        case 'W':
+            write_behind = atoi(optarg);
+            if (write_behind < 0)
+                usage(argv[0]);
+            break;
+
+        case 'g':
+            graph_path = optarg;
+            break;
+
+        case 'e':
+            edge_factor = atoi(optarg);
+            if (edge_factor <= 0)
+                usage(argv[0]);
+            break;
+
+        case 'o':
+            for (i = 0; order_names[i] != NULL; i++) {
+                if (strcmp(optarg, order_names[i]) == 0)
+                    break;
+            }
+            if (order_names[i] == NULL)
+                usage(argv[0]);
+            graph_order = (graph_order_t) i;
+            break;
+
+        case 'i':
+            iterations = atoi(optarg);
+            if (iterations <= 0)
+                usage(argv[0]);
+            break;
+
+        case 't':
+            steps = atoi(optarg);
+            if (steps < 0)
+                usage(argv[0]);
+            break;
+
+        case 'd':
+            depth = atoi(optarg);
+            if (depth < 0)
+                usage(argv[0]);
+            break;
+
+        case '?':
+            /* getopt_long already printed an error message. */
+            usage(argv[0]);
+            /* usage() will exit the program. */
+            break;
+
+        default:
+            abort();
+        }
+    }
+
+    if (optind + 1 != argc)
+        usage(argv[0]);
+
+    size = atoi(argv[optind]);
+    if (size <= 0)
+        usage(argv[0]);
+}
+
+
+/* Returns the i'th test key for the run's seed.  The keys are scrambled, so
+ * that consecutive ones land in unrelated buckets.
+ */
+static uint64_t test_key(long i) {
+    return splitmix64((uint64_t) seed * 0x100000000ull + i);
+}
+
+
+/* The value stored with each test key. */
+static uint64_t test_value(uint64_t key) {
+    return ~key;
+}
+
+
+/* Builds a hash table holding test keys 0 .. size - 1, and then looks up size
+ * keys chosen at random from 0 .. 2 * size - 1, so that about half of them
+ * are present.  The lookups are checked, and the page loads for each phase
+ * are reported.
+ */
+static void run_hash_test(void) {
+    vmhash_t *t;
+    uint64_t *keys, *values;
+    char *found;
+    unsigned int loads;
+    long *which;
+    int i, j, n, num_found = 0, wrong = 0;
+
+    printf("Building a hash table of %d keys\n", size);
+    t = vmhash_create(size, load, seed);
+    if (t == NULL) {
+        fprintf(stderr, "Couldn't allocate the hash table\n");
+        exit(1);
+    }
+    for (i = 0; i < size; i++) {
+        if (!vmhash_insert(t, test_key(i), test_value(test_key(i))))
+            exit(1);
+    }
+    loads = get_num_loads();
+    printf(" * %u buckets (%.0f%% full), %u page loads\n\n", t->num_buckets,
+           100.0 * size / ((double) t->num_buckets * VMHASH_SLOTS), loads);
+
+    which = malloc(size * sizeof(long));
+    keys = malloc(size * sizeof(uint64_t));
+    values = malloc(size * sizeof(uint64_t));
+    found = malloc(size);
+    if (!which || !keys || !values || !found) {
+        fprintf(stderr, "Couldn't allocate the lookup keys\n");
+        exit(1);
+    }
+    for (i = 0; i < size; i++) {
+        which[i] = splitmix64_next(&key_state) % (2 * (long) size);
+        keys[i] = test_key(which[i]);
+    }
+
+    if (batch > 0)
+        printf("Looking up %d keys in batches of %d\n", size, batch);
+    else
+        printf("Looking up %d keys one at a time\n", size);
+    for (i = 0; i < size; i += n) {
+        n = (batch > 0 && batch < size - i) ? batch : size - i;
+        if (batch > 0) {
+            num_found += vmhash_lookup_batch(t, keys + i, n, values + i,
+                                             found + i);
+        }
+        else {
+            for (j = i; j < i + n; j++) {
+                found[j] = vmhash_lookup(t, keys[j], &values[j]);
+                num_found += found[j];
+            }
+        }
+    }
+    loads = get_num_loads() - loads;
+    printf(" * %d keys found, %u page loads (%.3f per lookup)\n\n", num_found,
+           loads, (double) loads / size);
+
+    printf("Verifying the lookups\n");
+    for (i = 0; i < size; i++) {
+        if (found[i] != (which[i] < size) ||
+            (found[i] && values[i] != test_value(keys[i])))
+            wrong++;
+    }
+    if (wrong == 0)
+        printf(" * Lookups are correct\n");
+    else
+        printf(" * ERROR:  %d lookups are wrong!\n", wrong);
+
+    free(which);
+    free(keys);
+    free(values);
+    free(found);
+}
+
+
+/* What a range scan has seen so far, for checking it. */
+typedef struct scan_state_t {
+    uint64_t last_key;
+    uint64_t checksum;
+    long count;
+    int in_order;
+} scan_state_t;
+
+
+/* Called by vmbtree_scan() for each key in the range. */
+static void visit_key(uint64_t key, uint64_t value, void *arg) {
+    scan_state_t *state = arg;
+
+    if (state->count > 0 && key <= state->last_key)
+        state->in_order = 0;
+    state->last_key = key;
+    state->checksum += value;
+    state->count++;
+}
+
+
+/* Bulk-loads the even keys 0 .. 2 * (size - 1) into a B+tree, and then runs
+ * three phases, reporting the page loads of each:  size / 2 lookups of random
+ * keys (about half present), size / 10 inserts of random odd keys, and
+ * size / scan_len range scans that each cover scan_len keys' worth of the key
+ * space.  Everything is checked against a plain array of which keys are
+ * present.
+ */
+static void run_btree_test(void) {
+    vmbtree_t *t;
+    uint64_t *keys, *values, value;
+    scan_state_t state;
+    unsigned int loads;
+    char *present;
+    long i, k, lo, hi, expected, num_keys = 2 * (long) size;
+    int wrong = 0, found;
+
+    printf("Bulk-loading a B+tree with %d keys\n", size);
+    keys = malloc(size * sizeof(uint64_t));
+    values = malloc(size * sizeof(uint64_t));
+    present = calloc(num_keys, 1);
+    if (!keys || !values || !present) {
+        fprintf(stderr, "Couldn't allocate the keys\n");
+        exit(1);
+    }
+    for (i = 0; i < size; i++) {
+        keys[i] = 2 * i;
+        values[i] = test_value(keys[i]);
+        present[2 * i] = 1;
+    }
+    t = vmbtree_bulk_load(keys, values, size, fill);
+    if (t == NULL) {
+        fprintf(stderr, "Couldn't allocate the B+tree\n");
+        exit(1);
+    }
+    free(keys);
+    free(values);
+    printf(" * %d levels, %u page loads\n", t->height, get_num_loads());
+
+    if (pin_levels > 0) {
+        if (vmbtree_pin_levels(t, pin_levels))
+            printf(" * Pinned the top %d levels\n", pin_levels);
+        else
+            printf(" * Couldn't pin all of the top %d levels\n", pin_levels);
+    }
+    printf("\n");
+
+    printf("Looking up %d keys\n", size / 2);
+    loads = get_num_loads();
+    for (i = 0; i < size / 2; i++) {
+        k = splitmix64_next(&key_state) % num_keys;
+        found = vmbtree_lookup(t, k, &value);
+        if (found != present[k] || (found && value != test_value(k)))
+            wrong++;
+    }
+    loads = get_num_loads() - loads;
+    printf(" * %u page loads (%.3f per lookup)\n\n", loads,
+           (double) loads / (size / 2 > 0 ? size / 2 : 1));
+
+    printf("Inserting %d keys\n", size / 10);
+    loads = get_num_loads();
+    for (i = 0; i < size / 10; i++) {
+        k = (splitmix64_next(&key_state) % size) * 2 + 1;
+        if (!vmbtree_insert(t, k, test_value(k)))
+            exit(1);
+        present[k] = 1;
+    }
+    loads = get_num_loads() - loads;
+    printf(" * %d levels, %lu keys, %u page loads\n\n", t->height, t->count,
+           loads);
+
+    printf("Running %d range scans of %d keys\n", size / scan_len, scan_len);
+    loads = get_num_loads();
+    for (i = 0; i < size / scan_len; i++) {
+        lo = splitmix64_next(&key_state) % num_keys;
+        hi = lo + 2 * (long) scan_len - 1;
+        memset(&state, 0, sizeof(state));
+        state.in_order = 1;
+        vmbtree_scan(t, lo, hi, readahead, visit_key, &state);
+
+        expected = 0;
+        value = 0;
+        for (k = lo; k <= hi && k < num_keys; k++) {
+            if (present[k]) {
+                expected++;
+                value += test_value(k);
+            }
+        }
+        if (state.count != expected || state.checksum != value ||
+            !state.in_order)
+            wrong++;
+    }
+    loads = get_num_loads() - loads;
+    printf(" * %u page loads\n\n", loads);
+
+    printf("Verifying the results\n");
+    expected = 0;
+    for (k = 0; k < num_keys; k++)
+        expected += present[k];
+    if (t->count != expected)
+        wrong++;
+    if (wrong == 0)
+        printf(" * Lookups, inserts and scans are correct\n");
+    else
+        printf(" * ERROR:  %d lookups or scans are wrong!\n", wrong);
+
+    free(present);
+}
+
+
+/* Fills a buffer with size scrambled test keys, sorts them with vmsort(), and
+ * checks that the result is in order and holds the same keys, reporting the
+ * page loads of generating the keys and of sorting them.
+ */
+static void run_sort_test(void) {
+    uint64_t *data, *scratch, sum = 0, check = 0;
+    vmsort_stats_t stats;
+    unsigned int loads;
+    long i, wrong = 0;
+
+    printf("Generating %d keys\n", size);
+    data = vmem_alloc_aligned(size * sizeof(uint64_t), PAGE_SIZE);
+    scratch = vmem_alloc_aligned(size * sizeof(uint64_t), PAGE_SIZE);
+    if (data == NULL || scratch == NULL) {
+        fprintf(stderr, "Couldn't allocate the keys\n");
+        exit(1);
+    }
+    for (i = 0; i < size; i++) {
+        data[i] = test_key(i);
+        sum += data[i];
+    }
+    printf(" * %u page loads\n\n", get_num_loads());
+
+    printf("Sorting\n");
+    loads = get_num_loads();
+    vmsort(data, scratch, size, readahead, write_behind, &stats);
+    loads = get_num_loads() - loads;
+    printf(" * %ld runs of %ld keys, merged %d at a time, %d merge passes\n",
+           stats.num_runs, stats.run_keys, stats.fan_in, stats.num_passes);
+    printf(" * %d pages of readahead per run, %d pages of write-behind\n",
+           stats.readahead, stats.write_behind);
+    printf(" * %u page loads (%.2f per page of keys)\n\n", loads,
+           loads / ((double) size / VMSORT_PAGE_KEYS));
+
+    printf("Verifying the results\n");
+    for (i = 0; i < size; i++) {
+        check += data[i];
+        if (i > 0 && data[i - 1] > data[i])
+            wrong++;
+    }
+    if (wrong == 0 && check == sum)
+        printf(" * Keys are sorted correctly\n");
+    else if (check != sum)
+        printf(" * ERROR:  the sorted keys aren't the original keys!\n");
+    else
+        printf(" * ERROR:  %ld keys are out of order!\n", wrong);
+}
+
+
+/* Builds a graph, optionally renumbers its vertices, and then runs a
+ * breadth-first search and PageRank over it, reporting the page loads per
+ * edge traversed.  The search levels are checked edge by edge, and the ranks
+ * must add up to 1.
+ */
+static void run_graph_test(void) {
+    vmgraph_t *g, *orig;
+    uint32_t *order, *level, n, root, u, v, e;
+    double *rank, total = 0.0;
+    unsigned int loads;
+    long edges, wrong = 0;
+    char *has_parent;
+    int scale;
+
+    if (graph_path != NULL) {
+        printf("Loading a graph from %s\n", graph_path);
+        g = vmgraph_load(graph_path);
+        if (g == NULL)
+            exit(1);
+    }
+    else {
+        for (scale = 1; (1L << scale) < size; scale++)
+            ;
+        printf("Generating an R-MAT graph with %ld vertices\n", 1L << scale);
+        g = vmgraph_rmat(scale, edge_factor, seed);
+        if (g == NULL) {
+            fprintf(stderr, "Couldn't allocate the graph\n");
+            exit(1);
+        }
+    }
+    n = g->num_vertices;
+    printf(" * %u vertices, %u edges, %u page loads\n\n", n, g->num_edges,
+           get_num_loads());
+
+    /* Search from the vertex with the most edges, which is almost certainly
+     * in the largest part of the graph.
+     */
+    root = 0;
+    for (v = 1; v < n; v++) {
+        if (g->offsets[v + 1] - g->offsets[v] >
+            g->offsets[root + 1] - g->offsets[root])
+            root = v;
+    }
+
+    if (graph_order != ORDER_NONE) {
+        printf("Renumbering the vertices in %s order\n",
+               order_names[graph_order]);
+        loads = get_num_loads();
+        if (graph_order == ORDER_BFS)
+            order = vmgraph_bfs_order(g, root);
+        else
+            order = vmgraph_degree_order(g);
+        orig = g;
+        g = vmgraph_reorder(orig, order);
+        if (g == NULL) {
+            fprintf(stderr, "Couldn't allocate the renumbered graph\n");
+            exit(1);
+        }
+        for (v = 0; order[v] != root; v++)
+            ;
+        root = v;
+        free(order);
+        printf(" * %u page loads\n\n", get_num_loads() - loads);
+    }
+
+    level = vmem_alloc_aligned(n * sizeof(uint32_t), PAGE_SIZE);
+    rank = vmem_alloc_aligned(n * sizeof(double), PAGE_SIZE);
+    if (level == NULL || rank == NULL) {
+        fprintf(stderr, "Couldn't allocate the results\n");
+        exit(1);
+    }
+
+    printf("Breadth-first search from vertex %u\n", root);
+    loads = get_num_loads();
+    edges = vmgraph_bfs(g, root, level);
+    loads = get_num_loads() - loads;
+    if (edges < 0) {
+        fprintf(stderr, "Couldn't allocate the search queue\n");
+        exit(1);
+    }
+    printf(" * %ld edges traversed, %u page loads (%.4f per edge)\n\n",
+           edges, loads, (double) loads / (edges > 0 ? edges : 1));
+
+    printf("Running %d PageRank iterations\n", iterations);
+    loads = get_num_loads();
+    edges = vmgraph_pagerank(g, iterations, 0.85, rank);
+    loads = get_num_loads() - loads;
+    if (edges < 0) {
+        fprintf(stderr, "Couldn't allocate the ranks\n");
+        exit(1);
+    }
+    printf(" * %ld edges traversed, %u page loads (%.4f per edge)\n\n",
+           edges, loads, (double) loads / (edges > 0 ? edges : 1));
+
+    /* Every edge out of a reached vertex must lead at most one level deeper,
+     * and every reached vertex but the root must have an edge into it from
+     * the level above.
+     */
+    printf("Verifying the results\n");
+    has_parent = calloc(n, 1);
+    if (has_parent == NULL) {
+        fprintf(stderr, "Couldn't allocate the parent flags\n");
+        exit(1);
+    }
+    has_parent[root] = 1;
+    if (level[root] != 0)
+        wrong++;
+    for (u = 0; u < n; u++) {
+        if (level[u] == VMGRAPH_UNREACHED)
+            continue;
+        for (e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            v = g->targets[e];
+            if (level[v] > level[u] + 1)
+                wrong++;
+            else if (level[v] == level[u] + 1)
+                has_parent[v] = 1;
+        }
+    }
+    for (v = 0; v < n; v++) {
+        if (level[v] != VMGRAPH_UNREACHED && !has_parent[v])
+            wrong++;
+        if (rank[v] < 0.0)
+            wrong++;
+        total += rank[v];
+    }
+    free(has_parent);
+
+    if (wrong == 0 && total > 1.0 - 1e-6 && total < 1.0 + 1e-6)
+        printf(" * Search levels and ranks are correct\n");
+    else
+        printf(" * ERROR:  %ld vertices are wrong, ranks add up to %g!\n",
+               wrong, total);
+}
+
+
+/* Fills a size x size grid with its starting values:  the top edge is held
+ * at 1, the other edges at 0, and the interior starts out with scrambled
+ * values between 0 and 1.
+ */
+static void init_grid(double *grid) {
+    int i, j;
+
+    for (i = 0; i < size; i++) {
+        for (j = 0; j < size; j++) {
+            if (i == 0)
+                grid[i * size + j] = 1.0;
+            else if (i == size - 1 || j == 0 || j == size - 1)
+                grid[i * size + j] = 0.0;
+            else
+                grid[i * size + j] =
+                    (test_key((long) i * size + j) >> 11) * 0x1.0p-53;
+        }
+    }
+}
+
+
+/* Runs the Jacobi stencil over a size x size grid with the naive schedule,
+ * and again from the same start with the wavefront schedule, reporting the
+ * page loads of each.  The two results must match bit for bit.
+ */
+static void run_stencil_test(void) {
+    double *a, *b, *c, *naive, *wave;
+    unsigned int loads;
+    int i, d, wrong = 0;
+
+    if (size < 3) {
+        fprintf(stderr, "The grid must be at least 3 x 3\n");
+        exit(1);
+    }
+    a = vmstencil_alloc(size, size);
+    b = vmstencil_alloc(size, size);
+    c = vmstencil_alloc(size, size);
+    if (a == NULL || b == NULL || c == NULL) {
+        fprintf(stderr, "Couldn't allocate the grids\n");
+        exit(1);
+    }
+
+    printf("Sweeping a %d x %d grid once per step for %d steps\n", size,
+           size, steps);
+    init_grid(a);
+    loads = get_num_loads();
+    naive = vmstencil_naive(a, b, size, size, steps);
+    loads = get_num_loads() - loads;
+    printf(" * %u page loads (%.2f per step)\n\n", loads,
+           (double) loads / (steps > 0 ? steps : 1));
+
+    /* Start the wavefront schedule over in c and whichever grid doesn't hold
+     * the naive result.
+     */
+    d = (depth > 0) ? depth : vmstencil_depth(size);
+    printf("Sweeping in wavefronts %d steps deep\n", d);
+    a = (naive == a) ? b : a;
+    init_grid(a);
+    loads = get_num_loads();
+    wave = vmstencil_wavefront(a, c, size, size, steps, d);
+    loads = get_num_loads() - loads;
+    printf(" * %u page loads (%.2f per step)\n\n", loads,
+           (double) loads / (steps > 0 ? steps : 1));
+
+    printf("Verifying the results\n");
+    for (i = 0; i < size; i++) {
+        if (memcmp(naive + i * size, wave + i * size, size * sizeof(double)))
+            wrong++;
+    }
+    if (wrong == 0)
+        printf(" * Both schedules give identical grids\n");
+    else
+        printf(" * ERROR:  %d rows differ between the schedules!\n", wrong);
+}
+
+
+int main(int argc, char **argv) {
+    /* Parse arguments */
+    parse_args(argc, argv);
+
+    /* Configure the test. */
+
+    if (seed == 0)
+       seed = time(NULL);
+
+    printf("Options:\n");
+    printf(" * Random seed = %ld\n", seed);
+    printf(" * Max resident pages = %u\n", max_resident);
+    if (vtick != 0)
+        printf(" * Policy timer ticks every %u faults\n", vtick);
+    printf(" * Workload = %s, size %d\n", workload_names[workload], size);
+    printf("\n");
+
+    srand(seed);
+    key_state = seed;
+
+    /* Initialize the virtual memory system. */
+    vmem_init(max_resident);
+    if (vtick != 0)
+        vmem_set_virtual_ticks(vtick);
+    vmem_alloc_init();
+
+    /* Perform the test. */
+
+    switch (workload) {
+    case WORK_HASH:
+        run_hash_test();
+        break;
+
+    case WORK_BTREE:
+        run_btree_test();
+        break;
+
+    case WORK_SORT:
+        run_sort_test();
+        break;
+
+    case WORK_GRAPH:
+        run_graph_test();
+        break;
+
+    case WORK_STENCIL:
+        run_stencil_test();
+        break;
+    }
+
+    printf("\nDone!\n\n");
+
+    printf("Total page loads:  %u\n", get_num_loads());
+    printf("Total faults:  %u\n", get_num_faults());
+    printf("Total writebacks:  %u\n", get_num_writebacks());
+
+    vmem_cleanup();
+
+    return 0;
+}
@@ -14,7 +14,9 @@
 
 #include <sys/errno.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "virtualmem.h"
 #include "vmpolicy.h"
@@ -38,6 +40,9 @@
 #define TIMESLICE_SEC 0
 #define TIMESLICE_USEC 10000
 
+/* The most pages that vmem_writeback() writes with a single call. */
+#define WRITEBACK_BATCH 32
+
 
 /* ============================================================================
  * Global state for the virtual memory system.
@@ -62,6 +67,16 @@ static char swapfile[40];
 static int fd_swapfile;
 
 
+/* Where each page's contents come from when it is next loaded.  Normally
+ * this is the page's own slot in the swap file (recorded as an fd of -1),
+ * but vmem_map_file() can point pages at a region of some other file
+ * instead.  The first time such a page is written back, it goes to its swap
+ * slot like any other page, and its backing reverts to the swap file.
+ */
+static int backing_fd[NUM_PAGES];
+static off_t backing_offset[NUM_PAGES];
+
+
 /* The number of pages that are currently resident. */
 static unsigned int num_resident;
 
@@ -70,15 +85,57 @@ static unsigned int num_resident;
 static unsigned int max_resident;
 
 
-/* A count of how many faults have occurred since initialization.  Note that
- * this doesn't correspond to the number of page - loads, since we use faults
- * to detect accesses and writes as well.
+/* The number of pages that are pinned, and so can't be evicted. */
+static unsigned int num_pinned;
+
+
+/* Counts of the faults, page loads, writebacks and so on since
+ * initialization, and their values at the last vmem_reset_stats().  Note that
+ * the faults don't correspond to the page - loads, since we use faults to
+ * detect accesses and writes as well.
+ */
+static vmem_stats_t totals;
+static vmem_stats_t stats_base;
+
+/* If nonzero, the policy's timer ticks come every tick_faults faults instead
+ * of from the SIGALRM timer, so that a run's page loads don't depend on how
+ * fast the machine is.  faults_since_tick counts towards the next one.
+ */
+static unsigned int tick_faults;
+static unsigned int faults_since_tick;
+
+/* The process's count of major faults when vmem_init() ran. */
+static long start_major_faults;
+
+
+#if VMEM_PROFILE
+
+/* The timings of each kind of fault, by stage, and those of the fault being
+ * handled now.
+ */
+static vmem_profile_t profile;
+static uint64_t fault_ticks[VMEM_NUM_STAGES];
+static int fault_wrote_back;
+volatile uint64_t vmem_profile_mark;
+
+/* Start timing a stage, and add the time since then to the stage. */
+#define PROFILE_START(t) uint64_t t = vmem_timestamp()
+#define PROFILE_END(t, stage) (fault_ticks[stage] += vmem_timestamp() - (t))
+
+/* Start timing a call into the paging policy, and add the time since then to
+ * the policy_ns statistic.
  */
-static unsigned int num_faults;
+#define POLICY_START(t) uint64_t t = clock_ns()
+#define POLICY_END(t) (totals.policy_ns += clock_ns() - (t))
 
+#else
 
-/* A count of how many page-loads have occurred since initialization. */
-static unsigned int num_loads;
+#define PROFILE_START(t)
+#define PROFILE_END(t, stage)
+#define POLICY_START(t)
+#define POLICY_END(t)
+
+#endif /* VMEM_PROFILE */
 
 
 /* This page table records the state of every virtual page in the virtual
@@ -124,6 +181,15 @@ page_t addr_to_page(void *addr) {
 }
 
 
+/* Returns the maximum number of pages that may be resident in memory.  Code
+ * running on top of the virtual memory system can use this to size its
+ * working sets.
+ */
+unsigned int vmem_get_max_resident() {
+    return max_resident;
+}
+
+
 /* Returns the number of segfaults that occurred in the system.  Note that
  * segfaults don't correspond to page - faults, because we use segfaults for
  * other things besides detecting page faults.  The number of page loads,
@@ -131,7 +197,7 @@ page_t addr_to_page(void *addr) {
  * performance.
  */
 unsigned int get_num_faults() {
-    return num_faults;
+    return totals.maperr_faults + totals.read_faults + totals.write_faults;
 }
 
 
@@ -140,10 +206,105 @@ unsigned int get_num_faults() {
  * the system.  This is the number we want to minimize.
  */
 unsigned int get_num_loads() {
-    return num_loads;
+    return totals.loads;
 }
 
 
+/* Returns the number of pages written back to the swap file, whether on
+ * eviction or by vmem_writeback().
+ */
+unsigned int get_num_writebacks() {
+    return totals.writebacks;
+}
+
+
+/* Returns the number of major faults the kernel has handled for the process
+ * since initialization.  The pager reads pages in with read(), so these are
+ * only faults on the rest of the process, which lets a run of the pager be
+ * compared against the same run under kernelmem.c.
+ */
+unsigned int get_num_major_faults() {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_majflt - start_major_faults;
+}
+
+
+/* Copies the statistics gathered since the last vmem_reset_stats() into
+ * *stats.  The timer handler updates them too, so it is kept out meanwhile.
+ */
+void vmem_get_stats(vmem_stats_t *stats) {
+    sigset_t mask, oldmask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    stats->maperr_faults = totals.maperr_faults - stats_base.maperr_faults;
+    stats->read_faults = totals.read_faults - stats_base.read_faults;
+    stats->write_faults = totals.write_faults - stats_base.write_faults;
+    stats->loads = totals.loads - stats_base.loads;
+    stats->evictions = totals.evictions - stats_base.evictions;
+    stats->clean_evictions =
+        totals.clean_evictions - stats_base.clean_evictions;
+    stats->dirty_evictions =
+        totals.dirty_evictions - stats_base.dirty_evictions;
+    stats->writebacks = totals.writebacks - stats_base.writebacks;
+    stats->bytes_read = totals.bytes_read - stats_base.bytes_read;
+    stats->bytes_written = totals.bytes_written - stats_base.bytes_written;
+    stats->timer_ticks = totals.timer_ticks - stats_base.timer_ticks;
+    stats->policy_ns = totals.policy_ns - stats_base.policy_ns;
+    stats->readahead_pages =
+        totals.readahead_pages - stats_base.readahead_pages;
+    stats->readahead_hits = totals.readahead_hits - stats_base.readahead_hits;
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/* Starts the statistics that vmem_get_stats() reports from zero again.  The
+ * totals since initialization carry on, so get_num_loads() and the like are
+ * unaffected.
+ */
+void vmem_reset_stats(void) {
+    sigset_t mask, oldmask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+    stats_base = totals;
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+#if VMEM_PROFILE
+
+/* Returns the monotonic clock in nanoseconds, for timing the paging policy.
+ * clock_gettime() is async-signal-safe, so the signal handlers can use it.
+ */
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/* Copies the fault timings gathered since the last reset into *p. */
+void vmem_get_profile(vmem_profile_t *p) {
+    *p = profile;
+}
+
+
+/* Clears the fault timings. */
+void vmem_reset_profile(void) {
+    memset(&profile, 0, sizeof(profile));
+}
+
+#endif /* VMEM_PROFILE */
+
+
 /* Returns a string representation of the signal - code value from the SIGSEGV
  * signal details.
  */
@@ -235,6 +396,53 @@ int is_page_dirty(page_t page) {
 }
 
 
+/* Sets the specified page's "pinned" bit in its page-table entry. */
+void set_page_pinned(page_t page) {
+    assert(page < NUM_PAGES);
+    page_table[page] |= PAGE_PINNED;
+}
+
+
+/* Clears the specified page's "pinned" bit in its page-table entry. */
+void clear_page_pinned(page_t page) {
+    assert(page < NUM_PAGES);
+    page_table[page] &= ~PAGE_PINNED;
+}
+
+
+/* Returns the specified page's "pinned" bit.  Nonzero means the page must
+ * not be evicted, zero means it may be.
+ */
+int is_page_pinned(page_t page) {
+    assert(page < NUM_PAGES);
+    return page_table[page] & PAGE_PINNED;
+}
+
+
+/* Sets the specified page's "prefetched" bit in its page-table entry. */
+void set_page_prefetched(page_t page) {
+    assert(page < NUM_PAGES);
+    page_table[page] |= PAGE_PREFETCHED;
+}
+
+
+/* Clears the specified page's "prefetched" bit in its page-table entry. */
+void clear_page_prefetched(page_t page) {
+    assert(page < NUM_PAGES);
+    page_table[page] &= ~PAGE_PREFETCHED;
+}
+
+
+/* Returns the specified page's "prefetched" bit.  Nonzero means that
+ * vmem_advise() mapped the page in ahead of its use, and no fault on it has
+ * been seen since.
+ */
+int is_page_prefetched(page_t page) {
+    assert(page < NUM_PAGES);
+    return page_table[page] & PAGE_PREFETCHED;
+}
+
+
 /* Returns the specified page's permission value from the page - table entry.
  * The other bits (e.g. resident, accessed, dirty) are masked out of this
  * return - value.
@@ -257,10 +465,12 @@ void set_page_permission(page_t page, int perm) {
            perm == PAGEPERM_RDWR);
 
     /* Call mprotect() to set the memory region's protections. */
+    PROFILE_START(start);
     if (mprotect(page_to_addr(page), PAGE_SIZE, pageperm_to_mmap(perm)) == -1) {
         perror("mprotect");
         abort();
     }
+    PROFILE_END(start, VMEM_STAGE_MPROTECT);
 
     /* Replace old permission with new permission. */
     page_table[page] = (page_table[page] & ~PAGEPERM_MASK) | perm;
@@ -304,6 +514,24 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data);
 static void sigalrm_handler(int signum, siginfo_t *infop, void *data);
 
 
+/* Starts the periodic SIGALRM timer if enabled is nonzero, or stops it. */
+static void set_tick_timer(int enabled) {
+    struct itimerval itimer;
+
+    memset(&itimer, 0, sizeof(itimer));
+    if (enabled) {
+        itimer.it_interval.tv_sec = TIMESLICE_SEC;
+        itimer.it_interval.tv_usec = TIMESLICE_USEC;
+        itimer.it_value.tv_sec = TIMESLICE_SEC;
+        itimer.it_value.tv_usec = TIMESLICE_USEC;
+    }
+    if (setitimer(ITIMER_REAL, &itimer, (struct itimerval *) 0) < 0) {
+        perror("setitimer");
+        exit(1);
+    }
+}
+
+
 /* This function initializes the virtual memory system with the specified
  * "maximum resident" limit on the number of pages that may be in the address
  * space.  This function does the following:
@@ -327,7 +555,7 @@ static void sigalrm_handler(int signum, siginfo_t *infop, void *data);
  */
 void * vmem_init(unsigned _max_resident) {
     struct sigaction action;
-    struct itimerval itimer;
+    struct rusage usage;
 
     /* Set up the address range we will use. */
     vmem_start = (void *) VIRTUALMEM_ADDR_START;
@@ -338,7 +566,12 @@ void * vmem_init(unsigned _max_resident) {
      */
     num_resident = 0;
     max_resident = _max_resident;
-    num_faults = 0;
+    num_pinned = 0;
+    memset(&totals, 0, sizeof(totals));
+    memset(&stats_base, 0, sizeof(stats_base));
+
+    getrusage(RUSAGE_SELF, &usage);
+    start_major_faults = usage.ru_majflt;
 
     fprintf(stderr, "\"Physical memory\" is in the range %p..%p\n * %d pages"
             " total, %d maximum resident pages\n\n", vmem_start, vmem_end,
@@ -346,6 +579,7 @@ void * vmem_init(unsigned _max_resident) {
 
     /* Clear the entire page table. */
     memset(page_table, 0, sizeof(page_table));
+    memset(backing_fd, -1, sizeof(backing_fd));
 
     /* Initialize the page replacement policy. */
     if (!policy_init(max_resident)) {
@@ -405,14 +639,8 @@ void * vmem_init(unsigned _max_resident) {
     }
 
     /* Start the periodic timer! */
-    itimer.it_interval.tv_sec = TIMESLICE_SEC;
-    itimer.it_interval.tv_usec = TIMESLICE_USEC;
-    itimer.it_value.tv_sec = TIMESLICE_SEC;
-    itimer.it_value.tv_usec = TIMESLICE_USEC;
-    if (setitimer(ITIMER_REAL, &itimer, (struct itimerval *) 0) < 0) {
-        perror("setitimer");
-        exit(1);
-    }
+    tick_faults = 0;
+    set_tick_timer(1);
 
     return vmem_start;
 }
@@ -423,11 +651,381 @@ void vmem_cleanup(void) {
 }
 
 
+/* Switches the policy's timer ticks to virtual time:  one tick every
+ * faults_per_tick faults, counting every SIGSEGV the handler sees, instead
+ * of one every 10ms.  With the same inputs (and seed, for the random policy)
+ * every run then makes the same page loads, on any machine.  Passing 0 goes
+ * back to the SIGALRM timer.
+ */
+void vmem_set_virtual_ticks(unsigned int faults_per_tick) {
+    sigset_t mask, oldmask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    tick_faults = faults_per_tick;
+    faults_since_tick = 0;
+    set_tick_timer(faults_per_tick == 0);
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/* This function tells the virtual memory system that the contents of the
+ * specified address range are no longer needed.  Every resident dirty page
+ * that lies entirely inside the range is marked clean, so that evicting it
+ * won't write it back to the swap file.  Pages only partly covered by the
+ * range are left alone, since they may hold other live data.  After this call
+ * the contents of the discarded pages are undefined.
+ */
+void vmem_discard(void *addr, unsigned int len) {
+    sigset_t mask, oldmask;
+    void *start, *end;
+    page_t page;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    /* Round inward to whole pages. */
+    start = vmem_start + (addr - vmem_start + PAGE_SIZE - 1) / PAGE_SIZE *
+            PAGE_SIZE;
+    end = vmem_start + (addr + len - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+
+    /* The timer handler also changes page permissions, so keep it out while
+     * we are updating page-table entries.
+     */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (; start < end; start += PAGE_SIZE) {
+        page = addr_to_page(start);
+        if (is_page_resident(page) && is_page_dirty(page)) {
+            /* Drop write permission too, so that a later write is noticed
+             * and the page becomes dirty again.
+             */
+            clear_page_dirty(page);
+            if (get_page_permission(page) == PAGEPERM_RDWR)
+                set_page_permission(page, PAGEPERM_READ);
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/* This function writes the resident dirty pages touched by the specified
+ * address range back to the swap file right away, rather than when they are
+ * evicted, and marks them clean; a later write to one makes it dirty again.
+ * This lets a program that produces data sequentially push each finished
+ * stretch out behind it, so that evicting those pages later is free.  Runs of
+ * consecutive dirty pages, up to WRITEBACK_BATCH of them, are written with a
+ * single call.
+ */
+void vmem_writeback(void *addr, unsigned int len) {
+    sigset_t mask, oldmask;
+    unsigned char old_perm[WRITEBACK_BATCH];
+    page_t page, first, last;
+    int i, count, wc;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    if (len == 0)
+        return;
+
+    first = (addr - vmem_start) / PAGE_SIZE;
+    last = (addr + len - vmem_start - 1) / PAGE_SIZE;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (page = first; page <= last; page += count) {
+        /* Gather a run of dirty pages, making them all readable so that
+         * write() can read them.
+         */
+        for (count = 0; count < WRITEBACK_BATCH && page + count <= last;
+             count++) {
+            if (!is_page_resident(page + count) || !is_page_dirty(page + count))
+                break;
+            old_perm[count] = get_page_permission(page + count);
+            if (old_perm[count] != PAGEPERM_READ)
+                set_page_permission(page + count, PAGEPERM_READ);
+        }
+        if (count == 0) {
+            count = 1;
+            continue;
+        }
+
+        wc = pwrite(fd_swapfile, page_to_addr(page), count * PAGE_SIZE,
+                    (off_t) page * PAGE_SIZE);
+        if (wc == -1) {
+            perror("pwrite in vmem_writeback");
+            abort();
+        }
+        if (wc != count * PAGE_SIZE) {
+            fprintf(stderr, "pwrite: only wrote %d bytes (%d expected)\n",
+                    wc, count * PAGE_SIZE);
+            abort();
+        }
+
+        /* Pages the policy had made inaccessible go back to being so, so
+         * that it still sees the next access.  Writable pages stay readable,
+         * so that the next write is noticed.
+         */
+        totals.writebacks += count;
+        totals.bytes_written += count * PAGE_SIZE;
+        for (i = 0; i < count; i++) {
+            clear_page_dirty(page + i);
+            backing_fd[page + i] = -1;
+            if (old_perm[i] == PAGEPERM_NONE)
+                set_page_permission(page + i, PAGEPERM_NONE);
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/* This function arranges for the page-aligned address range starting at addr
+ * to be filled lazily from the file fd, starting at the page-aligned file
+ * offset.  The range is rounded up to whole pages, so the caller must own
+ * all of its last page.  Pages that aren't resident will be read from the
+ * file when they are first touched, instead of from the swap file; pages
+ * that are already resident are filled from the file right away, and marked
+ * dirty so that their new contents reach the swap file if they are evicted.
+ * The caller must keep fd open for as long as the range is in use.
+ */
+void vmem_map_file(void *addr, unsigned int len, int fd, off_t offset) {
+    sigset_t mask, oldmask;
+    page_t page;
+    void *p;
+    int rc;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+    assert((addr - vmem_start) % PAGE_SIZE == 0);
+    assert(offset % PAGE_SIZE == 0);
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (p = addr; p < addr + len; p += PAGE_SIZE, offset += PAGE_SIZE) {
+        page = addr_to_page(p);
+        if (!is_page_resident(page)) {
+            backing_fd[page] = fd;
+            backing_offset[page] = offset;
+            continue;
+        }
+
+        set_page_permission(page, PAGEPERM_RDWR);
+        set_page_accessed(page);
+        set_page_dirty(page);
+        rc = pread(fd, p, PAGE_SIZE, offset);
+        if (rc == -1) {
+            perror("pread");
+            abort();
+        }
+        memset(p + rc, 0, PAGE_SIZE - rc);
+        totals.bytes_read += rc;
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/* Makes room for another page to be mapped, by evicting the page chosen by the
+ * paging policy if the maximum number of pages is already resident.  Pinned
+ * pages can't be evicted, so any that the policy chooses are handed straight
+ * back to it as if they had just been mapped.  vmem_pin() never pins more
+ * than half of the resident pages, so the policy soon picks another page.
+ */
+static void make_room(void) {
+    page_t victim;
+
+    assert(num_resident <= max_resident);
+    if (num_resident == max_resident) {
+        PROFILE_START(start);
+        POLICY_START(policy_start);
+        victim = choose_and_evict_victim_page();
+        while (is_page_pinned(victim)) {
+            policy_page_mapped(victim);
+            victim = choose_and_evict_victim_page();
+        }
+        POLICY_END(policy_start);
+        PROFILE_END(start, VMEM_STAGE_POLICY);
+        assert(is_page_resident(victim));
+        unmap_page(victim);
+        assert(!is_page_resident(victim));
+    }
+}
+
+
+/* This function passes on advice about how the program will use the address
+ * range starting at addr.  VMEM_ADVICE_WILLNEED maps in the pages of the range
+ * that aren't resident yet, so that touching them won't fault; to keep one
+ * call from flushing the whole working set, at most a quarter of the resident
+ * pages are brought in per call.  The other kinds of advice are handed to the
+ * paging policy for each resident page.  Since a range that has just been
+ * passed over is typically followed directly by data that is still in use,
+ * VMEM_ADVICE_CYCLIC and VMEM_ADVICE_STREAM only cover the pages entirely
+ * inside the range; the other kinds of advice cover every page that the range
+ * touches.  Advice is only a hint, so ranges outside the virtual memory pool
+ * are ignored.
+ */
+void vmem_advise(void *addr, unsigned int len, int advice) {
+    sigset_t mask, oldmask;
+    void *start, *end;
+    unsigned int budget;
+    page_t page;
+
+    assert(advice == VMEM_ADVICE_WILLNEED || advice == VMEM_ADVICE_REUSE ||
+           advice == VMEM_ADVICE_CYCLIC || advice == VMEM_ADVICE_STREAM);
+
+    if (len == 0 || addr < vmem_start || addr + len > vmem_end)
+        return;
+
+    if (advice == VMEM_ADVICE_CYCLIC || advice == VMEM_ADVICE_STREAM) {
+        start = vmem_start + (addr - vmem_start + PAGE_SIZE - 1) / PAGE_SIZE *
+                PAGE_SIZE;
+        end = vmem_start + (addr + len - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+    }
+    else {
+        start = vmem_start + (addr - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+        end = vmem_start + (addr + len - vmem_start + PAGE_SIZE - 1) /
+              PAGE_SIZE * PAGE_SIZE;
+    }
+
+    budget = max_resident / 4;
+    if (budget == 0)
+        budget = 1;
+
+    /* Both mapping pages and the policy's own bookkeeping race with the timer
+     * handler, so keep it out until we are done.
+     */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (; start < end; start += PAGE_SIZE) {
+        page = addr_to_page(start);
+        if (advice != VMEM_ADVICE_WILLNEED) {
+            if (is_page_resident(page)) {
+                POLICY_START(policy_start);
+                policy_page_advice(page, advice);
+                POLICY_END(policy_start);
+            }
+            continue;
+        }
+
+        if (is_page_resident(page))
+            continue;
+        if (budget == 0)
+            break;
+        budget--;
+
+        /* The caller has said the page is about to be used, so map it
+         * readable and already accessed, saving the fault that would
+         * otherwise record the access.  It is marked as prefetched, so that
+         * the first fault on it shows that the prefetch was used.
+         */
+        make_room();
+        map_page(page, PAGEPERM_READ);
+        set_page_accessed(page);
+        set_page_prefetched(page);
+        totals.readahead_pages++;
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/* This function pins the pages touched by the specified address range, so that
+ * they stay resident until vmem_unpin() is called on them; pages that aren't
+ * resident yet are mapped in first.  Pinning isn't counted, so one call to
+ * vmem_unpin() releases a page however many times it was pinned.  To leave
+ * room for everything else, at most half of the resident pages may be pinned
+ * at once.  Returns nonzero on success, or 0 (pinning nothing) if the range
+ * would take the number of pinned pages over that limit.
+ */
+int vmem_pin(void *addr, unsigned int len) {
+    sigset_t mask, oldmask;
+    void *start, *end, *p;
+    unsigned int count = 0;
+    page_t page;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    start = vmem_start + (addr - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+    end = vmem_start + (addr + len - vmem_start + PAGE_SIZE - 1) / PAGE_SIZE *
+          PAGE_SIZE;
+
+    for (p = start; p < end; p += PAGE_SIZE) {
+        if (!is_page_pinned(addr_to_page(p)))
+            count++;
+    }
+    if (num_pinned + count > max_resident / 2)
+        return 0;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    for (p = start; p < end; p += PAGE_SIZE) {
+        page = addr_to_page(p);
+        if (!is_page_resident(page)) {
+            make_room();
+            map_page(page, PAGEPERM_NONE);
+        }
+        if (!is_page_pinned(page)) {
+            set_page_pinned(page);
+            num_pinned++;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+    return 1;
+}
+
+
+/* This function unpins the pages touched by the specified address range, so
+ * that the paging policy may evict them again.
+ */
+void vmem_unpin(void *addr, unsigned int len) {
+    sigset_t mask, oldmask;
+    void *p;
+    page_t page;
+
+    assert(addr >= vmem_start);
+    assert(addr + len <= vmem_end);
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+    p = vmem_start + (addr - vmem_start) / PAGE_SIZE * PAGE_SIZE;
+    for (; p < addr + len; p += PAGE_SIZE) {
+        page = addr_to_page(p);
+        if (is_page_pinned(page)) {
+            clear_page_pinned(page);
+            num_pinned--;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
 /* This function maps the specified page from the swap file into the virtual
  * address space, and sets up the page permissions so that accesses and writes
  * to the page can be detected.
  */
 void map_page(page_t page, unsigned initial_perm) {
+
     assert(page < NUM_PAGES);
     assert(initial_perm == PAGEPERM_NONE || initial_perm == PAGEPERM_READ ||
            initial_perm == PAGEPERM_RDWR);
@@ -478,7 +1076,9 @@ void map_page(page_t page, unsigned initial_perm) {
     int flags = MAP_FIXED | MAP_SHARED | MAP_ANONYMOUS;
 
     /* Map the page's address-range to the process' virtual memory */ 
+    PROFILE_START(mmap_start);
     void *virt_addr = mmap(input_addr, PAGE_SIZE, prot, flags, -1, 0);
+    PROFILE_END(mmap_start, VMEM_STAGE_MMAP);
 
     /* Check for errors and that input and virtual addresses are the same */ 
     if(virt_addr == (void *) -1) {
@@ -490,20 +1090,36 @@ void map_page(page_t page, unsigned initial_perm) {
         abort();
     }
 
+    /* Pages backed by a mapped file are read from that file instead of from
+     * the swap file.  The file may end part way through the last page; the
+     * rest of that page is zero-filled.
+     */
+    int fd = fd_swapfile;
+    off_t offset = page * PAGE_SIZE;
+    if (backing_fd[page] >= 0) {
+        fd = backing_fd[page];
+        offset = backing_offset[page];
+    }
+
     /* Seek to the start of the page's corresponding slot in the swap - file.
      * Report an error in case of failure. */ 
-    if(lseek(fd_swapfile, page * PAGE_SIZE, SEEK_SET) == -1) {
+    PROFILE_START(read_start);
+    if(lseek(fd, offset, SEEK_SET) == -1) {
         perror("lseek");
         abort();
     }
 
     /* Load the data of the page from swap and check for errors */ 
-    int rc = read(fd_swapfile, virt_addr, PAGE_SIZE);
+    int rc = read(fd, virt_addr, PAGE_SIZE);
     if(rc == -1) {
         perror("read");
         abort();
     }
-    if(rc != PAGE_SIZE) {
+    PROFILE_END(read_start, VMEM_STAGE_READ);
+    if(fd != fd_swapfile) {
+        memset(virt_addr + rc, 0, PAGE_SIZE - rc);
+    }
+    else if(rc != PAGE_SIZE) {
         fprintf(stderr, "read: only read %d bytes (%d expected)\n", \
  rc, PAGE_SIZE);
         abort();
@@ -517,10 +1133,15 @@ void map_page(page_t page, unsigned initial_perm) {
     set_page_permission(page, initial_perm);
 
     assert(is_page_resident(page));  /* Now it should be mapped! */
-    num_loads++;
+    totals.loads++;
+    totals.bytes_read += rc;
 
     /* Inform the paging policy that the page was mapped. */
+    PROFILE_START(profile_start);
+    POLICY_START(policy_start);
     policy_page_mapped(page);
+    POLICY_END(policy_start);
+    PROFILE_END(profile_start, VMEM_STAGE_POLICY);
 
 #if VERBOSE
     fprintf(stderr, "Successfully mapped in page %u with initial "
@@ -573,6 +1194,7 @@ void unmap_page(page_t page) {
 
         /* Seek to the start of the page's slot in the swap file.
          * Report any errors. */ 
+        PROFILE_START(write_start);
         if(lseek(fd_swapfile, page * PAGE_SIZE, SEEK_SET) == -1) {
             perror("lseek in unmap_page");
             abort();
@@ -589,14 +1211,31 @@ void unmap_page(page_t page) {
  wc, PAGE_SIZE);
             abort();
         }
+
+        PROFILE_END(write_start, VMEM_STAGE_WRITEBACK);
+#if VMEM_PROFILE
+        fault_wrote_back = 1;
+#endif
+
+        /* The swap slot now holds the page's contents. */
+        backing_fd[page] = -1;
+        totals.writebacks++;
+        totals.bytes_written += PAGE_SIZE;
+        totals.dirty_evictions++;
     }
+    else {
+        totals.clean_evictions++;
+    }
+    totals.evictions++;
 
     /* Call unmap to remove the page's address range from
      * the process' virtual address space */ 
+    PROFILE_START(munmap_start);
     if(munmap(addr, PAGE_SIZE) == -1) {
         perror("munmap in unmap_page");
         abort();
     }
+    PROFILE_END(munmap_start, VMEM_STAGE_MUNMAP);
 
     /* Clear the page's Page Table Entry */ 
     clear_page_entry(page);
@@ -624,6 +1263,16 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
     void *addr;
     page_t page;
 
+#if VMEM_PROFILE
+    uint64_t entry = vmem_timestamp();
+    int kind = -1, stage;
+
+    memset(fault_ticks, 0, sizeof(fault_ticks));
+    fault_wrote_back = 0;
+    if (vmem_profile_mark != 0)
+        fault_ticks[VMEM_STAGE_DELIVERY] = entry - vmem_profile_mark;
+#endif
+
     /* Only handle SIGSEGVs addresses in range */
     addr = infop->si_addr;
     if (addr < vmem_start || addr >= vmem_end) {
@@ -631,12 +1280,18 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
         abort();
     }
 
-    num_faults++;
-
     /* Figure out what page generated the fault. */
     page = addr_to_page(addr);
     assert(page < NUM_PAGES);
 
+    /* Reads of a prefetched page don't fault until the policy takes access
+     * away, so the first fault on it is the first sign that it was used.
+     */
+    if (is_page_prefetched(page)) {
+        clear_page_prefetched(page);
+        totals.readahead_hits++;
+    }
+
 #if VERBOSE
     fprintf(stderr,
         "================================================================\n");
@@ -690,19 +1345,18 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
 
     /* Case address is unmapped (SEGV_MAPERR) */ 
     if(infop->si_code == SEGV_MAPERR) {
-        assert(num_resident <= max_resident);
+        totals.maperr_faults++;
 
         /* respect the physical memory constraints by evicting a page */ 
-        if (num_resident == max_resident) {
-            page_t victim = choose_and_evict_victim_page();
-            assert(is_page_resident(victim));
-            unmap_page(victim);
-            assert(!is_page_resident(victim));
-        }
+        make_room();
 
         /* Map the page into memory */ 
         map_page(page, PAGEPERM_NONE);
         assert(is_page_resident(page));
+
+#if VMEM_PROFILE
+        kind = fault_wrote_back ? VMEM_FAULT_MAP_DIRTY : VMEM_FAULT_MAP_CLEAN;
+#endif
     }
 
     /* Case address is mapped (SEGV_ACCERR) */ 
@@ -713,7 +1367,11 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
         if(get_page_permission(page) == PAGEPERM_NONE) {
 
             /* Allow reading */ 
+            totals.read_faults++;
             set_page_permission(page, PAGEPERM_READ);
+#if VMEM_PROFILE
+            kind = VMEM_FAULT_READ;
+#endif
 
             /* Mark page as accessed, since it will be read */ 
             set_page_accessed(page);
@@ -726,7 +1384,11 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
         else if(get_page_permission(page) == PAGEPERM_READ) {
 
             /* Allow writing (and reading) */ 
+            totals.write_faults++;
             set_page_permission(page, PAGEPERM_RDWR);
+#if VMEM_PROFILE
+            kind = VMEM_FAULT_WRITE;
+#endif
 
             /* Mark page as dirty, since it will be written */ 
             set_page_dirty(page);
@@ -735,6 +1397,28 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
             assert(get_page_permission(page) == PAGEPERM_RDWR);
         }
     }
+
+    /* In virtual time, the fault may be the one that ends a tick. */
+    if (tick_faults != 0 && ++faults_since_tick == tick_faults) {
+        faults_since_tick = 0;
+        POLICY_START(policy_start);
+        policy_timer_tick();
+        POLICY_END(policy_start);
+        totals.timer_ticks++;
+    }
+
+#if VMEM_PROFILE
+    /* Record the fault's timings, and start timing the next one's delivery
+     * from here, in case the access faults again.
+     */
+    vmem_profile_mark = vmem_timestamp();
+    fault_ticks[VMEM_STAGE_HANDLER] = vmem_profile_mark - entry;
+    if (kind >= 0) {
+        profile.faults[kind]++;
+        for (stage = 0; stage < VMEM_NUM_STAGES; stage++)
+            profile.ticks[kind][stage] += fault_ticks[stage];
+    }
+#endif
 }
 
 
@@ -745,6 +1429,7 @@ static void sigsegv_handler(int signum, siginfo_t *infop, void *data) {
  * a timer interrupt will never interrupt the segmentation - fault handler.
  */
 static void sigalrm_handler(int signum, siginfo_t *infop, void *data) {
+
 #if VERBOSE
     fprintf(stderr,
         "================================================================\n");
@@ -754,7 +1439,10 @@ static void sigalrm_handler(int signum, siginfo_t *infop, void *data) {
     /* All we have to do is inform the page replacement policy that a timer
      * tick occurred!
      */
+    POLICY_START(policy_start);
     policy_timer_tick();
+    POLICY_END(policy_start);
+    totals.timer_ticks++;
 }
 
 
@@ -7,6 +7,7 @@
 #define VIRTUALMEM_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 
 /* When debugging virtual memory, setting this to 1 will result in a lot of
@@ -14,6 +15,16 @@
  */
 #define VERBOSE 0
 
+/* Setting this to 1 (for example with -DVMEM_PROFILE=1) makes the SIGSEGV
+ * handler time each stage of every fault it handles with the processor's
+ * timestamp counter; see vmem_get_profile().  It also times every call into
+ * the paging policy for the policy_ns statistic.  It is off by default, since
+ * reading the clocks slows every fault down a little.
+ */
+#ifndef VMEM_PROFILE
+#define VMEM_PROFILE 0
+#endif
+
 
 /* Type for representing a page number.  Since we have a limit of 4K
  * pages, we can use a 16-bit unsigned integer for this value.
@@ -47,8 +58,10 @@ typedef unsigned char pte_t;
 #define PAGE_RESIDENT 0x01   /* Is the page resident in memory? */
 #define PAGE_ACCESSED 0x02   /* Has the page been accessed?     */
 #define PAGE_DIRTY    0x04   /* Has the page been modified?     */
+#define PAGE_PINNED   0x08   /* Must the page stay resident?    */
+#define PAGE_PREFETCHED 0x80 /* Prefetched, and not yet seen in use? */
 
-#define PAGEPERM_MASK 0xF0   /* A mask for extracting the permission value. */
+#define PAGEPERM_MASK 0x70   /* A mask for extracting the permission value. */
 
 #define PAGEPERM_NONE 0x10   /* No access is permitted.         */
 #define PAGEPERM_READ 0x20   /* Read-only access is permitted.  */
@@ -65,6 +78,12 @@ int is_page_accessed(page_t page);
 void set_page_dirty(page_t page);
 void clear_page_dirty(page_t page);
 int is_page_dirty(page_t page);
+void set_page_pinned(page_t page);
+void clear_page_pinned(page_t page);
+int is_page_pinned(page_t page);
+void set_page_prefetched(page_t page);
+void clear_page_prefetched(page_t page);
+int is_page_prefetched(page_t page);
 int get_page_permission(page_t page);
 void set_page_permission(page_t page, int perm);
 
@@ -89,8 +108,151 @@ void vmem_cleanup();
 void * page_to_addr(page_t page);
 page_t addr_to_page(void *addr);
 
-/* Return statistics about the virtual memory system. */
+/* Declare that the contents of an address range are no longer needed, so that
+ * dirty pages within it are dropped instead of being written back.
+ */
+void vmem_discard(void *addr, unsigned int len);
+
+/* Write the dirty pages of an address range back to the swap file now, so
+ * that evicting them later costs nothing.
+ */
+void vmem_writeback(void *addr, unsigned int len);
+
+/* Fill a page-aligned address range lazily from a file, page by page as the
+ * pages are first touched.
+ */
+void vmem_map_file(void *addr, unsigned int len, int fd, off_t offset);
+
+/* Advice values for vmem_advise(), describing how an address range is about
+ * to be used.
+ */
+#define VMEM_ADVICE_WILLNEED 1   /* Will be touched soon; prefetch it.      */
+#define VMEM_ADVICE_REUSE    2   /* Will be touched again; try to keep it.  */
+#define VMEM_ADVICE_CYCLIC   3   /* Part of a repeated pass over a range.   */
+#define VMEM_ADVICE_STREAM   4   /* Not needed again; evict it first.       */
+
+/* Tell the virtual memory system how an address range will be used next, so
+ * that it can prefetch pages and steer the page replacement policy.
+ */
+void vmem_advise(void *addr, unsigned int len, int advice);
+
+/* Keep the pages of an address range resident until they are unpinned. */
+int vmem_pin(void *addr, unsigned int len);
+void vmem_unpin(void *addr, unsigned int len);
+
+/* Drive the paging policy's timer ticks from the fault count instead of the
+ * clock, one tick every faults_per_tick faults, so that runs are
+ * reproducible; 0 goes back to the 10ms timer.
+ */
+void vmem_set_virtual_ticks(unsigned int faults_per_tick);
+
+/* Returns the maximum number of pages that may be resident at once. */
+unsigned int vmem_get_max_resident();
+
+/* Statistics about the virtual memory system, counted since vmem_init() or
+ * the last vmem_reset_stats().  Loads and byte counts include pages read from
+ * files given to vmem_map_file(); writebacks include those made by
+ * vmem_writeback() as well as by evictions.
+ *
+ * A prefetched page is mapped readable, so it only counts towards
+ * readahead_hits if it faults before it is evicted.  The CLOCK/LRU policy
+ * takes access away from resident pages on its timer ticks, so reads after the
+ * page's next tick are seen.  The FIFO and random policies never do, so under
+ * them only prefetched pages that are written count, and readahead_hits is a
+ * lower bound that is only meaningful for CLOCK/LRU.
+ */
+typedef struct vmem_stats_t {
+    uint64_t maperr_faults;     /* Faults on pages that weren't mapped.     */
+    uint64_t read_faults;       /* First reads of mapped pages.             */
+    uint64_t write_faults;      /* First writes of mapped pages.            */
+    uint64_t loads;             /* Pages read in.                           */
+    uint64_t evictions;         /* Pages evicted, clean or dirty.           */
+    uint64_t clean_evictions;
+    uint64_t dirty_evictions;   /* Evicted after being written back.        */
+    uint64_t writebacks;        /* Dirty pages written back.                */
+    uint64_t bytes_read;        /* Bytes read in by loads.                  */
+    uint64_t bytes_written;     /* Bytes written back.                      */
+    uint64_t timer_ticks;       /* The paging policy's timer ticks.         */
+    uint64_t policy_ns;         /* Nanoseconds spent in the paging policy,
+                                 * or 0 unless built with VMEM_PROFILE.     */
+    uint64_t readahead_pages;   /* Pages mapped in by VMEM_ADVICE_WILLNEED. */
+    uint64_t readahead_hits;    /* Those later seen to be used.             */
+} vmem_stats_t;
+
+/* Copy the statistics gathered since the last reset into *stats. */
+void vmem_get_stats(vmem_stats_t *stats);
+
+/* Start counting the statistics from zero again, for example at the start of
+ * each phase of a program.  The totals returned by get_num_faults() and the
+ * functions after it are unaffected.
+ */
+void vmem_reset_stats();
+
+/* Return statistics about the virtual memory system since vmem_init(). */
 unsigned int get_num_faults();
 unsigned int get_num_loads();
+unsigned int get_num_writebacks();
+
+/* Returns the number of major page faults the kernel has handled for the
+ * process since vmem_init(), as reported by getrusage().
+ */
+unsigned int get_num_major_faults();
+
+#if VMEM_PROFILE
+
+/* Returns the current timestamp:  the processor's timestamp counter on x86,
+ * or else the monotonic clock in nanoseconds.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t vmem_timestamp(void) {
+    return __rdtsc();
+}
+#else
+#include <time.h>
+static inline uint64_t vmem_timestamp(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+/* The kinds of fault that are timed separately. */
+#define VMEM_FAULT_MAP_CLEAN 0   /* Unmapped; no victim, or a clean one.  */
+#define VMEM_FAULT_MAP_DIRTY 1   /* Unmapped; the victim was written back. */
+#define VMEM_FAULT_READ      2   /* First read:  NONE -> READ.            */
+#define VMEM_FAULT_WRITE     3   /* First write:  READ -> RDWR.           */
+#define VMEM_NUM_FAULT_KINDS 4
+
+/* The stages of a fault.  VMEM_STAGE_DELIVERY runs from vmem_profile_mark
+ * (or the end of the previous fault) to the start of the handler, so it
+ * covers the kernel delivering the signal and, for the second fault of one
+ * access, returning from the first.  VMEM_STAGE_HANDLER is the whole
+ * handler; the stages after it are the parts of it spent in each call.
+ */
+#define VMEM_STAGE_DELIVERY  0
+#define VMEM_STAGE_HANDLER   1
+#define VMEM_STAGE_POLICY    2   /* Choosing a victim, recording a page.   */
+#define VMEM_STAGE_WRITEBACK 3   /* lseek() and write() of a dirty victim. */
+#define VMEM_STAGE_MUNMAP    4
+#define VMEM_STAGE_MMAP      5
+#define VMEM_STAGE_READ      6   /* lseek() and read() of the new page.    */
+#define VMEM_STAGE_MPROTECT  7
+#define VMEM_NUM_STAGES      8
+
+typedef struct vmem_profile_t {
+    unsigned long faults[VMEM_NUM_FAULT_KINDS];
+    uint64_t ticks[VMEM_NUM_FAULT_KINDS][VMEM_NUM_STAGES];
+} vmem_profile_t;
+
+/* Set to a timestamp just before touching memory, so that the next fault can
+ * tell how long its delivery took.
+ */
+extern volatile uint64_t vmem_profile_mark;
+
+void vmem_get_profile(vmem_profile_t *profile);
+void vmem_reset_profile();
+
+#endif /* VMEM_PROFILE */
 
 #endif /* VIRTUALMEM_H */
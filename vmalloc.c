@@ -3,6 +3,8 @@
  * memory system.
  */
 
+#include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "virtualmem.h"
@@ -14,7 +16,9 @@
  * allocation size, as long as the request will fit in the virtual memory
  * area.  When we run out of space, we start returning NULL.
  *
- * Oh, and we never deallocate...
+ * Oh, and we never deallocate...  except that a caller may take a mark and
+ * later roll the pointer back to it, releasing everything allocated since in
+ * one go.  This is enough for scratch space in recursive algorithms.
  */
 static void *nextptr;
 
@@ -42,3 +46,53 @@ void * vmem_alloc(unsigned int size) {
     return p;
 }
 
+
+
+/* Request an allocation of the specified size, whose start address is a
+ * multiple of align (which must be a power of two).  Any bytes skipped to
+ * reach the alignment are simply wasted.  This will return NULL if no more
+ * memory is available.
+ */
+void * vmem_alloc_aligned(unsigned int size, unsigned int align) {
+    void *start;
+
+    assert(align > 0 && (align & (align - 1)) == 0);
+
+    start = (void *) (((uintptr_t) nextptr + align - 1) &
+                      ~(uintptr_t) (align - 1));
+    if (start + size > get_vmem_end()) {
+        fprintf(stderr, "vmem_alloc_aligned(%u, %u): ran out of heap space\n",
+                size, align);
+        return NULL;
+    }
+
+    nextptr = start + size;
+    return start;
+}
+
+
+/* Returns the number of bytes still available for allocation. */
+unsigned int vmem_alloc_available() {
+    return get_vmem_end() - nextptr;
+}
+
+
+/* Returns a mark recording the current state of the allocator, which can be
+ * passed to vmem_alloc_release() later on.
+ */
+void * vmem_alloc_mark() {
+    return nextptr;
+}
+
+
+/* Release every allocation made since the specified mark was taken.  The
+ * released pages are discarded in the virtual memory system, so any dirty
+ * scratch data in them is never written back to the swap file.
+ */
+void vmem_alloc_release(void *mark) {
+    assert(mark >= get_vmem_start() && mark <= nextptr);
+
+    if (nextptr > mark)
+        vmem_discard(mark, nextptr - mark);
+    nextptr = mark;
+}
@@ -8,6 +8,14 @@
 
 void vmem_alloc_init();
 void * vmem_alloc(unsigned int size);
+void * vmem_alloc_aligned(unsigned int size, unsigned int align);
+unsigned int vmem_alloc_available();
 
-#endif /* VMALLOC_H */
+/* Arena-style release:  everything allocated after vmem_alloc_mark() returned
+ * the mark is freed by vmem_alloc_release(mark), and its pages are discarded
+ * without being written back.
+ */
+void * vmem_alloc_mark();
+void vmem_alloc_release(void *mark);
 
+#endif /* VMALLOC_H */
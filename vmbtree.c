@@ -0,0 +1,508 @@
+/*============================================================================
+ * Implementation of the page-sized B+tree declared in vmbtree.h.
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmalloc.h"
+#include "vmbtree.h"
+
+
+/* Allocate an empty node from the virtual memory pool, on a page of its own.
+ * Returns NULL if the pool is out of space.
+ */
+static vmbtree_node_t * alloc_node(int is_leaf) {
+    vmbtree_node_t *node;
+
+    node = vmem_alloc_aligned(PAGE_SIZE, PAGE_SIZE);
+    if (node == NULL)
+        return NULL;
+
+    node->is_leaf = is_leaf;
+    node->num_keys = 0;
+    node->next = NULL;
+    return node;
+}
+
+
+/* Returns the index of the first of the n sorted keys that is >= key, or n if
+ * there is none.
+ */
+static int lower_bound(const uint64_t *keys, int n, uint64_t key) {
+    int lo = 0, hi = n, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+/* Returns the index of the first of the n sorted keys that is > key, or n if
+ * there is none.  For an internal node, this is the child to descend into.
+ */
+static int upper_bound(const uint64_t *keys, int n, uint64_t key) {
+    int lo = 0, hi = n, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (keys[mid] <= key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+/* Returns the first node on the specified level of the tree, where the root
+ * is level 0.
+ */
+static vmbtree_node_t * first_on_level(const vmbtree_t *t, int level) {
+    vmbtree_node_t *node = t->root;
+
+    assert(level >= 0 && level < t->height);
+    while (level-- > 0)
+        node = node->u.inner.children[0];
+    return node;
+}
+
+
+/* Pins or unpins every node on the specified level of the tree.  Returns
+ * nonzero if all of the nodes could be pinned.
+ */
+static int pin_level(const vmbtree_t *t, int level, int pin) {
+    vmbtree_node_t *node;
+    int ok = 1;
+
+    for (node = first_on_level(t, level); node != NULL; node = node->next) {
+        if (!pin)
+            vmem_unpin(node, PAGE_SIZE);
+        else if (!vmem_pin(node, PAGE_SIZE))
+            ok = 0;
+    }
+    return ok;
+}
+
+
+/* Create an empty tree, whose root is an empty leaf.  Returns NULL if the
+ * pool doesn't have room for it.
+ */
+vmbtree_t * vmbtree_create(void) {
+    vmbtree_t *t;
+
+    assert(sizeof(vmbtree_node_t) == PAGE_SIZE);
+
+    t = vmem_alloc(sizeof(vmbtree_t));
+    if (t == NULL)
+        return NULL;
+
+    t->root = alloc_node(1);
+    if (t->root == NULL)
+        return NULL;
+
+    t->height = 1;
+    t->pinned_levels = 0;
+    t->count = 0;
+    return t;
+}
+
+
+/* Build a tree holding the n keys in keys, which must be sorted and distinct,
+ * with the matching values.  The tree is built bottom-up, a level at a time,
+ * so the nodes of each level are contiguous and in key order.  Each node is
+ * filled to the fraction fill of its capacity (or completely, if fill is 0),
+ * leaving room for later inserts.  Returns NULL if the pool doesn't have room
+ * for the tree.
+ */
+vmbtree_t * vmbtree_bulk_load(const uint64_t *keys, const uint64_t *values,
+                              long n, double fill) {
+    vmbtree_t *t;
+    vmbtree_node_t **nodes, *node, *prev;
+    uint64_t *mins;
+    long i, j, k, m, count, per_leaf, per_inner;
+
+    assert(n >= 0);
+    assert(fill >= 0.0 && fill <= 1.0);
+
+    if (fill == 0.0)
+        fill = 1.0;
+    per_leaf = (long) (VMBTREE_LEAF_KEYS * fill);
+    if (per_leaf < 1)
+        per_leaf = 1;
+    per_inner = (long) ((VMBTREE_INNER_KEYS + 1) * fill);
+    if (per_inner < 2)
+        per_inner = 2;
+
+    t = vmbtree_create();
+    if (t == NULL || n == 0)
+        return t;
+
+    /* The nodes of the level being built, and the smallest key under each. */
+    k = (n + per_leaf - 1) / per_leaf;
+    nodes = malloc(k * sizeof(vmbtree_node_t *));
+    mins = malloc(k * sizeof(uint64_t));
+    if (nodes == NULL || mins == NULL) {
+        fprintf(stderr, "vmbtree_bulk_load: out of memory\n");
+        abort();
+    }
+
+    /* The empty root leaf that vmbtree_create() made becomes the first leaf,
+     * so that the leaves are contiguous.
+     */
+    prev = NULL;
+    for (i = 0, k = 0; i < n; i += count, k++) {
+        node = (k == 0) ? t->root : alloc_node(1);
+        if (node == NULL)
+            goto fail;
+
+        count = (n - i < per_leaf) ? n - i : per_leaf;
+        for (j = 0; j < count; j++) {
+            assert(i + j == 0 || keys[i + j - 1] < keys[i + j]);
+            node->u.leaf.keys[j] = keys[i + j];
+            node->u.leaf.values[j] = values[i + j];
+        }
+        node->num_keys = count;
+
+        if (prev != NULL)
+            prev->next = node;
+        prev = node;
+        nodes[k] = node;
+        mins[k] = keys[i];
+    }
+
+    /* Build each level on top of the last one, until one node is left. */
+    while (k > 1) {
+        prev = NULL;
+        for (i = 0, m = 0; i < k; i += count, m++) {
+            node = alloc_node(0);
+            if (node == NULL)
+                goto fail;
+
+            count = (k - i < per_inner) ? k - i : per_inner;
+            for (j = 0; j < count; j++) {
+                node->u.inner.children[j] = nodes[i + j];
+                if (j > 0)
+                    node->u.inner.keys[j - 1] = mins[i + j];
+            }
+            node->num_keys = count - 1;
+
+            if (prev != NULL)
+                prev->next = node;
+            prev = node;
+            nodes[m] = node;
+            mins[m] = mins[i];
+        }
+        k = m;
+        t->height++;
+    }
+
+    t->root = nodes[0];
+    t->count = n;
+    free(nodes);
+    free(mins);
+    return t;
+
+fail:
+    free(nodes);
+    free(mins);
+    return NULL;
+}
+
+
+/* Look up key in the tree.  If it is present, its value is stored into *value
+ * (if value isn't NULL) and nonzero is returned; otherwise 0 is returned.
+ */
+int vmbtree_lookup(const vmbtree_t *t, uint64_t key, uint64_t *value) {
+    const vmbtree_node_t *node;
+    int i;
+
+    assert(t != NULL);
+
+    node = t->root;
+    while (!node->is_leaf) {
+        i = upper_bound(node->u.inner.keys, node->num_keys, key);
+        node = node->u.inner.children[i];
+    }
+
+    i = lower_bound(node->u.leaf.keys, node->num_keys, key);
+    if (i == node->num_keys || node->u.leaf.keys[i] != key)
+        return 0;
+
+    if (value != NULL)
+        *value = node->u.leaf.values[i];
+    return 1;
+}
+
+
+/* Allocate a new node to split a node on the specified level of the tree
+ * into, pinning it if that level is pinned.
+ */
+static vmbtree_node_t * split_node(const vmbtree_t *t, int level,
+                                   int is_leaf) {
+    vmbtree_node_t *node;
+
+    /* vmbtree_insert() checks that the pool has room first. */
+    node = alloc_node(is_leaf);
+    assert(node != NULL);
+
+    if (level < t->pinned_levels)
+        vmem_pin(node, PAGE_SIZE);
+    return node;
+}
+
+
+/* Insert the separator key and the child to its right into an internal node
+ * that has room for them, as key i and child i + 1.
+ */
+static void inner_insert(vmbtree_node_t *node, int i, uint64_t key,
+                         vmbtree_node_t *child) {
+    int n = node->num_keys;
+
+    assert(n < VMBTREE_INNER_KEYS);
+    memmove(&node->u.inner.keys[i + 1], &node->u.inner.keys[i],
+            (n - i) * sizeof(uint64_t));
+    memmove(&node->u.inner.children[i + 2], &node->u.inner.children[i + 1],
+            (n - i) * sizeof(vmbtree_node_t *));
+    node->u.inner.keys[i] = key;
+    node->u.inner.children[i + 1] = child;
+    node->num_keys++;
+}
+
+
+/* Insert key and value into a leaf that has room for them, as entry i. */
+static void leaf_insert(vmbtree_node_t *node, int i, uint64_t key,
+                        uint64_t value) {
+    int n = node->num_keys;
+
+    assert(n < VMBTREE_LEAF_KEYS);
+    memmove(&node->u.leaf.keys[i + 1], &node->u.leaf.keys[i],
+            (n - i) * sizeof(uint64_t));
+    memmove(&node->u.leaf.values[i + 1], &node->u.leaf.values[i],
+            (n - i) * sizeof(uint64_t));
+    node->u.leaf.keys[i] = key;
+    node->u.leaf.values[i] = value;
+    node->num_keys++;
+}
+
+
+/* Insert key and value into the subtree rooted at node, which is on the
+ * specified level of the tree.  *added is set to nonzero if the key is new.
+ * If node has to be split to make room, the new node holding its upper half
+ * is returned, and the smallest key under that node is stored into *sep;
+ * otherwise NULL is returned.
+ */
+static vmbtree_node_t * insert_into(vmbtree_t *t, vmbtree_node_t *node,
+                                    int level, uint64_t key, uint64_t value,
+                                    uint64_t *sep, int *added) {
+    vmbtree_node_t *right, *child_right;
+    uint64_t child_sep;
+    int i, n = node->num_keys, half;
+
+    if (node->is_leaf) {
+        i = lower_bound(node->u.leaf.keys, n, key);
+        if (i < n && node->u.leaf.keys[i] == key) {
+            node->u.leaf.values[i] = value;
+            *added = 0;
+            return NULL;
+        }
+
+        *added = 1;
+        if (n < VMBTREE_LEAF_KEYS) {
+            leaf_insert(node, i, key, value);
+            return NULL;
+        }
+
+        /* Move the upper half of the entries into a new leaf. */
+        right = split_node(t, level, 1);
+        half = (n + 1) / 2;
+        memcpy(right->u.leaf.keys, &node->u.leaf.keys[half],
+               (n - half) * sizeof(uint64_t));
+        memcpy(right->u.leaf.values, &node->u.leaf.values[half],
+               (n - half) * sizeof(uint64_t));
+        right->num_keys = n - half;
+        node->num_keys = half;
+        right->next = node->next;
+        node->next = right;
+
+        if (i < half)
+            leaf_insert(node, i, key, value);
+        else
+            leaf_insert(right, i - half, key, value);
+        *sep = right->u.leaf.keys[0];
+        return right;
+    }
+
+    i = upper_bound(node->u.inner.keys, n, key);
+    child_right = insert_into(t, node->u.inner.children[i], level + 1, key,
+                              value, &child_sep, added);
+    if (child_right == NULL)
+        return NULL;
+
+    if (n < VMBTREE_INNER_KEYS) {
+        inner_insert(node, i, child_sep, child_right);
+        return NULL;
+    }
+
+    /* Move the keys and children above the middle key into a new node; the
+     * middle key itself moves up to separate the two.
+     */
+    right = split_node(t, level, 0);
+    half = n / 2;
+    *sep = node->u.inner.keys[half];
+    memcpy(right->u.inner.keys, &node->u.inner.keys[half + 1],
+           (n - half - 1) * sizeof(uint64_t));
+    memcpy(right->u.inner.children, &node->u.inner.children[half + 1],
+           (n - half) * sizeof(vmbtree_node_t *));
+    right->num_keys = n - half - 1;
+    node->num_keys = half;
+    right->next = node->next;
+    node->next = right;
+
+    if (i <= half)
+        inner_insert(node, i, child_sep, child_right);
+    else
+        inner_insert(right, i - half - 1, child_sep, child_right);
+    return right;
+}
+
+
+/* Insert key into the tree with the specified value, replacing the value if
+ * the key is already present.  Full nodes are split on the way back up from
+ * the leaf, and if the root splits, the tree grows a new root.  Returns
+ * nonzero on success, or 0 if the pool might not have room for the splits,
+ * in which case the tree is unchanged.
+ */
+int vmbtree_insert(vmbtree_t *t, uint64_t key, uint64_t value) {
+    vmbtree_node_t *right, *root;
+    uint64_t sep;
+    int added;
+
+    assert(t != NULL);
+
+    /* Each split takes a page, plus up to a page to align it. */
+    if (vmem_alloc_available() < 2 * PAGE_SIZE * (t->height + 1)) {
+        fprintf(stderr, "vmbtree_insert: out of space for nodes\n");
+        return 0;
+    }
+
+    right = insert_into(t, t->root, 0, key, value, &sep, &added);
+    if (right != NULL) {
+        root = alloc_node(0);
+        assert(root != NULL);
+        root->u.inner.keys[0] = sep;
+        root->u.inner.children[0] = t->root;
+        root->u.inner.children[1] = right;
+        root->num_keys = 1;
+        t->root = root;
+        t->height++;
+
+        /* Every pinned level just moved down one, so pin the new root and
+         * unpin the level that fell out of the pinned range.
+         */
+        if (t->pinned_levels > 0) {
+            vmem_pin(root, PAGE_SIZE);
+            if (t->pinned_levels < t->height)
+                pin_level(t, t->pinned_levels, 0);
+        }
+    }
+
+    if (added)
+        t->count++;
+    return 1;
+}
+
+
+/* Call visit on every key in the range lo .. hi (inclusive) with its value,
+ * in key order, and return the number of keys in the range.  visit may be
+ * NULL, to just count them.  The scan finds the first leaf, and then follows
+ * the chain of leaves.  If readahead is positive, a second cursor runs along
+ * the level above the leaves, which knows where the next leaves are without
+ * touching them, and prefetches up to readahead leaves ahead of the scan,
+ * stopping at the end of the range.
+ */
+long vmbtree_scan(const vmbtree_t *t, uint64_t lo, uint64_t hi,
+                  int readahead, vmbtree_visit_t visit, void *arg) {
+    const vmbtree_node_t *node, *parent = NULL;
+    long count = 0;
+    int i, ahead = 0, parent_i = 0;
+
+    assert(t != NULL);
+
+    node = t->root;
+    while (!node->is_leaf) {
+        parent = node;
+        parent_i = upper_bound(node->u.inner.keys, node->num_keys, lo);
+        node = node->u.inner.children[parent_i];
+    }
+
+    i = lower_bound(node->u.leaf.keys, node->num_keys, lo);
+    while (node != NULL) {
+        /* Keep the readahead cursor the requested number of leaves ahead. */
+        while (ahead < readahead && parent != NULL) {
+            if (++parent_i > parent->num_keys) {
+                parent = parent->next;
+                parent_i = 0;
+                if (parent == NULL)
+                    break;
+            }
+            if (parent_i > 0 && parent->u.inner.keys[parent_i - 1] > hi) {
+                parent = NULL;
+                break;
+            }
+            vmem_advise(parent->u.inner.children[parent_i], PAGE_SIZE,
+                        VMEM_ADVICE_WILLNEED);
+            ahead++;
+        }
+
+        for (; i < node->num_keys; i++) {
+            if (node->u.leaf.keys[i] > hi)
+                return count;
+            if (visit != NULL)
+                visit(node->u.leaf.keys[i], node->u.leaf.values[i], arg);
+            count++;
+        }
+
+        node = node->next;
+        i = 0;
+        if (ahead > 0)
+            ahead--;
+    }
+
+    return count;
+}
+
+
+/* Pin the nodes on the top levels of the tree, starting from the root, so
+ * that lookups never fault on them; 0 unpins them all.  Inserts keep the
+ * pinning up to date as nodes split and the tree grows.  Returns nonzero if
+ * every node could be pinned, or 0 if the virtual memory system ran out of
+ * pages to pin, in which case only some of them are.
+ */
+int vmbtree_pin_levels(vmbtree_t *t, int levels) {
+    int level, ok = 1;
+
+    assert(t != NULL);
+    assert(levels >= 0);
+
+    if (levels > t->height)
+        levels = t->height;
+
+    for (level = levels; level < t->pinned_levels; level++)
+        pin_level(t, level, 0);
+    for (level = 0; level < levels; level++) {
+        if (!pin_level(t, level, 1))
+            ok = 0;
+    }
+
+    t->pinned_levels = levels;
+    return ok;
+}
@@ -0,0 +1,73 @@
+/*============================================================================
+ * Declarations for a B+tree index that lives in the virtual memory pool.  It
+ * maps 64-bit keys to 64-bit values, and every node is exactly one page, so
+ * a lookup touches one page per level.  The nodes on each level are chained
+ * together in key order, so range scans walk along the leaves, and they use
+ * the chain one level up to prefetch the leaves ahead of them.  The upper
+ * levels, which every lookup passes through, can be pinned in memory.
+ *
+ * Keys can be inserted but not removed, since the allocator can't free the
+ * nodes anyway.
+ */
+
+
+#ifndef VMBTREE_H
+#define VMBTREE_H
+
+#include <stdint.h>
+
+#include "virtualmem.h"
+
+
+/* The size of the header at the start of each node. */
+#define VMBTREE_HEADER_SIZE 16
+
+/* The most keys a leaf can hold; each has a value. */
+#define VMBTREE_LEAF_KEYS ((PAGE_SIZE - VMBTREE_HEADER_SIZE) / \
+                           (2 * sizeof(uint64_t)))
+
+/* The most keys an internal node can hold; it has one more child. */
+#define VMBTREE_INNER_KEYS ((PAGE_SIZE - VMBTREE_HEADER_SIZE - \
+                             sizeof(void *)) / (2 * sizeof(uint64_t)))
+
+
+typedef struct vmbtree_node_t {
+    uint32_t is_leaf;
+    uint32_t num_keys;
+    struct vmbtree_node_t *next;    /* The next node on the same level. */
+    union {
+        struct {
+            uint64_t keys[VMBTREE_LEAF_KEYS];
+            uint64_t values[VMBTREE_LEAF_KEYS];
+        } leaf;
+
+        /* Child i holds the keys k with keys[i - 1] <= k < keys[i]. */
+        struct {
+            uint64_t keys[VMBTREE_INNER_KEYS];
+            struct vmbtree_node_t *children[VMBTREE_INNER_KEYS + 1];
+        } inner;
+    } u;
+} vmbtree_node_t;
+
+typedef struct vmbtree_t {
+    vmbtree_node_t *root;
+    int height;             /* Number of levels, including the leaves. */
+    int pinned_levels;      /* Number of levels pinned, from the root.  */
+    unsigned long count;    /* Number of keys in the tree.              */
+} vmbtree_t;
+
+/* Called by vmbtree_scan() for each key in the range, in order. */
+typedef void (*vmbtree_visit_t)(uint64_t key, uint64_t value, void *arg);
+
+
+vmbtree_t * vmbtree_create(void);
+vmbtree_t * vmbtree_bulk_load(const uint64_t *keys, const uint64_t *values,
+                              long n, double fill);
+int vmbtree_insert(vmbtree_t *t, uint64_t key, uint64_t value);
+int vmbtree_lookup(const vmbtree_t *t, uint64_t key, uint64_t *value);
+long vmbtree_scan(const vmbtree_t *t, uint64_t lo, uint64_t hi,
+                  int readahead, vmbtree_visit_t visit, void *arg);
+int vmbtree_pin_levels(vmbtree_t *t, int levels);
+
+
+#endif /* VMBTREE_H */
@@ -0,0 +1,420 @@
+/*============================================================================
+ * A benchmark for the virtual memory system that replays synthetic reference
+ * streams over a buffer in the virtual memory pool, one reference per page
+ * touched, so that each paging policy can be measured on access patterns
+ * other than the ones the matrix and workload tests happen to produce.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "splitmix.h"
+#include "virtualmem.h"
+#include "vmalloc.h"
+
+#define DEFAULT_MAX_RESIDENT 64
+
+
+/* The reference patterns.  PATTERN_ALL runs each of the others in turn. */
+typedef enum {
+    PATTERN_SEQ, PATTERN_STRIDE, PATTERN_UNIFORM, PATTERN_ZIPF, PATTERN_LOOP,
+    PATTERN_PHASE, PATTERN_ALL
+} pattern_t;
+static const char *pattern_names[] = {
+    "seq", "stride", "uniform", "zipf", "loop", "phase", "all", NULL
+};
+
+static long seed = 0;
+static unsigned int max_resident = DEFAULT_MAX_RESIDENT;
+static int size;                    /* Buffer size in pages. */
+static pattern_t pattern = PATTERN_ALL;
+static long num_refs = 0;           /* 0 means 4 * size.     */
+static double writes = 0.0;         /* Fraction of writes.   */
+
+/* Faults per paging policy timer tick, or 0 to tick every 10ms. */
+static unsigned int vtick = 0;
+
+/* Pattern parameters:  the stride in pages, the Zipf skew, the working set
+ * of the loop in pages (0 for 1.5 * max_resident), and the size in pages
+ * (0 for max_resident / 2) and number of the phases' hot sets.
+ */
+static int stride = 7;
+static double skew = 0.99;
+static int working_set = 0;
+static int hot_pages = 0;
+static int num_phases = 4;
+
+/* The generator states for the pages touched and for choosing writes, kept
+ * apart so that the pages touched don't depend on the write fraction.
+ */
+static uint64_t page_state;
+static uint64_t write_state;
+
+
+/* Prints the program's usage, and then exit the program. */
+void usage(const char *prog) {
+    printf("usage: %s [--seed num] [--max_resident num] [--pattern p]\n"
+           "\t[--refs num] [--writes p] [--stride num] [--skew s]\n"
+           "\t[--working_set num] [--hot num] [--phases num] [--vtick num]\n"
+           "\tsize\n", prog);
+    printf("\tTouches pages of a size-page buffer in the virtual memory\n");
+    printf("\tpool in a synthetic pattern, and reports the page loads,\n");
+    printf("\tfaults, writebacks and throughput.\n\n");
+    printf("\t--seed | -s num optionally specifies the seed for the random\n");
+    printf("\tnumber generator.  The system time is used otherwise.\n\n");
+    printf("\t--max_resident | -m num specifies the maximum number of pages\n");
+    printf("\tthat may be resident in the virtual memory system.\n\n");
+    printf("\t--vtick | -K num ticks the paging policy's timer every num\n");
+    printf("\tfaults instead of every 10ms, so that runs with the same\n");
+    printf("\tseed make the same page loads on any machine.\n\n");
+    printf("\t--pattern | -p p selects the pattern:  \"seq\", \"stride\",\n");
+    printf("\t\"uniform\", \"zipf\", \"loop\", \"phase\", or \"all\" (the\n");
+    printf("\tdefault) to run each in turn.\n\n");
+    printf("\t--refs | -n num sets the number of pages touched per pattern\n");
+    printf("\t(default 4 * size).\n\n");
+    printf("\t--writes | -w p makes a fraction p of the touches writes.\n\n");
+    printf("\t--stride | -S num sets the stride in pages (default 7).\n\n");
+    printf("\t--skew | -z s sets the Zipf skew (default 0.99).\n\n");
+    printf("\t--working_set | -W num sets the number of pages the loop\n");
+    printf("\tcycles through (default 1.5 * max_resident).\n\n");
+    printf("\t--hot | -H num sets the size of each phase's hot set (default\n");
+    printf("\tmax_resident / 2).\n\n");
+    printf("\t--phases | -P num sets the number of phases (default 4).\n");
+    exit(1);
+}
+
+
+/* Parse the command-line arguments passed to the program. */
+void parse_args(int argc, char **argv) {
+    int c, i;
+
+    while (1) {
+        static struct option long_options[] = {
+            {"seed",         required_argument, 0, 's'},
+            {"max_resident", required_argument, 0, 'm'},
+            {"vtick",        required_argument, 0, 'K'},
+            {"pattern",      required_argument, 0, 'p'},
+            {"refs",         required_argument, 0, 'n'},
+            {"writes",       required_argument, 0, 'w'},
+            {"stride",       required_argument, 0, 'S'},
+            {"skew",         required_argument, 0, 'z'},
+            {"working_set",  required_argument, 0, 'W'},
+            {"hot",          required_argument, 0, 'H'},
+            {"phases",       required_argument, 0, 'P'},
+            {0, 0, 0, 0}
+        };
+
+        /* getopt_long stores the option index here. */
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "s:m:K:p:n:w:S:z:W:H:P:", long_options,
+                        &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 's':
+            seed = atol(optarg);
+            printf("Setting seed to %ld\n", seed);
+            break;
+
+        case 'm':
+            max_resident = atoi(optarg);
+            printf("Max resident pages = %d\n", max_resident);
+            break;
+
+        case 'K':
+            vtick = atoi(optarg);
+            break;
+
+        case 'p':
+            for (i = 0; pattern_names[i] != NULL; i++) {
+                if (strcmp(optarg, pattern_names[i]) == 0)
+                    break;
+            }
+            if (pattern_names[i] == NULL)
+                usage(argv[0]);
+            pattern = (pattern_t) i;
+            break;
+
+        case 'n':
+            num_refs = atol(optarg);
+            if (num_refs <= 0)
+                usage(argv[0]);
+            break;
+
+        case 'w':
+            writes = atof(optarg);
+            if (writes < 0.0 || writes > 1.0)
+                usage(argv[0]);
+            break;
+
+        case 'S':
+            stride = atoi(optarg);
+            if (stride <= 0)
+                usage(argv[0]);
+            break;
+
+        case 'z':
+            skew = atof(optarg);
+            if (skew < 0.0)
+                usage(argv[0]);
+            break;
+
+        case 'W':
+            working_set = atoi(optarg);
+            if (working_set < 0)
+                usage(argv[0]);
+            break;
+
+        case 'H':
+            hot_pages = atoi(optarg);
+            if (hot_pages < 0)
+                usage(argv[0]);
+            break;
+
+        case 'P':
+            num_phases = atoi(optarg);
+            if (num_phases <= 0)
+                usage(argv[0]);
+            break;
+
+        case '?':
+            /* getopt_long already printed an error message. */
+            usage(argv[0]);
+            /* usage() will exit the program. */
+            break;
+
+        default:
+            abort();
+        }
+    }
+
+    if (optind + 1 != argc)
+        usage(argv[0]);
+
+    size = atoi(argv[optind]);
+    if (size <= 0)
+        usage(argv[0]);
+}
+
+
+/* Returns a random number in [0, 1) from the generator with the given
+ * state.
+ */
+static double next_uniform(uint64_t *state) {
+    return (splitmix64_next(state) >> 11) * 0x1.0p-53;
+}
+
+
+/* The Zipf distribution over the buffer's pages:  zipf_cdf[k] is the chance
+ * of picking one of the k + 1 most popular pages, and zipf_page[k] is the
+ * page with popularity rank k.  The ranks are shuffled over the buffer, so
+ * that the hot pages aren't all next to each other.
+ */
+static double *zipf_cdf;
+static int *zipf_page;
+
+
+/* Sets up zipf_cdf and zipf_page for the buffer size and skew. */
+static void init_zipf(void) {
+    double total = 0.0;
+    int k, j, t;
+
+    zipf_cdf = malloc(size * sizeof(double));
+    zipf_page = malloc(size * sizeof(int));
+    if (zipf_cdf == NULL || zipf_page == NULL) {
+        fprintf(stderr, "init_zipf: out of memory\n");
+        abort();
+    }
+
+    for (k = 0; k < size; k++) {
+        total += 1.0 / pow(k + 1, skew);
+        zipf_cdf[k] = total;
+    }
+    for (k = 0; k < size; k++)
+        zipf_cdf[k] /= total;
+
+    for (k = 0; k < size; k++)
+        zipf_page[k] = k;
+    for (k = size - 1; k > 0; k--) {
+        j = splitmix64_next(&page_state) % (k + 1);
+        t = zipf_page[k];
+        zipf_page[k] = zipf_page[j];
+        zipf_page[j] = t;
+    }
+}
+
+
+/* Returns the page that reference i out of refs touches in pattern p.
+ *
+ *  - "seq" walks through the buffer over and over.
+ *  - "stride" touches every stride'th page, starting one page further on
+ *    each time it wraps around the buffer.
+ *  - "uniform" picks pages at random.
+ *  - "zipf" picks pages at random with Zipf-distributed popularity.
+ *  - "loop" walks through the first working_set pages over and over.
+ *  - "phase" splits the references into phases, each of which makes nine
+ *    tenths of its references to its own hot set of pages.
+ */
+static int next_page(pattern_t p, long i, long refs) {
+    long per_pass, lo, hi, mid;
+    int ws, hot, phase;
+    double u;
+
+    switch (p) {
+    case PATTERN_SEQ:
+        return i % size;
+
+    case PATTERN_STRIDE:
+        per_pass = (size + stride - 1) / stride;
+        return ((i % per_pass) * stride + i / per_pass) % size;
+
+    case PATTERN_UNIFORM:
+        return splitmix64_next(&page_state) % size;
+
+    case PATTERN_ZIPF:
+        /* Find the first rank whose cumulative chance exceeds u. */
+        u = next_uniform(&page_state);
+        lo = 0;
+        hi = size - 1;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (zipf_cdf[mid] > u)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return zipf_page[lo];
+
+    case PATTERN_LOOP:
+        ws = (working_set > 0) ? working_set : max_resident * 3 / 2;
+        if (ws > size)
+            ws = size;
+        return i % (ws > 0 ? ws : 1);
+
+    case PATTERN_PHASE:
+        hot = (hot_pages > 0) ? hot_pages : max_resident / 2;
+        if (hot > size)
+            hot = size;
+        if (hot < 1)
+            hot = 1;
+        phase = i * num_phases / refs;
+        if (next_uniform(&page_state) < 0.9)
+            return (phase * hot + splitmix64_next(&page_state) % hot) % size;
+        return splitmix64_next(&page_state) % size;
+
+    default:
+        abort();
+    }
+}
+
+
+/* Runs pattern p over the buffer and reports what it cost.  Each reference
+ * reads or writes one word of its page, moving along the page from one
+ * reference to the next.
+ */
+static void run_pattern(pattern_t p, uint64_t *buffer) {
+    struct timespec start, end;
+    unsigned int loads, faults, writebacks;
+    long i, refs = (num_refs > 0) ? num_refs : 4L * size;
+    volatile uint64_t sink;
+    uint64_t sum = 0, *word;
+    double seconds;
+
+    page_state = seed * 0x100000000ull + p;
+    write_state = ~page_state;
+
+    printf("Pattern %s\n", pattern_names[p]);
+    loads = get_num_loads();
+    faults = get_num_faults();
+    writebacks = get_num_writebacks();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < refs; i++) {
+        word = buffer + (long) next_page(p, i, refs) * (PAGE_SIZE / 8) +
+               i % (PAGE_SIZE / 8);
+        if (writes > 0.0 && next_uniform(&write_state) < writes)
+            *word = i;
+        else
+            sum += *word;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sink = sum;
+    (void) sink;
+    loads = get_num_loads() - loads;
+    faults = get_num_faults() - faults;
+    writebacks = get_num_writebacks() - writebacks;
+    seconds = (end.tv_sec - start.tv_sec) +
+              (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    printf(" * %ld references, %u page loads (%.4f per reference)\n", refs,
+           loads, (double) loads / refs);
+    printf(" * %u faults, %u writebacks\n", faults, writebacks);
+    printf(" * %.3f seconds, %.0f references per second\n\n", seconds,
+           refs / (seconds > 0.0 ? seconds : 1e-9));
+}
+
+
+int main(int argc, char **argv) {
+    uint64_t *buffer;
+    int p;
+
+    /* Parse arguments */
+    parse_args(argc, argv);
+
+    /* Configure the test. */
+
+    if (seed == 0)
+       seed = time(NULL);
+
+    printf("Options:\n");
+    printf(" * Random seed = %ld\n", seed);
+    printf(" * Max resident pages = %u\n", max_resident);
+    if (vtick != 0)
+        printf(" * Policy timer ticks every %u faults\n", vtick);
+    printf(" * Pattern = %s, %d pages\n", pattern_names[pattern], size);
+    printf(" * Writes = %.0f%%\n", 100.0 * writes);
+    printf("\n");
+
+    /* Initialize the virtual memory system. */
+    vmem_init(max_resident);
+    if (vtick != 0)
+        vmem_set_virtual_ticks(vtick);
+    vmem_alloc_init();
+
+    buffer = vmem_alloc_aligned(size * PAGE_SIZE, PAGE_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Couldn't allocate a buffer of %d pages\n", size);
+        exit(1);
+    }
+
+    /* Perform the test. */
+
+    page_state = seed;
+    if (pattern == PATTERN_ZIPF || pattern == PATTERN_ALL)
+        init_zipf();
+
+    for (p = 0; p < PATTERN_ALL; p++) {
+        if (pattern == p || pattern == PATTERN_ALL)
+            run_pattern(p, buffer);
+    }
+
+    printf("Done!\n\n");
+
+    printf("Total page loads:  %u\n", get_num_loads());
+    printf("Total faults:  %u\n", get_num_faults());
+    printf("Total writebacks:  %u\n", get_num_writebacks());
+
+    vmem_cleanup();
+
+    return 0;
+}
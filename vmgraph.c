@@ -0,0 +1,460 @@
+/*============================================================================
+ * Implementation of the CSR graph declared in vmgraph.h.  The graphs are
+ * built in memory from malloc(), where scattering the edges into place
+ * costs nothing, and are then copied into the virtual memory pool in order.
+ */
+
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "splitmix.h"
+#include "vmalloc.h"
+#include "vmgraph.h"
+
+
+/* The R-MAT quadrant probabilities; the fourth is 1 - A - B - C.  These are
+ * the Graph500 values, which give a skewed, power-law degree distribution.
+ */
+#define RMAT_A 0.57
+#define RMAT_B 0.19
+#define RMAT_C 0.19
+
+
+/* Orders vertex numbers for qsort(). */
+static int compare_vertices(const void *a, const void *b) {
+    uint32_t va = *(const uint32_t *) a, vb = *(const uint32_t *) b;
+
+    return (va > vb) - (va < vb);
+}
+
+
+/* Build a graph in the virtual memory pool with the specified number of
+ * vertices (less than UINT32_MAX, so that offsets[num_vertices] exists), and
+ * an edge from src[i] to dst[i] for each of the num_edges edges.  Repeated
+ * edges and self-loops are kept.  Returns NULL if the pool doesn't have room
+ * for the graph.
+ */
+vmgraph_t * vmgraph_from_edges(uint32_t num_vertices, uint32_t num_edges,
+                               const uint32_t *src, const uint32_t *dst) {
+    vmgraph_t *g;
+    uint32_t *end, *targets, e, v;
+
+    assert(num_vertices < UINT32_MAX);
+
+    /* vmem_alloc_aligned() takes an unsigned int, so a larger array can't be
+     * in the pool anyway.
+     */
+    if (((size_t) num_vertices + 1) * sizeof(uint32_t) > UINT_MAX ||
+        (size_t) num_edges * sizeof(uint32_t) > UINT_MAX)
+        return NULL;
+
+    g = vmem_alloc(sizeof(vmgraph_t));
+    if (g == NULL)
+        return NULL;
+    g->num_vertices = num_vertices;
+    g->num_edges = num_edges;
+    g->offsets = vmem_alloc_aligned(((size_t) num_vertices + 1) *
+                                    sizeof(uint32_t), PAGE_SIZE);
+    g->targets = vmem_alloc_aligned((num_edges > 0 ? num_edges : 1) *
+                                    sizeof(uint32_t), PAGE_SIZE);
+    if (g->offsets == NULL || g->targets == NULL)
+        return NULL;
+
+    end = calloc((size_t) num_vertices + 1, sizeof(uint32_t));
+    targets = malloc((num_edges > 0 ? num_edges : 1) * sizeof(uint32_t));
+    if (end == NULL || targets == NULL) {
+        fprintf(stderr, "vmgraph_from_edges: out of memory\n");
+        abort();
+    }
+
+    /* Count each vertex's edges, and sum the counts into offsets. */
+    for (e = 0; e < num_edges; e++) {
+        assert(src[e] < num_vertices && dst[e] < num_vertices);
+        end[src[e] + 1]++;
+    }
+    for (v = 0; v < num_vertices; v++)
+        end[v + 1] += end[v];
+    memcpy(g->offsets, end, ((size_t) num_vertices + 1) * sizeof(uint32_t));
+
+    /* Scatter the edges into place, which leaves end[v] at the end of the
+     * edges of vertex v, and then sort each vertex's edges.
+     */
+    for (e = 0; e < num_edges; e++)
+        targets[end[src[e]]++] = dst[e];
+    for (v = 0; v < num_vertices; v++) {
+        e = (v == 0) ? 0 : end[v - 1];
+        qsort(targets + e, end[v] - e, sizeof(uint32_t), compare_vertices);
+    }
+    memcpy(g->targets, targets, num_edges * sizeof(uint32_t));
+
+    free(end);
+    free(targets);
+    return g;
+}
+
+
+/* Build a synthetic R-MAT graph with 2^scale vertices and edge_factor edges
+ * per vertex.  Each edge picks one quadrant of the adjacency matrix per bit
+ * of the vertex numbers, so that a few vertices get most of the edges.  The
+ * vertices are then numbered in a random order, as they would be in a real
+ * data set, so that the skew doesn't also hand the numbering good locality.
+ * Returns NULL if the pool doesn't have room for the graph.
+ */
+vmgraph_t * vmgraph_rmat(int scale, int edge_factor, uint64_t seed) {
+    vmgraph_t *g;
+    uint32_t *src, *dst, *perm, num_vertices, num_edges, e, u, v, t;
+    uint64_t state = seed;
+    double r;
+    int bit;
+
+    assert(scale > 0 && scale < 32);
+    assert(edge_factor > 0);
+
+    num_vertices = 1u << scale;
+    num_edges = num_vertices * edge_factor;
+
+    src = malloc(num_edges * sizeof(uint32_t));
+    dst = malloc(num_edges * sizeof(uint32_t));
+    perm = malloc(num_vertices * sizeof(uint32_t));
+    if (src == NULL || dst == NULL || perm == NULL) {
+        fprintf(stderr, "vmgraph_rmat: out of memory\n");
+        abort();
+    }
+
+    for (e = 0; e < num_edges; e++) {
+        u = 0;
+        v = 0;
+        for (bit = 0; bit < scale; bit++) {
+            r = (splitmix64_next(&state) >> 11) * 0x1.0p-53;
+            if (r >= RMAT_A + RMAT_B + RMAT_C) {
+                u |= 1u << bit;
+                v |= 1u << bit;
+            }
+            else if (r >= RMAT_A + RMAT_B)
+                u |= 1u << bit;
+            else if (r >= RMAT_A)
+                v |= 1u << bit;
+        }
+        src[e] = u;
+        dst[e] = v;
+    }
+
+    /* Shuffle the vertex numbers. */
+    for (v = 0; v < num_vertices; v++)
+        perm[v] = v;
+    for (v = num_vertices - 1; v > 0; v--) {
+        u = splitmix64_next(&state) % (v + 1);
+        t = perm[v];
+        perm[v] = perm[u];
+        perm[u] = t;
+    }
+    for (e = 0; e < num_edges; e++) {
+        src[e] = perm[src[e]];
+        dst[e] = perm[dst[e]];
+    }
+
+    g = vmgraph_from_edges(num_vertices, num_edges, src, dst);
+
+    free(src);
+    free(dst);
+    free(perm);
+    return g;
+}
+
+
+/* Load a graph from a text file listing one edge per line, as the numbers of
+ * its source and destination vertices separated by white space.  Lines that
+ * start with '#' or '%', as in the SNAP and Matrix Market formats, are
+ * skipped.  The graph has one more vertex than the largest number in the
+ * file.  Returns NULL if the file can't be read or holds no edges, or if the
+ * pool doesn't have room for the graph.
+ */
+vmgraph_t * vmgraph_load(const char *path) {
+    vmgraph_t *g;
+    FILE *f;
+    char line[256];
+    unsigned long u, v, max_vertex = 0;
+    uint32_t *src = NULL, *dst = NULL, num_edges = 0, capacity = 0;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '%')
+            continue;
+        if (sscanf(line, "%lu %lu", &u, &v) != 2)
+            continue;
+        /* The graph needs one more vertex than the largest number, and its
+         * offsets one more entry than that, which must still fit.
+         */
+        if (u >= UINT32_MAX - 1 || v >= UINT32_MAX - 1) {
+            fprintf(stderr, "%s: vertex number too large\n", path);
+            fclose(f);
+            free(src);
+            free(dst);
+            return NULL;
+        }
+
+        if (num_edges == capacity) {
+            capacity = (capacity == 0) ? 1024 : 2 * capacity;
+            src = realloc(src, capacity * sizeof(uint32_t));
+            dst = realloc(dst, capacity * sizeof(uint32_t));
+            if (src == NULL || dst == NULL) {
+                fprintf(stderr, "vmgraph_load: out of memory\n");
+                abort();
+            }
+        }
+        src[num_edges] = u;
+        dst[num_edges] = v;
+        num_edges++;
+        if (u > max_vertex)
+            max_vertex = u;
+        if (v > max_vertex)
+            max_vertex = v;
+    }
+    fclose(f);
+
+    if (num_edges == 0) {
+        fprintf(stderr, "%s: no edges\n", path);
+        return NULL;
+    }
+
+    g = vmgraph_from_edges(max_vertex + 1, num_edges, src, dst);
+
+    free(src);
+    free(dst);
+    return g;
+}
+
+
+/* Returns a malloc()'d array listing the vertices in the order a breadth-first
+ * search from root visits them; when the search runs out, it carries on from
+ * the lowest-numbered vertex not visited yet.  Numbering the vertices in this
+ * order gives the vertices on each edge nearby numbers.
+ */
+uint32_t * vmgraph_bfs_order(const vmgraph_t *g, uint32_t root) {
+    uint32_t *order, n = g->num_vertices, head = 0, count = 0, next = 0;
+    uint32_t u, e;
+    char *seen;
+
+    assert(root < n);
+
+    order = malloc(n * sizeof(uint32_t));
+    seen = calloc(n, 1);
+    if (order == NULL || seen == NULL) {
+        fprintf(stderr, "vmgraph_bfs_order: out of memory\n");
+        abort();
+    }
+
+    /* The order doubles as the search queue. */
+    while (count < n) {
+        if (head == count) {
+            if (count == 0) {
+                u = root;
+            }
+            else {
+                while (seen[next])
+                    next++;
+                u = next;
+            }
+            seen[u] = 1;
+            order[count++] = u;
+        }
+
+        u = order[head++];
+        for (e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            if (!seen[g->targets[e]]) {
+                seen[g->targets[e]] = 1;
+                order[count++] = g->targets[e];
+            }
+        }
+    }
+
+    free(seen);
+    return order;
+}
+
+
+/* A vertex and the number of edges it is on, for vmgraph_degree_order(). */
+typedef struct vertex_degree_t {
+    uint32_t degree;
+    uint32_t vertex;
+} vertex_degree_t;
+
+
+/* Orders vertices by decreasing degree, and then by number. */
+static int compare_degrees(const void *a, const void *b) {
+    const vertex_degree_t *va = a, *vb = b;
+
+    if (va->degree != vb->degree)
+        return (va->degree > vb->degree) ? -1 : 1;
+    return (va->vertex > vb->vertex) - (va->vertex < vb->vertex);
+}
+
+
+/* Returns a malloc()'d array listing the vertices from the most edges (in and
+ * out) to the fewest.  Numbering the vertices in this order packs the busiest
+ * ones onto a few pages, which then stay resident.
+ */
+uint32_t * vmgraph_degree_order(const vmgraph_t *g) {
+    vertex_degree_t *degrees;
+    uint32_t *order, n = g->num_vertices, v, e;
+
+    order = malloc(n * sizeof(uint32_t));
+    degrees = malloc(n * sizeof(vertex_degree_t));
+    if (order == NULL || degrees == NULL) {
+        fprintf(stderr, "vmgraph_degree_order: out of memory\n");
+        abort();
+    }
+
+    for (v = 0; v < n; v++) {
+        degrees[v].degree = g->offsets[v + 1] - g->offsets[v];
+        degrees[v].vertex = v;
+    }
+    for (e = 0; e < g->num_edges; e++)
+        degrees[g->targets[e]].degree++;
+
+    qsort(degrees, n, sizeof(vertex_degree_t), compare_degrees);
+    for (v = 0; v < n; v++)
+        order[v] = degrees[v].vertex;
+
+    free(degrees);
+    return order;
+}
+
+
+/* Build a copy of g with its vertices renumbered, so that vertex order[i]
+ * becomes vertex i.  order must list every vertex exactly once.  Returns
+ * NULL if the pool doesn't have room for the copy.
+ */
+vmgraph_t * vmgraph_reorder(const vmgraph_t *g, const uint32_t *order) {
+    vmgraph_t *copy;
+    uint32_t *new_id, *src, *dst, n = g->num_vertices, u, e;
+
+    new_id = malloc(n * sizeof(uint32_t));
+    src = malloc((g->num_edges > 0 ? g->num_edges : 1) * sizeof(uint32_t));
+    dst = malloc((g->num_edges > 0 ? g->num_edges : 1) * sizeof(uint32_t));
+    if (new_id == NULL || src == NULL || dst == NULL) {
+        fprintf(stderr, "vmgraph_reorder: out of memory\n");
+        abort();
+    }
+
+    for (u = 0; u < n; u++)
+        new_id[order[u]] = u;
+    for (u = 0; u < n; u++) {
+        for (e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            src[e] = new_id[u];
+            dst[e] = new_id[g->targets[e]];
+        }
+    }
+
+    copy = vmgraph_from_edges(n, g->num_edges, src, dst);
+
+    free(new_id);
+    free(src);
+    free(dst);
+    return copy;
+}
+
+
+/* Run a breadth-first search of g from root, storing into level the number
+ * of edges on the shortest path from root to each vertex, or
+ * VMGRAPH_UNREACHED if there is none.  level has an entry per vertex, and is
+ * normally in the pool too; the search queue is allocated from the pool
+ * while the search runs.  Returns the number of edges examined, or -1 if
+ * the pool has no room for the queue.
+ */
+long vmgraph_bfs(const vmgraph_t *g, uint32_t root, uint32_t *level) {
+    uint32_t *queue, n = g->num_vertices, head = 0, tail = 0, u, v, e;
+    long edges = 0;
+    void *mark;
+
+    assert(root < n);
+
+    mark = vmem_alloc_mark();
+    queue = vmem_alloc_aligned(n * sizeof(uint32_t), PAGE_SIZE);
+    if (queue == NULL)
+        return -1;
+
+    for (v = 0; v < n; v++)
+        level[v] = VMGRAPH_UNREACHED;
+    level[root] = 0;
+    queue[tail++] = root;
+
+    while (head < tail) {
+        u = queue[head++];
+        for (e = g->offsets[u]; e < g->offsets[u + 1]; e++) {
+            v = g->targets[e];
+            edges++;
+            if (level[v] == VMGRAPH_UNREACHED) {
+                level[v] = level[u] + 1;
+                queue[tail++] = v;
+            }
+        }
+    }
+
+    vmem_alloc_release(mark);
+    return edges;
+}
+
+
+/* Run the specified number of PageRank iterations over g, with the given
+ * damping factor, leaving each vertex's rank in rank, which has an entry per
+ * vertex and is normally in the pool too.  Each iteration pushes every
+ * vertex's rank along its edges, so rank is read in order while the next
+ * iteration's ranks, which are allocated from the pool while this runs, are
+ * updated all over the place.  Vertices without edges spread their rank over
+ * every vertex.  Returns the number of edges traversed, or -1 if the pool has
+ * no room for the next iteration's ranks.
+ */
+long vmgraph_pagerank(const vmgraph_t *g, int iterations, double damping,
+                      double *rank) {
+    uint32_t n = g->num_vertices, u, v, e, degree;
+    double *next, share, dangling, base;
+    long edges = 0;
+    void *mark;
+    int i;
+
+    assert(n > 0);
+    assert(damping >= 0.0 && damping <= 1.0);
+
+    mark = vmem_alloc_mark();
+    next = vmem_alloc_aligned(n * sizeof(double), PAGE_SIZE);
+    if (next == NULL)
+        return -1;
+
+    for (v = 0; v < n; v++)
+        rank[v] = 1.0 / n;
+
+    for (i = 0; i < iterations; i++) {
+        for (v = 0; v < n; v++)
+            next[v] = 0.0;
+
+        dangling = 0.0;
+        for (u = 0; u < n; u++) {
+            degree = g->offsets[u + 1] - g->offsets[u];
+            if (degree == 0) {
+                dangling += rank[u];
+                continue;
+            }
+            share = rank[u] / degree;
+            for (e = g->offsets[u]; e < g->offsets[u + 1]; e++)
+                next[g->targets[e]] += share;
+            edges += degree;
+        }
+
+        base = (1.0 - damping + damping * dangling) / n;
+        for (v = 0; v < n; v++)
+            rank[v] = base + damping * next[v];
+    }
+
+    vmem_alloc_release(mark);
+    return edges;
+}
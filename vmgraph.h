@@ -0,0 +1,51 @@
+/*============================================================================
+ * Declarations for a directed graph in compressed sparse row (CSR) form that
+ * lives in the virtual memory pool, with breadth-first search and PageRank
+ * over it.  Both follow edges to vertices all over the graph, so they touch
+ * per-vertex data in an order set by the graph rather than by the layout,
+ * which is the pointer-chasing pattern that page replacement policies find
+ * hardest.  Renumbering the vertices so that neighbors get nearby numbers
+ * (see vmgraph_bfs_order() and vmgraph_degree_order()) puts them on fewer
+ * pages.
+ */
+
+
+#ifndef VMGRAPH_H
+#define VMGRAPH_H
+
+#include <stdint.h>
+
+#include "virtualmem.h"
+
+
+/* The level vmgraph_bfs() gives vertices that the search never reaches. */
+#define VMGRAPH_UNREACHED UINT32_MAX
+
+
+/* A graph in CSR form.  The edges leaving vertex v go to the vertices
+ * targets[offsets[v]] up to (but not including) targets[offsets[v + 1]],
+ * sorted by number.  Both arrays start on page boundaries.
+ */
+typedef struct vmgraph_t {
+    uint32_t num_vertices;
+    uint32_t num_edges;
+    uint32_t *offsets;          /* num_vertices + 1 entries. */
+    uint32_t *targets;          /* num_edges entries.        */
+} vmgraph_t;
+
+
+vmgraph_t * vmgraph_from_edges(uint32_t num_vertices, uint32_t num_edges,
+                               const uint32_t *src, const uint32_t *dst);
+vmgraph_t * vmgraph_rmat(int scale, int edge_factor, uint64_t seed);
+vmgraph_t * vmgraph_load(const char *path);
+
+uint32_t * vmgraph_bfs_order(const vmgraph_t *g, uint32_t root);
+uint32_t * vmgraph_degree_order(const vmgraph_t *g);
+vmgraph_t * vmgraph_reorder(const vmgraph_t *g, const uint32_t *order);
+
+long vmgraph_bfs(const vmgraph_t *g, uint32_t root, uint32_t *level);
+long vmgraph_pagerank(const vmgraph_t *g, int iterations, double damping,
+                      double *rank);
+
+
+#endif /* VMGRAPH_H */
@@ -0,0 +1,279 @@
+/*============================================================================
+ * Implementation of the page-aware cuckoo hash table declared in vmhash.h.
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "splitmix.h"
+#include "vmalloc.h"
+#include "vmhash.h"
+
+
+/* Mixes a key with one of the table's seeds.  splitmix64() is cheap and
+ * spreads every input bit over the result.
+ */
+static uint64_t hash_key(uint64_t key, uint64_t seed) {
+    return splitmix64(key + seed);
+}
+
+
+/* Returns the first of the two buckets that key may be stored in. */
+static uint32_t first_bucket(const vmhash_t *t, uint64_t key) {
+    return hash_key(key, t->seed) % t->num_buckets;
+}
+
+
+/* Returns the other bucket that key may be stored in, given one of them.
+ * The two are always different when there is more than one bucket.
+ */
+static uint32_t other_bucket(const vmhash_t *t, uint64_t key, uint32_t b) {
+    uint32_t b1 = first_bucket(t, key);
+    uint32_t b2 = hash_key(key, ~t->seed) % t->num_buckets;
+
+    if (b2 == b1)
+        b2 = (b1 + 1) % t->num_buckets;
+    return (b == b1) ? b2 : b1;
+}
+
+
+/* Returns the index of key within bucket b, or -1 if it isn't there. */
+static int find_in_bucket(const vmhash_t *t, uint32_t b, uint64_t key) {
+    const vmhash_bucket_t *bucket = &t->buckets[b];
+    int i;
+
+    for (i = 0; i < bucket->count; i++) {
+        if (bucket->entries[i].key == key)
+            return i;
+    }
+    return -1;
+}
+
+
+/* Create an empty hash table in the virtual memory pool, with enough buckets
+ * to hold capacity keys with the given fraction of the slots in use (or
+ * VMHASH_DEFAULT_LOAD if load is 0).  The seed chooses the hash functions.
+ * Every bucket page is written once here, to clear its count.  Returns NULL
+ * if the pool doesn't have room for the table.
+ */
+vmhash_t * vmhash_create(unsigned int capacity, double load, uint64_t seed) {
+    vmhash_t *t;
+    uint32_t b;
+
+    assert(sizeof(vmhash_bucket_t) == PAGE_SIZE);
+
+    if (load <= 0.0)
+        load = VMHASH_DEFAULT_LOAD;
+    assert(load <= 1.0);
+
+    t = vmem_alloc(sizeof(vmhash_t));
+    if (t == NULL)
+        return NULL;
+
+    t->num_buckets = (uint32_t) (capacity / (VMHASH_SLOTS * load)) + 1;
+    if (t->num_buckets < 2)
+        t->num_buckets = 2;
+    t->count = 0;
+    t->seed = seed;
+    t->kick_state = seed;
+
+    t->buckets = vmem_alloc_aligned(t->num_buckets * PAGE_SIZE, PAGE_SIZE);
+    if (t->buckets == NULL)
+        return NULL;
+
+    for (b = 0; b < t->num_buckets; b++)
+        t->buckets[b].count = 0;
+
+    return t;
+}
+
+
+/* Insert key into the table with the specified value, replacing the value if
+ * the key is already present.  A new key goes into whichever of its buckets
+ * has room; if neither does, it displaces a key from one of them, which moves
+ * to its own other bucket, and so on.  Returns nonzero on success, or 0 if the
+ * table is too full, in which case the displacements are undone and the table
+ * is left as it was.
+ */
+int vmhash_insert(vmhash_t *t, uint64_t key, uint64_t value) {
+    vmhash_bucket_t *bucket;
+    vmhash_entry_t entry, victim;
+    uint32_t b, b2, path_bucket[VMHASH_MAX_KICKS];
+    int i, kicks, path_slot[VMHASH_MAX_KICKS];
+
+    assert(t != NULL);
+
+    b = first_bucket(t, key);
+    b2 = other_bucket(t, key, b);
+    if ((i = find_in_bucket(t, b, key)) >= 0) {
+        t->buckets[b].entries[i].value = value;
+        return 1;
+    }
+    if ((i = find_in_bucket(t, b2, key)) >= 0) {
+        t->buckets[b2].entries[i].value = value;
+        return 1;
+    }
+
+    /* Prefer the emptier bucket, which keeps the buckets evenly loaded. */
+    if (t->buckets[b2].count < t->buckets[b].count)
+        b = b2;
+
+    entry.key = key;
+    entry.value = value;
+    for (kicks = 0; ; kicks++) {
+        bucket = &t->buckets[b];
+        if (bucket->count < VMHASH_SLOTS) {
+            bucket->entries[bucket->count++] = entry;
+            t->count++;
+            return 1;
+        }
+        if (kicks == VMHASH_MAX_KICKS)
+            break;
+
+        /* The bucket is full:  swap the entry with a random one in it, and
+         * try to place that one in its other bucket.  The table has its own
+         * generator, so the layout depends only on the seed and the keys.
+         */
+        i = splitmix64_next(&t->kick_state) % VMHASH_SLOTS;
+        victim = bucket->entries[i];
+        bucket->entries[i] = entry;
+        entry = victim;
+        path_bucket[kicks] = b;
+        path_slot[kicks] = i;
+        b = other_bucket(t, entry.key, b);
+    }
+
+    /* Put every displaced entry back, ending up with the new one again. */
+    while (kicks-- > 0) {
+        bucket = &t->buckets[path_bucket[kicks]];
+        victim = bucket->entries[path_slot[kicks]];
+        bucket->entries[path_slot[kicks]] = entry;
+        entry = victim;
+    }
+    assert(entry.key == key);
+
+    fprintf(stderr, "vmhash_insert: table is full (%u keys in %u buckets)\n",
+            t->count, t->num_buckets);
+    return 0;
+}
+
+
+/* Look up key in the table.  If it is present, its value is stored into
+ * *value (if value isn't NULL) and nonzero is returned; otherwise 0 is
+ * returned.  At most the key's two bucket pages are touched.
+ */
+int vmhash_lookup(const vmhash_t *t, uint64_t key, uint64_t *value) {
+    uint32_t b;
+    int i;
+
+    assert(t != NULL);
+
+    b = first_bucket(t, key);
+    if ((i = find_in_bucket(t, b, key)) < 0) {
+        b = other_bucket(t, key, b);
+        if ((i = find_in_bucket(t, b, key)) < 0)
+            return 0;
+    }
+
+    if (value != NULL)
+        *value = t->buckets[b].entries[i].value;
+    return 1;
+}
+
+
+/* Remove key from the table.  Returns nonzero if it was present, or 0 if it
+ * wasn't.
+ */
+int vmhash_remove(vmhash_t *t, uint64_t key) {
+    vmhash_bucket_t *bucket;
+    uint32_t b;
+    int i;
+
+    assert(t != NULL);
+
+    b = first_bucket(t, key);
+    if ((i = find_in_bucket(t, b, key)) < 0) {
+        b = other_bucket(t, key, b);
+        if ((i = find_in_bucket(t, b, key)) < 0)
+            return 0;
+    }
+
+    /* Fill the hole with the bucket's last entry. */
+    bucket = &t->buckets[b];
+    bucket->entries[i] = bucket->entries[--bucket->count];
+    t->count--;
+    return 1;
+}
+
+
+/* A lookup waiting to probe a bucket, for vmhash_lookup_batch(). */
+typedef struct probe_t {
+    uint32_t bucket;
+    int index;
+} probe_t;
+
+
+/* Orders probes by bucket, and then by their position in the batch. */
+static int compare_probes(const void *a, const void *b) {
+    const probe_t *pa = a, *pb = b;
+
+    if (pa->bucket != pb->bucket)
+        return (pa->bucket < pb->bucket) ? -1 : 1;
+    return pa->index - pb->index;
+}
+
+
+/* Look up the n keys in keys, storing each one's value into the matching
+ * element of values and setting the matching element of found to nonzero if
+ * the key is present, or to 0 if it isn't.  Rather than probing in the order
+ * given, the probes are sorted by bucket, so each bucket page is visited once
+ * per batch however many of the keys hash to it:  first every key's first
+ * bucket, and then the other bucket of every key not found yet.  Returns the
+ * number of keys found.
+ */
+int vmhash_lookup_batch(const vmhash_t *t, const uint64_t *keys, int n,
+                        uint64_t *values, char *found) {
+    probe_t *probes;
+    int i, j, k, slot, num_found = 0, round;
+
+    assert(t != NULL);
+    assert(n >= 0);
+
+    probes = malloc(n * sizeof(probe_t));
+    if (probes == NULL && n > 0) {
+        fprintf(stderr, "vmhash_lookup_batch: out of memory\n");
+        abort();
+    }
+
+    for (i = 0; i < n; i++) {
+        found[i] = 0;
+        probes[i].bucket = first_bucket(t, keys[i]);
+        probes[i].index = i;
+    }
+
+    for (round = 0; round < 2 && n > 0; round++) {
+        qsort(probes, n, sizeof(probe_t), compare_probes);
+
+        /* Probe in bucket order, keeping the misses for the next round. */
+        for (i = 0, j = 0; i < n; i++) {
+            k = probes[i].index;
+            slot = find_in_bucket(t, probes[i].bucket, keys[k]);
+            if (slot >= 0) {
+                values[k] = t->buckets[probes[i].bucket].entries[slot].value;
+                found[k] = 1;
+                num_found++;
+            }
+            else if (round == 0) {
+                probes[j].bucket = other_bucket(t, keys[k], probes[i].bucket);
+                probes[j].index = k;
+                j++;
+            }
+        }
+        n = j;
+    }
+
+    free(probes);
+    return num_found;
+}
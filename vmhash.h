@@ -0,0 +1,64 @@
+/*============================================================================
+ * Declarations for a hash table that lives in the virtual memory pool.  It
+ * maps 64-bit keys to 64-bit values, and is laid out for paging:  every
+ * bucket is exactly one page, and cuckoo hashing keeps each key in one of
+ * only two buckets, so that a lookup touches at most two bucket pages.
+ *
+ * The allocator can't free memory, so the table never grows; it is sized for
+ * a given number of keys when it is created.
+ */
+
+
+#ifndef VMHASH_H
+#define VMHASH_H
+
+#include <stdint.h>
+
+#include "virtualmem.h"
+
+
+/* The number of key/value slots in each page-sized bucket.  One slot's worth
+ * of space holds the bucket's count.
+ */
+#define VMHASH_SLOTS (PAGE_SIZE / sizeof(vmhash_entry_t) - 1)
+
+/* The fraction of the slots that vmhash_create() plans to fill, when it is
+ * given 0.  Cuckoo hashing with buckets this large works well up to about
+ * 95% full.
+ */
+#define VMHASH_DEFAULT_LOAD 0.9
+
+/* How many keys an insert may displace before it gives up. */
+#define VMHASH_MAX_KICKS 500
+
+
+typedef struct vmhash_entry_t {
+    uint64_t key;
+    uint64_t value;
+} vmhash_entry_t;
+
+/* A bucket fills exactly one page.  Only the first count entries are used. */
+typedef struct vmhash_bucket_t {
+    uint32_t count;
+    uint32_t pad[3];
+    vmhash_entry_t entries[VMHASH_SLOTS];
+} vmhash_bucket_t;
+
+typedef struct vmhash_t {
+    uint32_t num_buckets;
+    uint32_t count;
+    uint64_t seed;
+    uint64_t kick_state;        /* Chooses the entries that inserts kick. */
+    vmhash_bucket_t *buckets;   /* Page-aligned array of num_buckets. */
+} vmhash_t;
+
+
+vmhash_t * vmhash_create(unsigned int capacity, double load, uint64_t seed);
+int vmhash_insert(vmhash_t *t, uint64_t key, uint64_t value);
+int vmhash_lookup(const vmhash_t *t, uint64_t key, uint64_t *value);
+int vmhash_remove(vmhash_t *t, uint64_t key);
+int vmhash_lookup_batch(const vmhash_t *t, const uint64_t *keys, int n,
+                        uint64_t *values, char *found);
+
+
+#endif /* VMHASH_H */
@@ -11,6 +11,14 @@
 
 #include "virtualmem.h"
 
+
+/* The number of distinct page numbers (every value of page_t), for policies
+ * that find a page's state through an array indexed by page number.  This is
+ * more than NUM_PAGES, since policy_bench drives the policies with page
+ * numbers of its own.
+ */
+#define POLICY_PAGE_RANGE 65536
+
 /* Called by vmem_init() to initialize the page replacement policy.  The
  * function should return nonzero for successful initialization, 0 otherwise.
  */
@@ -29,6 +37,15 @@ void policy_page_mapped(page_t page);
  */
 void policy_timer_tick(void);
 
+/* Called by vmem_advise() to pass on what the program expects of a resident
+ * page:  VMEM_ADVICE_REUSE if it will be used again soon, so it should be
+ * kept; VMEM_ADVICE_CYCLIC if it was just visited by a pass over a range that
+ * will be repeated, so the pages visited most recently are the ones needed
+ * last; or VMEM_ADVICE_STREAM if it won't be used again, so it should be
+ * evicted before anything else.  Policies are free to ignore the advice.
+ */
+void policy_page_advice(page_t page, int advice);
+
 /* Called by map_page() when space needs to be made for another virtual page
  * to be mapped, by evicting a currently mapped page.  Note that this function
  * both chooses a page to evict, and records in the paging policy that the page
@@ -28,6 +28,10 @@ typedef struct __page_node {
     struct __page_node *prev;
     /* Next node */ 
     struct __page_node *next;
+    /* VMEM_ADVICE_STREAM if the program has said it is done with the page,
+     * VMEM_ADVICE_CYCLIC if it has said it will come back to it later, or 0.
+     */
+    int advice;
 } page_node;
 
 /* "Loaded Pages" Data Structure
@@ -59,27 +63,40 @@ typedef struct loaded_pages_t {
 /* The list of pages that are currently resident. */
 static loaded_pages_t *loaded;
 
+/* The node of each resident page, or NULL, so that advice about a page
+ * doesn't have to search the queue for it.
+ */
+static page_node **nodes;
+
+/* The last of the streamed pages, which always sit at the very front of the
+ * queue, or NULL if there are none.  Cyclic pages are inserted after it.
+ */
+static page_node *last_stream;
+
 
 /* Initialize the policy.  Return nonzero for success, 0 for failure. */
 int policy_init(int max_resident) {
     fprintf(stderr, "Using CLOCK/LRU eviction policy.\n\n");
     
     loaded = malloc(sizeof(loaded_pages_t));
+    nodes = calloc(POLICY_PAGE_RANGE, sizeof(page_node *));
     if (loaded) {
         loaded->max_resident = max_resident;
         loaded->head = NULL;
         loaded->tail = NULL;
         loaded->num_loaded = 0;
     }
+    last_stream = NULL;
     
     /* Return nonzero if initialization succeeded. */
-    return (loaded != NULL);
+    return (loaded != NULL && nodes != NULL);
 }
 
 
 /* Clean up the data used by the page replacement policy. */
 void policy_cleanup(void) {
     free(loaded);
+    free(nodes);
 }
 
 
@@ -98,6 +115,8 @@ void policy_page_mapped(page_t page) {
     node->page = page;
     node->prev = NULL;
     node->next = NULL;
+    node->advice = 0;
+    nodes[page] = node;
 
     /* If queue is empty, set head and tail to the new page node */ 
     if(loaded->head == NULL) {
@@ -117,6 +136,17 @@ void policy_page_mapped(page_t page) {
 }
 
 
+/* Takes node out of the streamed pages at the front of the queue, if it is
+ * one of them, before it is moved, evicted or loses its advice.  The head's
+ * prev pointer isn't kept up to date when pages are evicted, so don't rely
+ * on it.
+ */
+static void leave_stream(page_node *node) {
+    if (node == last_stream)
+        last_stream = (node == loaded->head) ? NULL : node->prev;
+}
+
+
 /* This function is called when the virtual memory system has a timer tick.
  * Traverse throught the FIFO queue and move the accessed pages to the back.
  * In this way, the pages that have not been accessed for a while will be
@@ -138,12 +168,20 @@ void policy_timer_tick(void) {
 
         /* If the page has been accessed, move it to the back of the queue */ 
         if(is_page_accessed(page)) { 
-            /* Clear its accessed bit */ 
+            /* Clear its accessed bit, and any advice about it */ 
             clear_page_accessed(page);
+            leave_stream(node);
+            node->advice = 0;
             /* Update permission to NONE, so that we know if it gets 
              * accessed again */ 
             set_page_permission(page, PAGEPERM_NONE);
 
+            /* A node that is already at the back stays where it is */ 
+            if(node == loaded->tail) {
+                node = next_node;
+                continue;
+            }
+
             /* If node is the head update the head to be the second node, 
              * so that the node gets removed */
             if(node == loaded->head) {
@@ -152,7 +190,7 @@ void policy_timer_tick(void) {
             }
 
             /* If the node is between the head and tail, remove it */ 
-            else if(node != loaded->tail) {
+            else {
                 node->prev->next = node->next;
                 node->next->prev = node->prev;
             }
@@ -171,6 +209,75 @@ void policy_timer_tick(void) {
 }
 
 
+/* Links node into the queue directly after the node after, or at the front
+ * of the queue if after is NULL.
+ */
+static void insert_after(page_node *node, page_node *after) {
+    node->prev = after;
+    if (after == NULL) {
+        node->next = loaded->head;
+        loaded->head = node;
+    }
+    else {
+        node->next = after->next;
+        after->next = node;
+    }
+
+    if (node->next == NULL)
+        loaded->tail = node;
+    else
+        node->next->prev = node;
+}
+
+
+/* This function is called when the program gives advice about a resident
+ * page.  Pages that the program is done with go to the front of the queue,
+ * to be evicted next.  Pages visited by a repeated pass go just behind those,
+ * so that the last page visited is the first evicted and the start of the
+ * range survives until the next pass.  Either way the page's accessed bit is
+ * cleared, so that the next timer tick leaves it there unless it is touched
+ * again.  Pages that will be reused go to the back, as if just accessed.
+ */
+void policy_page_advice(page_t page, int advice) {
+    page_node *node = nodes[page], *prev, *after;
+
+    if (node == NULL)
+        return;
+
+    /* Unlink the node.  The head's prev pointer isn't kept up to date when
+     * pages are evicted, so don't rely on it.
+     */ 
+    leave_stream(node);
+    prev = (node == loaded->head) ? NULL : node->prev;
+    if (prev == NULL)
+        loaded->head = node->next;
+    else
+        prev->next = node->next;
+    if (node->next == NULL)
+        loaded->tail = prev;
+    else
+        node->next->prev = prev;
+
+    if (advice == VMEM_ADVICE_REUSE) {
+        node->advice = 0;
+        insert_after(node, loaded->tail);
+        return;
+    }
+
+    clear_page_accessed(page);
+    set_page_permission(page, PAGEPERM_NONE);
+
+    /* Streamed pages go to the very front of the queue, and cyclic pages
+     * after the last of them.
+     */
+    node->advice = advice;
+    after = (advice == VMEM_ADVICE_CYCLIC) ? last_stream : NULL;
+    if (advice == VMEM_ADVICE_STREAM && last_stream == NULL)
+        last_stream = node;
+    insert_after(node, after);
+}
+
+
 /* Choose a page to evict from the collection of mapped pages.  Then, record
  * that it is evicted.  We evict the head of the queue, since it is a FIFO
  * implementation. 
@@ -179,10 +286,12 @@ page_t choose_and_evict_victim_page(void) {
     /* Evict first page of the queue */ 
     page_t victim = loaded->head->page;
     page_node *temp = loaded->head;
+    leave_stream(temp);
     loaded->head = loaded->head->next;
 
     /* Free the page node of the evicted page */ 
     free(temp);
+    nodes[victim] = NULL;
 
     /* Decrement number of loaded pages */ 
     loaded->num_loaded--;
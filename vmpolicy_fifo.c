@@ -25,8 +25,14 @@
 typedef struct __page_node {
     /* Data: the page */ 
     page_t page;
+    /* Previous node */ 
+    struct __page_node *prev;
     /* Next node */ 
     struct __page_node *next;
+    /* VMEM_ADVICE_STREAM if the program has said it is done with the page,
+     * VMEM_ADVICE_CYCLIC if it has said it will come back to it later, or 0.
+     */
+    int advice;
 } page_node;
 
 
@@ -54,26 +60,39 @@ typedef struct loaded_pages_t {
 /* The list of pages that are currently resident. */
 static loaded_pages_t *loaded;
 
+/* The node of each resident page, or NULL, so that advice about a page
+ * doesn't have to search the queue for it.
+ */
+static page_node **nodes;
+
+/* The last of the streamed pages, which always sit at the very front of the
+ * queue, or NULL if there are none.  Cyclic pages are inserted after it.
+ */
+static page_node *last_stream;
+
 
 /* Initialize the policy.  Return nonzero for success, 0 for failure. */
 int policy_init(int max_resident) {
     fprintf(stderr, "Using FIFO eviction policy.\n\n");
     
     loaded = malloc(sizeof(loaded_pages_t));
+    nodes = calloc(POLICY_PAGE_RANGE, sizeof(page_node *));
     if (loaded) {
         loaded->max_resident = max_resident;
         loaded->head = NULL;
         loaded->tail = NULL;
     }
+    last_stream = NULL;
     
     /* Return nonzero if initialization succeeded. */
-    return (loaded != NULL);
+    return (loaded != NULL && nodes != NULL);
 }
 
 
 /* Clean up the data used by the page replacement policy. */
 void policy_cleanup(void) {
     free(loaded); 
+    free(nodes);
 }
 
 
@@ -90,7 +109,10 @@ void policy_page_mapped(page_t page) {
 
     /* Initialize page node */ 
     node->page = page;
+    node->prev = NULL;
     node->next = NULL;
+    node->advice = 0;
+    nodes[page] = node;
 
     /* If queue is empty, set head and tail to the new page node */ 
     if(loaded->head == NULL) {
@@ -100,6 +122,7 @@ void policy_page_mapped(page_t page) {
 
     /* Else, add the node at the back of the queue (we evict the front) */ 
     else {
+        node->prev = loaded->tail;
         loaded->tail->next = node;
         loaded->tail = node;
     }
@@ -112,6 +135,70 @@ void policy_timer_tick(void) {
 }
 
 
+/* This function is called when the program gives advice about a resident
+ * page.  Pages that the program is done with go to the front of the queue,
+ * to be evicted next.  Pages visited by a repeated pass go just behind those,
+ * so that the last page visited is the first evicted and the start of the
+ * range survives until the next pass.  Pages that will be reused go to the
+ * back of the queue.
+ */
+void policy_page_advice(page_t page, int advice) {
+    page_node *node = nodes[page], *prev, *after;
+
+    if (node == NULL)
+        return;
+
+    /* Unlink the node, first taking it out of the streamed pages */ 
+    prev = node->prev;
+    if (node == last_stream)
+        last_stream = prev;
+    if (prev == NULL)
+        loaded->head = node->next;
+    else
+        prev->next = node->next;
+    if (node->next == NULL)
+        loaded->tail = prev;
+    else
+        node->next->prev = prev;
+    node->prev = NULL;
+    node->next = NULL;
+
+    if (advice == VMEM_ADVICE_REUSE) {
+        /* Add the node at the back of the queue */ 
+        node->advice = 0;
+        node->prev = loaded->tail;
+        if (loaded->tail == NULL)
+            loaded->head = node;
+        else
+            loaded->tail->next = node;
+        loaded->tail = node;
+        return;
+    }
+
+    /* Streamed pages go to the very front of the queue, and cyclic pages
+     * after the last of them.
+     */
+    node->advice = advice;
+    after = (advice == VMEM_ADVICE_CYCLIC) ? last_stream : NULL;
+    if (advice == VMEM_ADVICE_STREAM && last_stream == NULL)
+        last_stream = node;
+
+    node->prev = after;
+    if (after == NULL) {
+        node->next = loaded->head;
+        loaded->head = node;
+    }
+    else {
+        node->next = after->next;
+        after->next = node;
+    }
+    if (node->next == NULL)
+        loaded->tail = node;
+    else
+        node->next->prev = node;
+}
+
+
 /* Choose a page to evict from the collection of mapped pages.  Then, record
  * that it is evicted.  We evict the head of the queue, since it is a FIFO
  * implementation. 
@@ -121,9 +208,14 @@ page_t choose_and_evict_victim_page(void) {
     page_t victim = loaded->head->page;
     page_node *temp = loaded->head;
     loaded->head = loaded->head->next;
+    if (loaded->head != NULL)
+        loaded->head->prev = NULL;
+    if (temp == last_stream)
+        last_stream = NULL;
 
     /* Free the page node of the evicted page */ 
     free(temp);
+    nodes[victim] = NULL;
 
 #if VERBOSE
     fprintf(stderr, "Choosing victim page %u to evict.\n", victim);
@@ -30,6 +30,14 @@ typedef struct loaded_pages_t {
      * less than max_resident.
      */
     int num_loaded;
+
+    /* The program's advice splits the array into three regions:  the first
+     * end_streamed pages are ones the program is done with, the pages from
+     * there up to end_cyclic were visited by a repeated pass, and the rest
+     * have no advice.  Advised pages are evicted before any others.
+     */
+    int end_streamed;
+    int end_cyclic;
     
     /* This is the array of pages that are actually loaded.  Note that only the
      * first "num_loaded" entries are actually valid.
@@ -46,19 +54,28 @@ typedef struct loaded_pages_t {
 /* The list of pages that are currently resident. */
 static loaded_pages_t *loaded;
 
+/* Where each resident page is in the pages array, so that advice about a
+ * page doesn't have to search the array for it.  The entries of pages that
+ * aren't resident are meaningless.
+ */
+static uint16_t *slot;
+
 
 /* Initialize the policy.  Return nonzero for success, 0 for failure. */
 int policy_init(int max_resident) {
     fprintf(stderr, "Using RANDOM eviction policy.\n\n");
     
     loaded = malloc(sizeof(loaded_pages_t) + max_resident * sizeof(page_t));
+    slot = malloc(POLICY_PAGE_RANGE * sizeof(uint16_t));
     if (loaded) {
         loaded->max_resident = max_resident;
         loaded->num_loaded = 0;
+        loaded->end_streamed = 0;
+        loaded->end_cyclic = 0;
     }
     
     /* Return nonzero if initialization succeeded. */
-    return (loaded != NULL);
+    return (loaded != NULL && slot != NULL);
 }
 
 
@@ -66,6 +83,8 @@ int policy_init(int max_resident) {
 void policy_cleanup(void) {
     free(loaded);
     loaded = NULL;
+    free(slot);
+    slot = NULL;
 }
 
 
@@ -75,6 +94,7 @@ void policy_cleanup(void) {
 void policy_page_mapped(page_t page) {
     assert(loaded->num_loaded < loaded->max_resident);
     loaded->pages[loaded->num_loaded] = page;
+    slot[page] = loaded->num_loaded;
     loaded->num_loaded++;
 }
 
@@ -85,23 +105,98 @@ void policy_timer_tick(void) {
 }
 
 
+/* Swaps the pages at indexes i and j of the loaded-pages array, returning j. */
+static int swap_pages(int i, int j) {
+    page_t tmp = loaded->pages[i];
+    loaded->pages[i] = loaded->pages[j];
+    loaded->pages[j] = tmp;
+    slot[loaded->pages[i]] = i;
+    slot[tmp] = j;
+    return j;
+}
+
+
+/* Moves the page at index i of the array into the next region towards the
+ * front, by swapping it with the first page past the end of that region, and
+ * returns its new index.
+ */
+static int promote(int i) {
+    if (i >= loaded->end_cyclic)
+        return swap_pages(i, loaded->end_cyclic++);
+    assert(i >= loaded->end_streamed);
+    return swap_pages(i, loaded->end_streamed++);
+}
+
+
+/* Moves the page at index i of the array into the next region towards the
+ * back, by swapping it with the last page of its current region, and returns
+ * its new index.
+ */
+static int demote(int i) {
+    if (i < loaded->end_streamed)
+        return swap_pages(i, --loaded->end_streamed);
+    assert(i < loaded->end_cyclic);
+    return swap_pages(i, --loaded->end_cyclic);
+}
+
+
+/* This function is called when the program gives advice about a resident
+ * page.  The page is moved into the region of the array that matches the
+ * advice.
+ */
+void policy_page_advice(page_t page, int advice) {
+    int i, region, target;
+
+    i = slot[page];
+    if (i >= loaded->num_loaded || loaded->pages[i] != page)
+        return;
+
+    /* Number the regions 0 (streamed), 1 (cyclic) and 2 (no advice). */
+    target = (advice == VMEM_ADVICE_STREAM) ? 0 :
+             (advice == VMEM_ADVICE_CYCLIC) ? 1 : 2;
+    region = (i < loaded->end_streamed) ? 0 : (i < loaded->end_cyclic) ? 1 : 2;
+    for (; region > target; region--)
+        i = promote(i);
+    for (; region < target; region++)
+        i = demote(i);
+
+    /* Keep the most recently visited cyclic page last in its region, where
+     * the next victim is taken from.
+     */
+    if (target == 1)
+        swap_pages(i, loaded->end_cyclic - 1);
+}
+
+
 /* Choose a page to evict from the collection of mapped pages.  Then, record
  * that it is evicted.  This is very simple since we are implementing a random
- * page-replacement policy.
+ * page-replacement policy.  The program's advice takes precedence, though:
+ * a page it is done with is evicted if there is one, and otherwise the page
+ * most recently visited by a repeated pass.
  */
 page_t choose_and_evict_victim_page(void) {
     int i_victim;
     page_t victim;
 
     /* Figure out which page to evict. */
-    i_victim = rand() % loaded->num_loaded;
+    if (loaded->end_streamed > 0)
+        i_victim = loaded->end_streamed - 1;
+    else if (loaded->end_cyclic > 0)
+        i_victim = loaded->end_cyclic - 1;
+    else
+        i_victim = rand() % loaded->num_loaded;
     victim = loaded->pages[i_victim];
 
+    /* Move the victim out of the advised regions first. */
+    while (i_victim < loaded->end_cyclic)
+        i_victim = demote(i_victim);
+
     /* Shrink the collection of loaded pages now, by moving the last page in the
      * collection into the spot that the victim just occupied.
      */
     loaded->num_loaded--;
     loaded->pages[i_victim] = loaded->pages[loaded->num_loaded];
+    slot[loaded->pages[i_victim]] = i_victim;
 
 #if VERBOSE
     fprintf(stderr, "Choosing victim page %u to evict.\n", victim);
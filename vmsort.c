@@ -0,0 +1,232 @@
+/*============================================================================
+ * Implementation of the external merge sort declared in vmsort.h.
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmsort.h"
+
+
+/* The part of an input run that a merge hasn't consumed yet. */
+typedef struct merge_run_t {
+    const uint64_t *next;
+    const uint64_t *end;
+} merge_run_t;
+
+
+/* Orders keys for qsort(). */
+static int compare_keys(const void *a, const void *b) {
+    uint64_t ka = *(const uint64_t *) a, kb = *(const uint64_t *) b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+
+/* Passes advice about the keys p[0 .. count - 1] on to the virtual memory
+ * system.
+ */
+static void advise_keys(const uint64_t *p, long count, int advice) {
+    if (count > 0)
+        vmem_advise((void *) p, count * sizeof(uint64_t), advice);
+}
+
+
+/* Moves the run at position i of a heap of run indexes down until the heap is
+ * ordered by each run's next key again.
+ */
+static void sift_down(int *heap, int size, int i, const merge_run_t *runs) {
+    int child, r = heap[i];
+    uint64_t key = *runs[r].next;
+
+    while ((child = 2 * i + 1) < size) {
+        if (child + 1 < size &&
+            *runs[heap[child + 1]].next < *runs[heap[child]].next)
+            child++;
+        if (key <= *runs[heap[child]].next)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = r;
+}
+
+
+/* Merges the sorted runs of width keys that make up src[0 .. n - 1] (the last
+ * may be shorter) into dst, which like src must be page-aligned.  Each run
+ * keeps the readahead pages after the one it is reading prefetched, and tells
+ * the pager that each page it finishes won't be needed again.  If write_behind
+ * is nonzero, every write_behind finished pages of output are written back to
+ * the swap file and likewise marked as done with.
+ */
+static void merge_runs(const uint64_t *src, uint64_t *dst, long n, long width,
+                       int readahead, int write_behind) {
+    merge_run_t *runs, *run;
+    uint64_t *out, *flushed;
+    long ra_keys = readahead * VMSORT_PAGE_KEYS;
+    long wb_keys = write_behind * VMSORT_PAGE_KEYS;
+    long ahead;
+    int *heap, i, k, size;
+
+    k = (n + width - 1) / width;
+    runs = malloc(k * sizeof(merge_run_t));
+    heap = malloc(k * sizeof(int));
+    if (runs == NULL || heap == NULL) {
+        fprintf(stderr, "merge_runs: out of memory\n");
+        abort();
+    }
+
+    for (i = 0; i < k; i++) {
+        runs[i].next = src + i * width;
+        runs[i].end = (n - i * width < width) ? src + n : runs[i].next + width;
+        if (readahead > 0) {
+            ahead = runs[i].end - runs[i].next;
+            if (ahead > ra_keys + (long) VMSORT_PAGE_KEYS)
+                ahead = ra_keys + VMSORT_PAGE_KEYS;
+            advise_keys(runs[i].next, ahead, VMEM_ADVICE_WILLNEED);
+        }
+        heap[i] = i;
+    }
+    size = k;
+    for (i = size / 2 - 1; i >= 0; i--)
+        sift_down(heap, size, i, runs);
+
+    out = dst;
+    flushed = dst;
+    while (size > 0) {
+        run = &runs[heap[0]];
+        *out++ = *run->next++;
+
+        /* On moving to a new page, let the last one go and prefetch the page
+         * readahead pages further on.
+         */
+        if ((run->next - src) % VMSORT_PAGE_KEYS == 0) {
+            advise_keys(run->next - VMSORT_PAGE_KEYS, VMSORT_PAGE_KEYS,
+                        VMEM_ADVICE_STREAM);
+            if (readahead > 0 && run->next + ra_keys < run->end) {
+                ahead = run->end - (run->next + ra_keys);
+                if (ahead > (long) VMSORT_PAGE_KEYS)
+                    ahead = VMSORT_PAGE_KEYS;
+                advise_keys(run->next + ra_keys, ahead, VMEM_ADVICE_WILLNEED);
+            }
+        }
+
+        if (run->next == run->end)
+            heap[0] = heap[--size];
+        if (size > 0)
+            sift_down(heap, size, 0, runs);
+
+        if (wb_keys > 0 && out - flushed == wb_keys) {
+            vmem_writeback(flushed, wb_keys * sizeof(uint64_t));
+            advise_keys(flushed, wb_keys, VMEM_ADVICE_STREAM);
+            flushed = out;
+        }
+    }
+
+    if (wb_keys > 0 && out > flushed) {
+        vmem_writeback(flushed, (out - flushed) * sizeof(uint64_t));
+        advise_keys(flushed, out - flushed, VMEM_ADVICE_STREAM);
+    }
+
+    free(runs);
+    free(heap);
+}
+
+
+/* Returns the number of passes needed to merge num_runs runs, fan_in at a
+ * time.
+ */
+static int count_passes(long num_runs, int fan_in) {
+    int passes = 0;
+
+    for (; num_runs > 1; num_runs = (num_runs + fan_in - 1) / fan_in)
+        passes++;
+    return passes;
+}
+
+
+/* Sorts the n keys in data into ascending order, using scratch, which must be
+ * as large, for the merge passes; both must be page-aligned.  The initial runs
+ * fill half of the resident pages, and the merges work within that half too.
+ * The number of passes is the fewest that merging one page from each run
+ * allows, and the fan-in is the smallest that still gets by with that many,
+ * since extra passes cost far more than readahead saves.  Whatever is left of
+ * the half after one page per input run and one for the output goes to the
+ * readahead pages that each input run keeps ahead of it, and then to the
+ * write_behind pages that the output holds before writing them back; both
+ * are cut down to fit.  The number of passes is worked out up front, so that
+ * the last one can end in data:  when it is odd, the runs are sorted into
+ * scratch rather than in place.  If stats isn't NULL, it is filled in.
+ */
+void vmsort(uint64_t *data, uint64_t *scratch, long n, int readahead,
+            int write_behind, vmsort_stats_t *stats) {
+    uint64_t *src, *dst, *tmp;
+    unsigned int budget;
+    long run_keys, num_runs, s, len, width, group;
+    int fan_in, passes, spare;
+
+    assert((unsigned long) data % PAGE_SIZE == 0);
+    assert((unsigned long) scratch % PAGE_SIZE == 0);
+    assert(n >= 0);
+    assert(readahead >= 0 && write_behind >= 0);
+
+    budget = vmem_get_max_resident() / 2;
+    if (budget == 0)
+        budget = 1;
+
+    run_keys = budget * VMSORT_PAGE_KEYS;
+    num_runs = (n + run_keys - 1) / run_keys;
+
+    fan_in = (budget > 2) ? (int) budget - 1 : 2;
+    passes = count_passes(num_runs, fan_in);
+    for (fan_in = 2; count_passes(num_runs, fan_in) > passes; fan_in++)
+        ;
+
+    spare = (int) budget - 1 - fan_in;
+    if (spare < 0)
+        spare = 0;
+    if (readahead > spare / fan_in)
+        readahead = spare / fan_in;
+    spare -= readahead * fan_in;
+    if (write_behind > spare)
+        write_behind = spare;
+
+    /* Sort each run where the first pass expects to find it. */
+    src = (passes % 2 == 0) ? data : scratch;
+    for (s = 0; s < n; s += run_keys) {
+        len = (n - s < run_keys) ? n - s : run_keys;
+        if (src != data) {
+            memcpy(src + s, data + s, len * sizeof(uint64_t));
+            advise_keys(data + s, len, VMEM_ADVICE_STREAM);
+        }
+        qsort(src + s, len, sizeof(uint64_t), compare_keys);
+        if (write_behind > 0)
+            vmem_writeback(src + s, len * sizeof(uint64_t));
+        advise_keys(src + s, len, VMEM_ADVICE_STREAM);
+    }
+
+    dst = (src == data) ? scratch : data;
+    for (width = run_keys; width < n; width *= fan_in) {
+        group = width * fan_in;
+        for (s = 0; s < n; s += group) {
+            merge_runs(src + s, dst + s, (n - s < group) ? n - s : group,
+                       width, readahead, write_behind);
+        }
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    assert(src == data);
+
+    if (stats != NULL) {
+        stats->num_runs = num_runs;
+        stats->run_keys = run_keys;
+        stats->fan_in = fan_in;
+        stats->num_passes = passes;
+        stats->readahead = readahead;
+        stats->write_behind = write_behind;
+    }
+}
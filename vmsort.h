@@ -0,0 +1,39 @@
+/*============================================================================
+ * Declarations for an external merge sort of 64-bit keys that live in the
+ * virtual memory pool.  The keys are first sorted in runs small enough to be
+ * resident all at once, and the runs are then merged, many at a time, in
+ * passes that stream through the pool.  While merging, each input run can
+ * read its next few pages ahead, and the output can be written back to the
+ * swap file behind the merge, so that every page is handled as a sequential
+ * stream rather than waiting on the page replacement policy.
+ */
+
+
+#ifndef VMSORT_H
+#define VMSORT_H
+
+#include <stdint.h>
+
+#include "virtualmem.h"
+
+
+/* The number of keys in a page. */
+#define VMSORT_PAGE_KEYS (PAGE_SIZE / sizeof(uint64_t))
+
+
+/* Statistics about one call to vmsort(). */
+typedef struct vmsort_stats_t {
+    long num_runs;          /* Number of initial sorted runs.        */
+    long run_keys;          /* Number of keys in each initial run.   */
+    int fan_in;             /* Most runs merged at once.             */
+    int num_passes;         /* Number of merge passes.               */
+    int readahead;          /* Readahead pages used per input run.   */
+    int write_behind;       /* Write-behind pages used.              */
+} vmsort_stats_t;
+
+
+void vmsort(uint64_t *data, uint64_t *scratch, long n, int readahead,
+            int write_behind, vmsort_stats_t *stats);
+
+
+#endif /* VMSORT_H */
@@ -0,0 +1,132 @@
+/*============================================================================
+ * Implementation of the Jacobi stencil schedules declared in vmstencil.h.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+
+#include "virtualmem.h"
+#include "vmalloc.h"
+#include "vmstencil.h"
+
+
+/* Allocate a page-aligned rows x cols grid from the virtual memory pool.
+ * Returns NULL if the pool doesn't have room for it.
+ */
+double * vmstencil_alloc(int rows, int cols) {
+    assert(rows > 0 && cols > 0);
+    return vmem_alloc_aligned(rows * cols * sizeof(double), PAGE_SIZE);
+}
+
+
+/* Computes row i of dst from the rows around it in src, copying the fixed
+ * boundary points at either end of the row across as well.  Both schedules
+ * use this, so they round identically.
+ */
+static void update_row(const double *src, double *dst, int i, int cols) {
+    const double *up = src + (i - 1) * cols, *row = src + i * cols;
+    const double *down = src + (i + 1) * cols;
+    double *out = dst + i * cols;
+    int j;
+
+    out[0] = row[0];
+    for (j = 1; j < cols - 1; j++)
+        out[j] = 0.25 * (up[j] + down[j] + row[j - 1] + row[j + 1]);
+    out[cols - 1] = row[cols - 1];
+}
+
+
+/* Copies the fixed top and bottom rows of a into b. */
+static void copy_boundary(const double *a, double *b, int rows, int cols) {
+    memcpy(b, a, cols * sizeof(double));
+    memcpy(b + (rows - 1) * cols, a + (rows - 1) * cols,
+           cols * sizeof(double));
+}
+
+
+/* Run the given number of time steps starting from the grid in a, using b as
+ * the other grid, by sweeping over the whole grid once per step.  Returns
+ * whichever of a and b holds the result.
+ */
+double * vmstencil_naive(double *a, double *b, int rows, int cols, int steps) {
+    double *tmp;
+    int i, t;
+
+    assert(rows >= 2 && cols >= 2);
+    copy_boundary(a, b, rows, cols);
+
+    for (t = 0; t < steps; t++) {
+        for (i = 1; i < rows - 1; i++)
+            update_row(a, b, i, cols);
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+    return a;
+}
+
+
+/* Returns the number of time steps that the wavefront schedule runs per
+ * sweep for grids with the specified number of columns.  A sweep of depth d
+ * works on a window of d + 2 rows of each grid, and the window is sized to
+ * fill half of the resident pages, counting each row as one page more than
+ * it fills since rows needn't start on page boundaries.
+ */
+int vmstencil_depth(int cols) {
+    int row_pages = (cols * sizeof(double) + PAGE_SIZE - 1) / PAGE_SIZE + 1;
+    int depth = vmem_get_max_resident() / 2 / (2 * row_pages) - 2;
+
+    return (depth < 1) ? 1 : depth;
+}
+
+
+/* Run the given number of time steps starting from the grid in a, using b as
+ * the other grid, sweeping over the grid once per depth steps (or per
+ * vmstencil_depth() steps, if depth is 0).  Within a sweep, row i at step t
+ * of the sweep is computed as the wavefront reaches row i + t - 1, just after
+ * the row below it at step t - 1, which is the last value it needs.  That
+ * also makes it the last use of the value it overwrites, so the two grids are
+ * enough however deep the sweep is.  Rows the wavefront has left behind
+ * won't be touched again in the sweep, so the pager is told to evict them
+ * first.  Returns whichever of a and b holds the result.
+ */
+double * vmstencil_wavefront(double *a, double *b, int rows, int cols,
+                             int steps, int depth) {
+    double *grid[2], *tmp;
+    int i, s, t, d, done;
+
+    assert(rows >= 2 && cols >= 2);
+    if (depth <= 0)
+        depth = vmstencil_depth(cols);
+    copy_boundary(a, b, rows, cols);
+
+    grid[0] = a;
+    grid[1] = b;
+    for (done = 0; done < steps; done += d) {
+        d = (steps - done < depth) ? steps - done : depth;
+
+        for (s = 1; s < rows - 1 + d - 1; s++) {
+            for (t = 1; t <= d; t++) {
+                i = s - t + 1;
+                if (i >= 1 && i < rows - 1)
+                    update_row(grid[(t - 1) % 2], grid[t % 2], i, cols);
+            }
+
+            i = s - d - 1;
+            if (i >= 1) {
+                vmem_advise(grid[0] + i * cols, cols * sizeof(double),
+                            VMEM_ADVICE_STREAM);
+                vmem_advise(grid[1] + i * cols, cols * sizeof(double),
+                            VMEM_ADVICE_STREAM);
+            }
+        }
+
+        if (d % 2 == 1) {
+            tmp = grid[0];
+            grid[0] = grid[1];
+            grid[1] = tmp;
+        }
+    }
+    return grid[0];
+}
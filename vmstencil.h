@@ -0,0 +1,25 @@
+/*============================================================================
+ * Declarations for a five-point Jacobi stencil over grids of doubles in the
+ * virtual memory pool.  Each time step replaces every interior point with
+ * the average of its four neighbors from the previous step, flipping between
+ * two grids; the boundary stays fixed.  Sweeping the whole grid once per
+ * step reads and writes every page once per step, so once the grids don't
+ * fit in memory, every step loads the grids all over again.  The wavefront
+ * schedule instead runs several steps in a single sweep, a few rows apart,
+ * so that each page is loaded once for all of them.  Both schedules do
+ * exactly the same arithmetic, so their results are identical bit for bit.
+ */
+
+
+#ifndef VMSTENCIL_H
+#define VMSTENCIL_H
+
+
+double * vmstencil_alloc(int rows, int cols);
+double * vmstencil_naive(double *a, double *b, int rows, int cols, int steps);
+int vmstencil_depth(int cols);
+double * vmstencil_wavefront(double *a, double *b, int rows, int cols,
+                             int steps, int depth);
+
+
+#endif /* VMSTENCIL_H */